@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #define HAVE_IO_URING
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+#endif
+
+#include "async_file.hpp"
+
+namespace {
+
+    std::atomic<bool> io_uring_disabled{false};
+
+    //Threads of the pwrite fallback, enough to keep a few requests queued at the device
+    constexpr std::size_t pool_threads = 4;
+
+    std::runtime_error io_error(const std::string &path, const char *what, int error) {
+        std::ostringstream err_msg_stream;
+        err_msg_stream << "Error: " << what << " \"" << path << "\": " << std::strerror(error) << "\n";
+        return std::runtime_error(err_msg_stream.str());
+    }
+
+}
+
+namespace AsyncFile {
+
+    class Queue {
+    public:
+
+        virtual ~Queue() = default;
+
+        //data stays valid and untouched until wait() has returned buffer_idx
+        virtual void submit(std::size_t buffer_idx, const unsigned char *data, std::size_t size, std::uint64_t offset) = 0;
+
+        //Blocks until a request finishes and returns its buffer. Throws std::runtime_error if it failed.
+        virtual std::size_t wait() = 0;
+
+    };
+
+}
+
+namespace {
+
+    class ThreadPoolQueue : public AsyncFile::Queue {
+    public:
+
+        ThreadPoolQueue(int fd, const std::string &path) : fd(fd), path(path) {
+            for (std::size_t i = 0; i < pool_threads; i++) threads.emplace_back(&ThreadPoolQueue::work, this);
+        }
+
+        ~ThreadPoolQueue() override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            wake_workers.notify_all();
+            for (std::thread &thread : threads) thread.join();
+        }
+
+        void submit(std::size_t buffer_idx, const unsigned char *data, std::size_t size, std::uint64_t offset) override {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back({buffer_idx, data, size, offset});
+            }
+            wake_workers.notify_one();
+        }
+
+        std::size_t wait() override {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_done.wait(lock, [&] { return !done.empty(); });
+            Done finished = done.front();
+            done.pop_front();
+            if (finished.error != 0) throw io_error(path, "Failed to write", finished.error);
+            return finished.buffer_idx;
+        }
+
+    private:
+
+        struct Job {
+            std::size_t buffer_idx;
+            const unsigned char *data;
+            std::size_t size;
+            std::uint64_t offset;
+        };
+
+        struct Done {
+            std::size_t buffer_idx;
+            int error;
+        };
+
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;) {
+                wake_workers.wait(lock, [&] { return stop || !jobs.empty(); });
+                if (jobs.empty()) return;
+                Job job = jobs.front();
+                jobs.pop_front();
+                lock.unlock();
+
+                int error = 0;
+                std::size_t written = 0;
+                while (written < job.size) {
+                    ssize_t n = ::pwrite(fd, job.data + written, job.size - written, static_cast<off_t>(job.offset + written));
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) {
+                        error = n < 0 ? errno : EIO;
+                        break;
+                    }
+                    written += static_cast<std::size_t>(n);
+                }
+
+                lock.lock();
+                done.push_back({job.buffer_idx, error});
+                job_done.notify_one();
+            }
+        }
+
+        int fd;
+        std::string path;
+
+        std::mutex mutex;
+        std::condition_variable wake_workers;
+        std::condition_variable job_done;
+        std::deque<Job> jobs;
+        std::deque<Done> done;
+        bool stop = false;
+        std::vector<std::thread> threads;
+
+    };
+
+#ifdef HAVE_IO_URING
+
+    //io_uring through the raw syscalls, liburing isn't needed for a single producer and consumer. The buffers are
+    //registered, so the kernel doesn't have to pin and map their pages again for every request.
+    class UringQueue : public AsyncFile::Queue {
+    public:
+
+        UringQueue(int fd, const std::string &path, unsigned char *buffers, std::size_t n_buffers) :
+            fd(fd), path(path), expected_sizes(n_buffers, 0) {
+
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(n_buffers), &params));
+            if (ring_fd < 0) throw io_error(path, "Failed to set up io_uring for", errno);
+
+            sq_ring_size = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+            cq_ring_size = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+            bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single_mmap) sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+            sqes_size = params.sq_entries*sizeof(io_uring_sqe);
+
+            sq_ring = map_ring(sq_ring_size, IORING_OFF_SQ_RING);
+            cq_ring = single_mmap ? sq_ring : map_ring(cq_ring_size, IORING_OFF_CQ_RING);
+            sqes = static_cast<io_uring_sqe*>(map_ring(sqes_size, IORING_OFF_SQES));
+            if (sq_ring == nullptr || cq_ring == nullptr || sqes == nullptr) {
+                int error = errno;
+                release();
+                throw io_error(path, "Failed to map the io_uring rings for", error);
+            }
+
+            sq_tail = ring_field(sq_ring, params.sq_off.tail);
+            sq_mask = *ring_field(sq_ring, params.sq_off.ring_mask);
+            sq_array = ring_field(sq_ring, params.sq_off.array);
+            cq_head = ring_field(cq_ring, params.cq_off.head);
+            cq_tail = ring_field(cq_ring, params.cq_off.tail);
+            cq_mask = *ring_field(cq_ring, params.cq_off.ring_mask);
+            cqes = reinterpret_cast<io_uring_cqe*>(static_cast<unsigned char*>(cq_ring) + params.cq_off.cqes);
+
+            //Registering counts against RLIMIT_MEMLOCK, plain writes still work when it's too low
+            std::vector<iovec> iovecs(n_buffers);
+            for (std::size_t i = 0; i < n_buffers; i++) iovecs[i] = {buffers + i*AsyncFile::buffer_size, AsyncFile::buffer_size};
+            registered = ::syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS, iovecs.data(), static_cast<unsigned>(n_buffers)) == 0;
+
+        }
+
+        ~UringQueue() override {
+            release();
+        }
+
+        void submit(std::size_t buffer_idx, const unsigned char *data, std::size_t size, std::uint64_t offset) override {
+
+            //Only this thread produces, so the tail can be read plainly
+            unsigned tail = *sq_tail;
+            unsigned idx = tail & sq_mask;
+
+            io_uring_sqe &sqe = sqes[idx];
+            std::memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe.fd = fd;
+            sqe.off = offset;
+            sqe.addr = reinterpret_cast<std::uint64_t>(data);
+            sqe.len = static_cast<std::uint32_t>(size);
+            if (registered) sqe.buf_index = static_cast<std::uint16_t>(buffer_idx);
+            sqe.user_data = buffer_idx;
+            sq_array[idx] = idx;
+            expected_sizes[buffer_idx] = size;
+
+            __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+            while (::syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0) < 0) {
+                if (errno != EINTR) throw io_error(path, "Failed to submit a write to", errno);
+            }
+
+        }
+
+        std::size_t wait() override {
+            for (;;) {
+                unsigned head = *cq_head;
+                if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+                    io_uring_cqe cqe = cqes[head & cq_mask];
+                    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+
+                    std::size_t buffer_idx = static_cast<std::size_t>(cqe.user_data);
+                    if (cqe.res < 0) throw io_error(path, "Failed to write", -cqe.res);
+                    //Direct writes to regular files don't come back short unless the disk is full
+                    if (static_cast<std::size_t>(cqe.res) != expected_sizes[buffer_idx]) throw io_error(path, "Failed to write", ENOSPC);
+                    return buffer_idx;
+                }
+                if (::syscall(__NR_io_uring_enter, ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                    throw io_error(path, "Failed to wait for a write to", errno);
+            }
+        }
+
+    private:
+
+        void* map_ring(std::size_t size, off_t offset) {
+            void *ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, offset);
+            return ptr == MAP_FAILED ? nullptr : ptr;
+        }
+
+        static unsigned* ring_field(void *ring, std::uint32_t offset) {
+            return reinterpret_cast<unsigned*>(static_cast<unsigned char*>(ring) + offset);
+        }
+
+        void release() {
+            if (sqes != nullptr) ::munmap(sqes, sqes_size);
+            if (cq_ring != nullptr && cq_ring != sq_ring) ::munmap(cq_ring, cq_ring_size);
+            if (sq_ring != nullptr) ::munmap(sq_ring, sq_ring_size);
+            sqes = nullptr;
+            cq_ring = sq_ring = nullptr;
+            if (ring_fd >= 0) ::close(ring_fd);
+            ring_fd = -1;
+        }
+
+        int fd;
+        std::string path;
+        int ring_fd = -1;
+        bool registered = false;
+
+        void *sq_ring = nullptr;
+        void *cq_ring = nullptr;
+        io_uring_sqe *sqes = nullptr;
+        std::size_t sq_ring_size = 0;
+        std::size_t cq_ring_size = 0;
+        std::size_t sqes_size = 0;
+
+        unsigned *sq_tail = nullptr;
+        unsigned sq_mask = 0;
+        unsigned *sq_array = nullptr;
+        unsigned *cq_head = nullptr;
+        unsigned *cq_tail = nullptr;
+        unsigned cq_mask = 0;
+        io_uring_cqe *cqes = nullptr;
+
+        std::vector<std::size_t> expected_sizes;
+
+    };
+
+#endif
+
+}
+
+namespace AsyncFile {
+
+    const char* backend_name(Backend backend) {
+        return backend == Backend::io_uring ? "io_uring" : "pwrite threads";
+    }
+
+    void disable_io_uring() {
+        io_uring_disabled = true;
+    }
+
+    Writer::Writer(const std::string &path) :
+        path(path), fd(-1), direct_io(false), queue_backend(Backend::thread_pool), buffers(nullptr) {
+
+        std::filesystem::path folder = std::filesystem::path(path).parent_path();
+        if (!folder.empty()) std::filesystem::create_directories(folder);
+
+        std::string tmp_path = path + ".tmp";
+        #ifdef O_DIRECT
+            //Some file systems (tmpfs) refuse O_DIRECT, those get buffered writes with the same alignment
+            fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+            direct_io = fd >= 0;
+            if (fd < 0 && errno == EINVAL) fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        #else
+            fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        #endif
+        if (fd < 0) throw io_error(tmp_path, "Failed to create", errno);
+
+        buffers = static_cast<unsigned char*>(::operator new(queue_depth*buffer_size, std::align_val_t(block_size)));
+
+        #ifdef HAVE_IO_URING
+            if (!io_uring_disabled) {
+                try {
+                    queue = std::make_unique<UringQueue>(fd, tmp_path, buffers, queue_depth);
+                    queue_backend = Backend::io_uring;
+                }
+                catch (std::exception&) {
+                    //Old kernels and seccomp filters, the thread pool does the same job
+                }
+            }
+        #endif
+        if (!queue) queue = std::make_unique<ThreadPoolQueue>(fd, tmp_path);
+
+        for (std::size_t i = queue_depth; i > 0; i--) free_buffers.push_back(i-1);
+
+    }
+
+    Writer::~Writer() {
+        if (open) discard();
+        queue.reset();
+        ::operator delete(buffers, std::align_val_t(block_size));
+    }
+
+    void Writer::discard() {
+        open = false;
+        //The kernel may still be reading the buffers
+        while (in_flight > 0) {
+            in_flight--;
+            try {
+                queue->wait();
+            }
+            catch (std::exception&) {}
+        }
+        ::close(fd);
+        std::remove((path + ".tmp").c_str());
+    }
+
+    void Writer::acquire_buffer() {
+        if (free_buffers.empty()) {
+            auto stall_start = std::chrono::high_resolution_clock::now();
+            free_buffers.push_back(wait_request());
+            statistics.stall_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - stall_start).count();
+        }
+        current = free_buffers.back();
+        free_buffers.pop_back();
+        current_fill = 0;
+    }
+
+    void Writer::submit_current() {
+
+        //Only the last buffer of a file is partial, close() trims the padding again
+        std::size_t size = (current_fill + block_size - 1)/block_size*block_size;
+        std::memset(buffer(current) + current_fill, 0, size - current_fill);
+
+        if (in_flight == 0) busy_start = std::chrono::high_resolution_clock::now();
+        queue->submit(current, buffer(current), size, submitted_size);
+        submitted_size += size;
+        in_flight++;
+
+        statistics.requests++;
+        statistics.queue_depth_sum += in_flight;
+        statistics.max_queue_depth = std::max(statistics.max_queue_depth, in_flight);
+
+        current = no_buffer;
+        current_fill = 0;
+
+    }
+
+    std::size_t Writer::wait_request() {
+        in_flight--;
+        std::size_t buffer_idx = queue->wait();
+        if (in_flight == 0) statistics.busy_seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - busy_start).count();
+        return buffer_idx;
+    }
+
+    void Writer::write(const void *data, std::size_t size) {
+
+        if (!open) throw std::runtime_error("Error: Writing to a closed file \"" + path + "\"\n");
+
+        const unsigned char *src = static_cast<const unsigned char*>(data);
+        while (size > 0) {
+            if (current == no_buffer) acquire_buffer();
+            std::size_t n = std::min(size, buffer_size - current_fill);
+            std::memcpy(buffer(current) + current_fill, src, n);
+            current_fill += n;
+            src += n;
+            size -= n;
+            file_size += n;
+            statistics.bytes += n;
+            if (current_fill == buffer_size) submit_current();
+        }
+
+    }
+
+    void Writer::pad_to(std::uint64_t offset) {
+        static const unsigned char zeros[block_size] = {};
+        while (file_size < offset) write(zeros, static_cast<std::size_t>(std::min<std::uint64_t>(offset - file_size, block_size)));
+    }
+
+    void Writer::close() {
+
+        if (!open) return;
+
+        try {
+            if (current != no_buffer && current_fill > 0) submit_current();
+            while (in_flight > 0) free_buffers.push_back(wait_request());
+        }
+        catch (...) {
+            discard();
+            throw;
+        }
+
+        std::string tmp_path = path + ".tmp";
+        open = false;
+        int truncated = ::ftruncate(fd, static_cast<off_t>(file_size));
+        int error = errno;
+        if (::close(fd) != 0 && truncated == 0) {
+            truncated = -1;
+            error = errno;
+        }
+        if (truncated != 0) {
+            std::remove(tmp_path.c_str());
+            throw io_error(path, "Failed to write", error);
+        }
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            error = errno;
+            std::remove(tmp_path.c_str());
+            throw io_error(path, "Failed to write", error);
+        }
+
+    }
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Sequential writer for the large output files (checkpoints, trajectories). Data is copied into a ring of block
+//aligned buffers and every full buffer is written with O_DIRECT while the next ones fill, so the page cache is
+//bypassed and several writes are in flight at once. On Linux the writes go through io_uring with the buffers
+//registered up front, elsewhere, or if the kernel refuses io_uring, a small pool of threads issues pwrite calls.
+namespace AsyncFile {
+
+    enum class Backend {
+        io_uring,
+        thread_pool,
+    };
+
+    const char* backend_name(Backend backend);
+
+    //O_DIRECT needs offsets, sizes and addresses aligned to the device's logical block size, this covers all of them
+    constexpr std::size_t block_size = 4096;
+    //Bytes per write request
+    constexpr std::size_t buffer_size = 1 << 20;
+    //Number of buffers, so also the most requests in flight at once
+    constexpr std::size_t queue_depth = 8;
+
+    //Makes writers created from now on use the thread pool even where io_uring works, for comparing the two
+    void disable_io_uring();
+
+    struct Stats {
+        std::uint64_t bytes = 0;
+        std::uint64_t requests = 0;
+        //Time with at least one request in flight, from a submission to an empty queue to the completion that
+        //empties it again. Time spent filling buffers while the disk is idle doesn't count.
+        double busy_seconds = 0.0;
+        //Time write() spent waiting for a buffer to come back from the disk
+        double stall_seconds = 0.0;
+        //Sum and maximum of the requests in flight right after each submission
+        std::uint64_t queue_depth_sum = 0;
+        std::size_t max_queue_depth = 0;
+
+        double bandwidth() const { return busy_seconds > 0.0 ? bytes/busy_seconds : 0.0; }
+        double mean_queue_depth() const { return requests > 0 ? static_cast<double>(queue_depth_sum)/requests : 0.0; }
+    };
+
+    //Submits buffer writes and hands back finished ones, one implementation per backend
+    class Queue;
+
+    class Writer {
+    public:
+
+        //Creates path + ".tmp" and its missing parent folders, close() renames it into place like
+        //ParticleFile::write_atomically. Throws std::runtime_error on failure.
+        explicit Writer(const std::string &path);
+        //Waits for the requests in flight and deletes the temporary file if close() wasn't reached
+        ~Writer();
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        //Copies data into the buffers, only blocks when all of them are in flight. Throws std::runtime_error on
+        //failure, also for failed earlier requests.
+        void write(const void *data, std::size_t size);
+
+        //Writes zeros up to offset
+        void pad_to(std::uint64_t offset);
+
+        //Bytes written so far
+        std::uint64_t offset() const { return file_size; }
+
+        //Waits for every request, trims the block padding and renames the file into place
+        void close();
+
+        Backend backend() const { return queue_backend; }
+        bool direct() const { return direct_io; }
+        const Stats& stats() const { return statistics; }
+
+    private:
+
+        static constexpr std::size_t no_buffer = ~std::size_t(0);
+
+        unsigned char* buffer(std::size_t idx) { return buffers + idx*buffer_size; }
+        void acquire_buffer();
+        void submit_current();
+        //Takes back a completed request's buffer, whichever finished first
+        std::size_t wait_request();
+        void discard();
+
+        std::string path;
+        int fd;
+        bool direct_io;
+        Backend queue_backend;
+
+        unsigned char *buffers;
+        std::unique_ptr<Queue> queue;
+        std::vector<std::size_t> free_buffers;
+        std::size_t in_flight = 0;
+
+        std::size_t current = no_buffer;
+        std::size_t current_fill = 0;
+
+        std::uint64_t file_size = 0;
+        std::uint64_t submitted_size = 0;
+        bool open = true;
+
+        std::chrono::high_resolution_clock::time_point busy_start;
+        Stats statistics;
+
+    };
+
+}
@@ -0,0 +1,49 @@
+#include "bloom.hpp"
+
+namespace Bloom {
+
+    MipChain::MipChain(unsigned width, unsigned height, unsigned first_divisor) : divisor(first_divisor) {
+        width /= divisor;
+        height /= divisor;
+        for (unsigned size = divisor; size <= 1u << max_levels; size *= 2) {
+            if (width < 2 || height < 2) break;
+            level_descs.push_back({width, height, level_format});
+            width /= 2;
+            height /= 2;
+        }
+    }
+
+    void MipChain::render(GlState::Cache &gl_state, GLuint downsample_program, GLuint upsample_program, GLuint scene, GLuint screen_vao,
+            const std::vector<RenderGraph::Target> &level_targets) const {
+
+        gl_state.bind_vertex_array(screen_vao);
+        gl_state.set_enabled(GL_DEPTH_TEST, false);
+        gl_state.set_enabled(GL_BLEND, false);
+
+        gl_state.use_program(downsample_program);
+        glUniform1i(gl_state.uniform_location(downsample_program, "image"), 0);
+        for (std::size_t level = 0; level < level_descs.size(); level++) {
+            gl_state.bind_framebuffer(level_targets[level].framebuffer);
+            gl_state.viewport(0, 0, level_descs[level].width, level_descs[level].height);
+            gl_state.bind_texture(0, level == 0 ? scene : level_targets[level-1].texture);
+            glUniform1i(gl_state.uniform_location(downsample_program, "threshold"), level == 0);
+            glUniform1i(gl_state.uniform_location(downsample_program, "footprint"), level == 0 ? divisor : 2);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+
+        //Each level keeps its own downsample and gets the blurred smaller ones added on top
+        gl_state.use_program(upsample_program);
+        glUniform1i(gl_state.uniform_location(upsample_program, "image"), 0);
+        gl_state.set_enabled(GL_BLEND, true);
+        gl_state.blend_func(GL_ONE, GL_ONE);
+        for (std::size_t level = level_descs.size() - 1; level > 0; level--) {
+            gl_state.bind_framebuffer(level_targets[level-1].framebuffer);
+            gl_state.viewport(0, 0, level_descs[level-1].width, level_descs[level-1].height);
+            gl_state.bind_texture(0, level_targets[level].texture);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        gl_state.set_enabled(GL_BLEND, false);
+
+    }
+
+}
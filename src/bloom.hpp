@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "render_graph.hpp"
+
+//Bloom from a chain of ever smaller render targets instead of repeated full resolution blurs. The first
+//downsample picks the bright pixels out of the HDR scene into a half (or smaller) resolution target, every further one
+//halves the size again. The upsamples then walk back up the chain, blurring each level with a small tent filter and
+//adding it to the next larger one, so the widest glow comes from the smallest, cheapest levels. The result stays at
+//the first level's resolution and is magnified by the composite.
+namespace Bloom {
+
+    //Levels below the scene, each half the size of the one before, the smallest is 1/2^max_levels of the scene. Fewer
+    //are used if the first level is smaller than half the scene or a level would get narrower than 2 pixels.
+    constexpr std::size_t max_levels = 6;
+    //Largest scene to first level size ratio, the thresholding pass reads twice that many texels per axis
+    constexpr unsigned max_first_divisor = 8;
+
+    //No alpha and half the bytes of RGBA16F, the chain is all about bandwidth
+    constexpr GLenum level_format = GL_R11F_G11F_B10F;
+
+    class MipChain {
+    public:
+
+        //The levels for a width x height scene. They're render targets of the frame's graph, the chain only owns
+        //their sizes. The first level is the scene divided by first_divisor, a power of 2 up to max_first_divisor, so
+        //the bloom can be computed at a lower resolution than the scene.
+        MipChain(unsigned width, unsigned height, unsigned first_divisor = 2);
+
+        std::size_t levels() const { return level_descs.size(); }
+        unsigned first_divisor() const { return divisor; }
+        const RenderGraph::TextureDesc& level_desc(std::size_t level) const { return level_descs[level]; }
+
+        //Runs the chain on scene with downsample_program (bloom_down.frag) and upsample_program (bloom_up.frag),
+        //drawing screen_vao's full screen quad into level_targets, one per level as described by level_desc(). The
+        //summed glow ends up in level_targets[0]. Sets GL state through gl_state, leaving depth testing and blending
+        //disabled.
+        void render(GlState::Cache &gl_state, GLuint downsample_program, GLuint upsample_program, GLuint scene, GLuint screen_vao,
+                const std::vector<RenderGraph::Target> &level_targets) const;
+
+        //Every level adds about as much light as the scene's bright pixels hold, the composite scales by this
+        float scale() const { return 1.f/level_descs.size(); }
+
+    private:
+
+        unsigned divisor;
+        std::vector<RenderGraph::TextureDesc> level_descs;
+
+    };
+
+}
@@ -0,0 +1,66 @@
+#include <algorithm>
+
+#include "blur.hpp"
+
+namespace Blur {
+
+    std::vector<float> weights(int radius) {
+
+        int n = 2*radius + 4;
+
+        //Row n of Pascal's triangle from its middle outwards, doubles hold them exactly up to n = 68
+        std::vector<double> coefficients(radius + 1);
+        double coefficient = 1.0;
+        for (int k = 1; k <= n/2; k++) coefficient = coefficient*(n - k + 1)/k;
+        for (int i = 0; i <= radius; i++) {
+            coefficients[i] = coefficient;
+            coefficient = coefficient*(n/2 - i)/(n/2 + i + 1);
+        }
+
+        double sum = coefficients[0];
+        for (int i = 1; i <= radius; i++) sum += 2.0*coefficients[i];
+
+        std::vector<float> result(radius + 1);
+        for (int i = 0; i <= radius; i++) result[i] = static_cast<float>(coefficients[i]/sum);
+        return result;
+
+    }
+
+    ComputeBlur::ComputeBlur(int radius, unsigned passes) : n_passes(passes) {
+        set_radius(radius);
+        for (unsigned i = 0; i < 2*passes; i++) pass_timers.push_back(std::make_unique<GpuTimer::Timer>());
+    }
+
+    void ComputeBlur::set_radius(int radius) {
+        blur_radius = std::clamp(radius, 1, max_radius);
+        radius_weights = weights(blur_radius);
+    }
+
+    void ComputeBlur::render(GlState::Cache &gl_state, GLuint blur_program, GLuint scene, const std::array<GLuint, 2> &images, unsigned width, unsigned height) {
+
+        gl_state.use_program(blur_program);
+        glUniform1i(gl_state.uniform_location(blur_program, "radius"), blur_radius);
+        glUniform1fv(gl_state.uniform_location(blur_program, "weights"), radius_weights.size(), radius_weights.data());
+
+        //The first pass reads the scene
+        GLuint source = scene;
+        for (unsigned i = 0; i < 2*n_passes; i++) {
+            bool horizontal = i % 2 == 0;
+            GLuint target = images[!horizontal];
+
+            pass_timers[i]->begin();
+            glBindImageTexture(0, source, 0, GL_FALSE, 0, GL_READ_ONLY, image_format);
+            glBindImageTexture(1, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, image_format);
+            glUniform1i(gl_state.uniform_location(blur_program, "horizontal"), horizontal);
+            glUniform1i(gl_state.uniform_location(blur_program, "threshold"), i == 0);
+            unsigned length = horizontal ? width : height;
+            glDispatchCompute((length + tile_size - 1)/tile_size, horizontal ? height : width, 1);
+            glMemoryBarrier(i + 1 < 2*n_passes ? GL_SHADER_IMAGE_ACCESS_BARRIER_BIT : GL_TEXTURE_FETCH_BARRIER_BIT);
+            pass_timers[i]->end();
+
+            source = target;
+        }
+
+    }
+
+}
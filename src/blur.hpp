@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "gl_state.hpp"
+#include "gpu_timer.hpp"
+
+//Full resolution separable gaussian blur of the bright pixels of the HDR scene, run by blur.comp. Each direction is
+//one dispatch reading and writing images, so there are no frame buffers to switch between the passes, and the taps
+//are summed from a tile in shared memory instead of being fetched from the texture again for every pixel.
+namespace Blur {
+
+    //Pixels per work group along the blurred direction, same as TILE_SIZE in blur.comp
+    constexpr unsigned tile_size = 256;
+    //Same as MAX_RADIUS in blur.comp
+    constexpr int max_radius = 32;
+
+    //The radius and pass count of the old 10 pass fragment shader blur
+    constexpr int default_radius = 4;
+    constexpr unsigned default_passes = 5;
+
+    //Center weight first, from the binomial row 2*radius + 4 without its two outermost coefficients on each side
+    //and renormalized. A radius of 4 gives the weights of the old fragment shader blur.
+    std::vector<float> weights(int radius);
+
+    //Of the images the passes ping-pong between
+    constexpr GLenum image_format = GL_RGBA16F;
+
+    class ComputeBlur {
+    public:
+
+        //Needs a current GL context for the pass timers
+        explicit ComputeBlur(int radius = default_radius, unsigned passes = default_passes);
+
+        ComputeBlur(const ComputeBlur&) = delete;
+        ComputeBlur& operator=(const ComputeBlur&) = delete;
+
+        //Thresholds scene and blurs it passes times horizontally and then vertically with blur_program. The
+        //horizontal passes write images[0] and the vertical ones images[1], which holds the result, ready to be
+        //sampled. scene and both images are width x height, the images of image_format. The program is bound through
+        //gl_state.
+        void render(GlState::Cache &gl_state, GLuint blur_program, GLuint scene, const std::array<GLuint, 2> &images, unsigned width, unsigned height);
+
+        //Clamped to 1 ... max_radius
+        void set_radius(int radius);
+        int radius() const { return blur_radius; }
+
+        unsigned passes() const { return n_passes; }
+
+        //GPU time of the horizontal and vertical half of each pass
+        const GpuTimer::Timer& horizontal_timer(unsigned pass) const { return *pass_timers[2*pass]; }
+        const GpuTimer::Timer& vertical_timer(unsigned pass) const { return *pass_timers[2*pass+1]; }
+
+    private:
+
+        int blur_radius;
+        unsigned n_passes;
+        std::vector<float> radius_weights;
+
+        std::vector<std::unique_ptr<GpuTimer::Timer>> pass_timers;
+
+    };
+
+}
@@ -0,0 +1,370 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "catalog.hpp"
+#include "ic_cache.hpp"
+#include "random.hpp"
+#include "star.hpp"
+
+namespace {
+
+    //Bytes at either end of the file that go into the hash
+    constexpr std::size_t hash_sample_size = 64 << 10;
+
+    std::runtime_error schema_error(const std::string &spec, const std::string &msg) {
+        std::ostringstream err_msg_stream;
+        err_msg_stream << "Error: Invalid catalog schema \"" << spec << "\": " << msg << "\n";
+        return std::runtime_error(err_msg_stream.str());
+    }
+
+    std::runtime_error row_error(const std::string &path, std::size_t row, const std::string &msg) {
+        std::ostringstream err_msg_stream;
+        err_msg_stream << "Error: " << path << ": row " << row+1 << ": " << msg << "\n";
+        return std::runtime_error(err_msg_stream.str());
+    }
+
+    bool has_suffix(const std::string &str, const std::string &suffix) {
+        return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    bool is_separator(char c) {
+        return c == ',' || c == ';' || c == ' ' || c == '\t' || c == '\r';
+    }
+
+    //Position of the newline ending the line p is in, or end
+    const char* line_end(const char *p, const char *end) {
+        const void *newline = std::memchr(p, '\n', end - p);
+        return newline ? static_cast<const char*>(newline) : end;
+    }
+
+    //Whether [p, end) holds a row rather than nothing or a comment
+    bool is_row(const char *p, const char *end) {
+        while (p < end && is_separator(*p)) p++;
+        return p < end && *p != '#';
+    }
+
+    //Clinger's fast path: up to 19 significant digits and a power of ten that's exact in a double give a correctly
+    //rounded double with one multiplication or division. Rounding that to float is only wrong if it lands exactly
+    //halfway between two floats, that and everything else is left to std::from_chars. Returns nullptr then.
+    const char* parse_float_fast(const char *p, const char *end, float &value) {
+
+        static const double powers_of_10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+        };
+
+        bool negative = p < end && *p == '-';
+        if (negative) p++;
+
+        std::uint64_t mantissa = 0;
+        int n_digits = 0;
+        int exponent = 0;
+        for (; p < end && static_cast<unsigned>(*p - '0') < 10; p++, n_digits++) mantissa = mantissa*10 + (*p - '0');
+        if (p < end && *p == '.') {
+            for (p++; p < end && static_cast<unsigned>(*p - '0') < 10; p++, n_digits++, exponent--) mantissa = mantissa*10 + (*p - '0');
+        }
+        if (n_digits == 0 || n_digits > 19) return nullptr;
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char *q = p + 1;
+            bool negative_exponent = q < end && *q == '-';
+            if (q < end && (*q == '-' || *q == '+')) q++;
+            int e = 0;
+            const char *exponent_begin = q;
+            for (; q < end && static_cast<unsigned>(*q - '0') < 10 && e < 1000; q++) e = e*10 + (*q - '0');
+            if (q == exponent_begin || (q < end && static_cast<unsigned>(*q - '0') < 10)) return nullptr;
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+
+        if (mantissa > (std::uint64_t(1) << 53) || exponent < -22 || exponent > 22) return nullptr;
+
+        double d = static_cast<double>(mantissa);
+        d = exponent < 0 ? d/powers_of_10[-exponent] : d*powers_of_10[exponent];
+        if (d != 0.0 && (d < std::numeric_limits<float>::min() || d > std::numeric_limits<float>::max())) return nullptr;
+
+        std::uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        //The 29 mantissa bits a double has over a float being exactly one half
+        if ((bits & ((std::uint64_t(1) << 29) - 1)) == (std::uint64_t(1) << 28)) return nullptr;
+
+        value = static_cast<float>(negative ? -d : d);
+        return p;
+
+    }
+
+    //Parses the number at p, which has to be followed by a separator or end. Returns the end of it or nullptr.
+    const char* parse_field(const char *p, const char *end, float &value) {
+        if (p < end && *p == '+') p++;
+        const char *fast_end = parse_float_fast(p, end, value);
+        if (fast_end) return fast_end == end || is_separator(*fast_end) ? fast_end : nullptr;
+        std::from_chars_result result = std::from_chars(p, end, value);
+        if (result.ec != std::errc() || (result.ptr < end && !is_separator(*result.ptr))) return nullptr;
+        return result.ptr;
+    }
+
+    //Returns false if value isn't valid for the column
+    bool set_column(Catalog::Record &record, Catalog::Column column, float value) {
+        if (!std::isfinite(value)) return false;
+        switch (column) {
+            case Catalog::Column::skip: break;
+            case Catalog::Column::x: record.position.x = value; break;
+            case Catalog::Column::y: record.position.y = value; break;
+            case Catalog::Column::z: record.position.z = value; break;
+            case Catalog::Column::vx: record.velocity.x = value; break;
+            case Catalog::Column::vy: record.velocity.y = value; break;
+            case Catalog::Column::vz: record.velocity.z = value; break;
+            case Catalog::Column::mass: record.mass = value; break;
+            case Catalog::Column::radius: record.radius = value; break;
+            case Catalog::Column::type:
+                if (value < 0.f || value >= static_cast<float>(Star::n_star_colors) || value != std::floor(value)) return false;
+                record.type_idx = static_cast<std::uint32_t>(value);
+                break;
+        }
+        return true;
+    }
+
+}
+
+namespace Catalog {
+
+    Schema parse_schema(const std::string &spec) {
+
+        static const std::pair<const char*, Column> names[] = {
+            {"-", Column::skip},
+            {"x", Column::x}, {"y", Column::y}, {"z", Column::z},
+            {"vx", Column::vx}, {"vy", Column::vy}, {"vz", Column::vz},
+            {"mass", Column::mass},
+            {"radius", Column::radius},
+            {"type", Column::type},
+        };
+
+        Schema schema;
+        bool constant_mass = false;
+
+        std::istringstream stream(spec);
+        std::string entry;
+        while (std::getline(stream, entry, ',')) {
+
+            entry.erase(0, entry.find_first_not_of(" \t"));
+            entry.erase(entry.find_last_not_of(" \t") + 1);
+
+            if (entry.compare(0, 5, "mass=") == 0) {
+                std::string value = entry.substr(5);
+                char *end;
+                errno = 0;
+                schema.mass = std::strtof(value.c_str(), &end);
+                if (errno != 0 || end == value.c_str() || *end != '\0' || !std::isfinite(schema.mass))
+                    throw schema_error(spec, "invalid mass \"" + value + "\"");
+                constant_mass = true;
+                continue;
+            }
+
+            auto name = std::find_if(std::begin(names), std::end(names), [&](const std::pair<const char*, Column> &n) { return entry == n.first; });
+            if (name == std::end(names)) throw schema_error(spec, "unknown column \"" + entry + "\"");
+            if (name->second != Column::skip && std::count(schema.columns.begin(), schema.columns.end(), name->second) != 0)
+                throw schema_error(spec, "column \"" + entry + "\" appears twice");
+            schema.columns.push_back(name->second);
+
+        }
+
+        auto has = [&](Column column) { return std::count(schema.columns.begin(), schema.columns.end(), column) != 0; };
+        if (!has(Column::x) || !has(Column::y) || !has(Column::z)) throw schema_error(spec, "x, y and z are required");
+        if (constant_mass && has(Column::mass)) throw schema_error(spec, "mass is both a column and a constant");
+
+        return schema;
+
+    }
+
+    Catalog::Catalog(const std::string &path, const Schema &schema) :
+            path(path), schema(schema), file(path), binary_format(has_suffix(path, ".bin") || has_suffix(path, ".f32")) {
+
+        for (Column column : schema.columns) {
+            has_radius |= column == Column::radius;
+            has_type |= column == Column::type;
+        }
+
+        std::size_t size = file.size();
+
+        if (binary_format) {
+
+            std::size_t record_size = schema.columns.size()*sizeof(float);
+            if (size % record_size != 0) {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: \"" << path << "\" is " << size << " bytes, which isn't a whole number of "
+                               << record_size << " byte records of the schema\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+
+            n_rows = size/record_size;
+            std::size_t rows_per_range = std::max<std::size_t>(range_size/record_size, 1);
+            for (std::size_t row = 0; row < n_rows; row += rows_per_range)
+                ranges.push_back({row*record_size, std::min(row + rows_per_range, n_rows)*record_size, row});
+
+        }
+        else {
+
+            file.sequential();
+
+            const char *data = reinterpret_cast<const char*>(file.data());
+            const char *end = data + size;
+
+            //A header is a first row that doesn't start with a number
+            std::size_t data_begin = 0;
+            for (const char *p = data; p < end;) {
+                const char *le = line_end(p, end);
+                if (is_row(p, le)) {
+                    while (is_separator(*p)) p++;
+                    float value;
+                    const char *field_end = parse_field(p, le, value);
+                    if (!field_end) data_begin = std::min<std::size_t>(le - data + 1, size);
+                    break;
+                }
+                p = le + 1;
+            }
+
+            for (std::size_t begin = data_begin; begin < size;) {
+                std::size_t range_end = begin + range_size;
+                range_end = range_end >= size ? size : std::min<std::size_t>(line_end(data + range_end - 1, end) - data + 1, size);
+                ranges.push_back({begin, range_end, 0});
+                begin = range_end;
+            }
+
+            std::vector<std::size_t> counts(ranges.size(), 0);
+            Parallel::parallel_for(ranges.size(), 1, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t r = begin; r < end; r++) {
+                    const char *range_end = data + ranges[r].end;
+                    for (const char *p = data + ranges[r].begin; p < range_end;) {
+                        const char *le = line_end(p, range_end);
+                        if (is_row(p, le)) counts[r]++;
+                        p = le + 1;
+                    }
+                }
+            });
+
+            for (std::size_t r = 0; r < ranges.size(); r++) {
+                ranges[r].first_row = n_rows;
+                n_rows += counts[r];
+            }
+
+        }
+
+        if (n_rows == 0) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Catalog \"" << path << "\" holds no particles\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+
+    }
+
+    void Catalog::add_to_hash(ICCache::Hasher &hasher) const {
+        std::size_t size = file.size();
+        std::size_t sample = std::min(size, hash_sample_size);
+        hasher.add(size);
+        hasher.add_bytes(file.data(), sample);
+        hasher.add_bytes(file.data() + size - sample, sample);
+        hasher.add(binary_format);
+        for (Column column : schema.columns) hasher.add(column);
+        hasher.add(schema.mass);
+    }
+
+    std::size_t Catalog::decode(const Range &range, std::size_t &cursor, std::size_t row, std::uint64_t seed, Record *records) const {
+
+        std::size_t n = 0;
+
+        if (binary_format) {
+            std::size_t n_columns = schema.columns.size();
+            std::size_t record_size = n_columns*sizeof(float);
+            for (; n < batch_size && cursor < range.end; n++, cursor += record_size) {
+                Record &record = records[n];
+                record = {glm::vec3(0.f), glm::vec3(0.f), schema.mass, 0.f, 0};
+                for (std::size_t c = 0; c < n_columns; c++) {
+                    float value;
+                    std::memcpy(&value, file.data() + cursor + c*sizeof(float), sizeof(float));
+                    if (!set_column(record, schema.columns[c], value)) {
+                        std::ostringstream msg_stream;
+                        msg_stream << "invalid value " << value << " in column " << c+1;
+                        throw row_error(path, row + n, msg_stream.str());
+                    }
+                }
+            }
+        }
+        else {
+            n = decode_text(range, cursor, row, records);
+        }
+
+        for (std::size_t k = 0; k < n; k++) {
+            Record &record = records[k];
+            if (!has_type) {
+                RandomNum::Philox rng(seed, row + k);
+                record.type_idx = static_cast<std::uint32_t>(Star::rand_star_type_idx(rng));
+            }
+            if (!has_radius) record.radius = Star::star_size_mults[record.type_idx];
+        }
+
+        return n;
+
+    }
+
+    std::size_t Catalog::decode_text(const Range &range, std::size_t &cursor, std::size_t row, Record *records) const {
+
+        const char *data = reinterpret_cast<const char*>(file.data());
+        const char *p = data + cursor;
+        const char *end = data + range.end;
+
+        std::size_t n = 0;
+        while (n < batch_size && p < end) {
+
+            const char *le = line_end(p, end);
+            if (!is_row(p, le)) {
+                p = le + 1;
+                continue;
+            }
+
+            Record &record = records[n];
+            record = {glm::vec3(0.f), glm::vec3(0.f), schema.mass, 0.f, 0};
+
+            const char *field = p;
+            for (std::size_t c = 0; c < schema.columns.size(); c++) {
+
+                while (field < le && is_separator(*field)) field++;
+                if (field == le) {
+                    std::ostringstream msg_stream;
+                    msg_stream << "has " << c << " fields but the schema needs " << schema.columns.size();
+                    throw row_error(path, row + n, msg_stream.str());
+                }
+
+                const char *field_end = field;
+                if (schema.columns[c] == Column::skip) {
+                    while (field_end < le && !is_separator(*field_end)) field_end++;
+                }
+                else {
+                    float value;
+                    field_end = parse_field(field, le, value);
+                    if (!field_end || !set_column(record, schema.columns[c], value)) {
+                        const char *token_end = field;
+                        while (token_end < le && !is_separator(*token_end)) token_end++;
+                        throw row_error(path, row + n, "invalid value \"" + std::string(field, token_end) + "\" in column " + std::to_string(c+1));
+                    }
+                }
+                field = field_end;
+
+            }
+
+            n++;
+            p = le + 1;
+
+        }
+
+        cursor = std::min<std::size_t>(p - data, range.end);
+        return n;
+
+    }
+
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+namespace ICCache {
+    class Hasher;
+}
+
+//Initial conditions read from an external particle catalog instead of being generated. The file is mapped and
+//cut into fixed size ranges that start on line boundaries, one pass counts the rows of every range in parallel
+//and a second one parses them straight into the particle store, every range writing from its own first row on.
+//Fields are parsed with an exact fast path for short decimals, std::from_chars handles the rest.
+//
+//Text catalogs have one particle per line with the fields separated by commas, semicolons, spaces or tabs, runs
+//of separators count as one. Empty lines and lines starting with # are skipped, so is a first line that doesn't
+//start with a number (a header). Files ending in .bin or .f32 are binary instead, packed little endian float32
+//records with one value per schema column and no header.
+namespace Catalog {
+
+    enum class Column {
+        skip,
+        x, y, z,
+        vx, vy, vz,
+        mass,
+        radius,
+        type,
+    };
+
+    struct Schema {
+        std::vector<Column> columns;
+        //Mass of every particle if there's no mass column
+        float mass = 1.f;
+    };
+
+    //Used when no schema is given
+    constexpr const char *default_schema = "x,y,z,vx,vy,vz,mass";
+
+    //Comma separated column names out of x, y, z, vx, vy, vz, mass, radius and type, "-" skips a column.
+    //mass=M instead of a mass column gives every particle mass M. Positions are required, missing velocities
+    //are 0, missing star types are drawn like the generator does and missing radii follow from the star type.
+    //Throws std::runtime_error on malformed schemas.
+    Schema parse_schema(const std::string &spec);
+
+    //One decoded row
+    struct Record {
+        glm::vec3 position;
+        glm::vec3 velocity;
+        float mass;
+        float radius;
+        std::uint32_t type_idx;
+    };
+
+    //Bytes per range, fixed so the row order and errors don't depend on the thread count
+    constexpr std::size_t range_size = 4 << 20;
+    //Rows decoded at once before they're written to the particles
+    constexpr std::size_t batch_size = 1024;
+
+    class Catalog {
+    public:
+
+        //Maps the file and counts its rows. Throws std::runtime_error on failure.
+        Catalog(const std::string &path, const Schema &schema);
+
+        Catalog(const Catalog&) = delete;
+        Catalog& operator=(const Catalog&) = delete;
+
+        std::size_t n_particles() const { return n_rows; }
+        std::size_t size_bytes() const { return file.size(); }
+        bool binary() const { return binary_format; }
+
+        //Adds the file size, samples of its contents and the schema, enough to tell catalogs apart without
+        //reading all of it
+        void add_to_hash(ICCache::Hasher &hasher) const;
+
+        //Parses every row into particles[0, n_particles()). The seed only matters without a type column.
+        //Throws std::runtime_error naming the row of the first malformed one.
+        template<typename Particles>
+        void read(Particles &particles, std::uint64_t seed) const {
+
+            typedef typename Particles::vec3_type vec3_type;
+
+            Parallel::parallel_for(ranges.size(), 1, [&](std::size_t begin, std::size_t end) {
+                std::vector<Record> records(batch_size);
+                for (std::size_t r = begin; r < end; r++) {
+                    std::size_t cursor = ranges[r].begin;
+                    std::size_t row = ranges[r].first_row;
+                    for (std::size_t n; (n = decode(ranges[r], cursor, row, seed, records.data())) != 0; row += n) {
+                        for (std::size_t k = 0; k < n; k++) {
+                            const Record &record = records[k];
+                            particles.set_particle(row + k, vec3_type(record.position), vec3_type(record.velocity),
+                                    record.radius, record.mass, record.type_idx);
+                        }
+                    }
+                }
+            });
+
+        }
+
+    private:
+
+        struct Range {
+            std::size_t begin;
+            std::size_t end;
+            std::size_t first_row;
+        };
+
+        //Decodes up to batch_size rows of range from cursor on, which is advanced past them. row is the index of
+        //the first one. Returns the number of rows decoded, 0 at the end of the range.
+        std::size_t decode(const Range &range, std::size_t &cursor, std::size_t row, std::uint64_t seed, Record *records) const;
+        std::size_t decode_text(const Range &range, std::size_t &cursor, std::size_t row, Record *records) const;
+
+        std::string path;
+        Schema schema;
+        File::MappedFile file;
+        bool binary_format;
+
+        std::vector<Range> ranges;
+        std::size_t n_rows = 0;
+
+        bool has_radius = false;
+        bool has_type = false;
+
+    };
+
+}
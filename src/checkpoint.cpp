@@ -0,0 +1,430 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <glm/glm.hpp>
+
+#ifdef __unix__
+    #include <fcntl.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+#include "particle_layout.hpp"
+#include "checkpoint.hpp"
+
+namespace {
+
+    constexpr char magic[8] = {'G', 'S', 'I', 'M', 'C', 'K', 'P', 'T'};
+    constexpr std::uint32_t format_version = 1;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t endian_marker;
+        std::uint64_t header_size;
+        std::uint64_t n_particles;
+        ParticleFile::Sections sections;
+        Checkpoint::State state;
+    };
+
+    Header make_header(std::uint64_t n_particles, const Checkpoint::State &state) {
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = format_version;
+        header.endian_marker = ParticleFile::endian_marker;
+        header.header_size = sizeof(Header);
+        header.n_particles = n_particles;
+        header.sections = ParticleFile::sections(sizeof(Header), n_particles);
+        header.state = state;
+        return header;
+    }
+
+    std::runtime_error load_error(const std::string &path, const char *msg) {
+        std::ostringstream err_msg_stream;
+        err_msg_stream << "Error: Can't restart from \"" << path << "\": " << msg << "\n";
+        return std::runtime_error(err_msg_stream.str());
+    }
+
+    //Particles packed per write() in the fork writer's child
+    constexpr std::size_t fork_pack_particles = 16384;
+
+    #ifdef __unix__
+
+        //Async-signal-safe write of the whole range, the fork writer's child can't use stdio
+        bool write_all(int fd, const void *data, std::size_t size) {
+            const unsigned char *ptr = static_cast<const unsigned char*>(data);
+            while (size > 0) {
+                ssize_t n = ::write(fd, ptr, size);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) return false;
+                ptr += n;
+                size -= static_cast<std::size_t>(n);
+            }
+            return true;
+        }
+
+        //Zeros from offset up to target, the sections start on section_alignment boundaries
+        bool pad_to(int fd, std::uint64_t &offset, std::uint64_t target) {
+            static const unsigned char zeros[ParticleFile::section_alignment] = {};
+            while (offset < target) {
+                std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(target - offset, sizeof(zeros)));
+                if (!write_all(fd, zeros, n)) return false;
+                offset += n;
+            }
+            return true;
+        }
+
+        //Packs count particles starting at first with pack(i, out) into scratch and writes them
+        template<typename T, typename Pack>
+        bool write_section(int fd, std::uint64_t &offset, std::size_t n, unsigned char *scratch, Pack pack) {
+            T *packed = reinterpret_cast<T*>(scratch);
+            for (std::size_t first = 0; first < n; first += fork_pack_particles) {
+                std::size_t count = std::min(fork_pack_particles, n - first);
+                for (std::size_t k = 0; k < count; k++) pack(first+k, packed[k]);
+                if (!write_all(fd, packed, count*sizeof(T))) return false;
+                offset += count*sizeof(T);
+            }
+            return true;
+        }
+
+        //Runs in the forked child. Only async-signal-safe calls: the parent's other threads may have been holding
+        //the malloc or stdio locks at the time of the fork. Returns 0 or an errno value for the exit status.
+        int write_store(const char *tmp_path, const char *path, const Header &header, const Particles::HostParticleStore &store,
+                        unsigned char *scratch) {
+
+            int fd = ::open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) return errno;
+
+            const ParticleFile::Sections &sections = header.sections;
+            std::size_t n = header.n_particles;
+            std::uint64_t offset = 0;
+
+            bool ok = write_all(fd, &header, sizeof(header));
+            offset += sizeof(header);
+
+            ok = ok && pad_to(fd, offset, sections.positions_offset) &&
+                write_section<glm::vec4>(fd, offset, n, scratch, [&](std::size_t i, glm::vec4 &out) {
+                    out = glm::vec4(glm::vec3(store.position(i)), static_cast<float>(store.radius(i)));
+                });
+            ok = ok && pad_to(fd, offset, sections.velocities_offset) &&
+                write_section<glm::vec4>(fd, offset, n, scratch, [&](std::size_t i, glm::vec4 &out) {
+                    out = glm::vec4(glm::vec3(store.velocity(i)), static_cast<float>(store.mass(i)));
+                });
+            ok = ok && pad_to(fd, offset, sections.info_offset) &&
+                write_section<ParticleLayout::ParticleInfo>(fd, offset, n, scratch, [&](std::size_t i, ParticleLayout::ParticleInfo &out) {
+                    out = {static_cast<float>(store.lighting(i)), store.type_idx(i)};
+                });
+            ok = ok && pad_to(fd, offset, sections.file_size);
+
+            int error = ok ? 0 : (errno != 0 ? errno : EIO);
+            if (::close(fd) != 0 && error == 0) error = errno;
+            if (error == 0 && ::rename(tmp_path, path) != 0) error = errno;
+            if (error != 0) ::unlink(tmp_path);
+            return error;
+
+        }
+
+    #endif
+
+    //Into the staging buffer bound to GL_COPY_WRITE_BUFFER
+    void copy_section(GLuint buffer, std::uint64_t offset, std::size_t size) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, size);
+    }
+
+}
+
+namespace Checkpoint {
+
+    void save_camera(State &state, const Camera::Camera &camera) {
+        for (int i = 0; i < 3; i++) state.camera_position[i] = camera.Position[i];
+        state.camera_yaw = camera.Yaw;
+        state.camera_pitch = camera.Pitch;
+        state.camera_movement_speed = camera.MovementSpeed;
+        state.camera_zoom = camera.Zoom;
+    }
+
+    void restore_camera(const State &state, Camera::Camera &camera) {
+        camera.Position = glm::vec3(state.camera_position[0], state.camera_position[1], state.camera_position[2]);
+        camera.Yaw = state.camera_yaw;
+        camera.Pitch = state.camera_pitch;
+        camera.MovementSpeed = state.camera_movement_speed;
+        camera.Zoom = state.camera_zoom;
+        //Recomputes the camera vectors from the angles
+        camera.ProcessMouseMovement(0.f, 0.f);
+    }
+
+    Restart load(const std::string &path) {
+
+        File::MappedFile file(path);
+
+        Header header;
+        if (file.size() < sizeof(Header)) throw load_error(path, "file is too small to be a checkpoint");
+        std::memcpy(&header, file.data(), sizeof(Header));
+
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) throw load_error(path, "not a checkpoint file");
+        if (header.version != format_version) throw load_error(path, "unsupported checkpoint version");
+        if (header.endian_marker != ParticleFile::endian_marker) throw load_error(path, "checkpoint has the wrong byte order");
+        if (header.header_size != sizeof(Header)) throw load_error(path, "unexpected header size");
+
+        Header expected = make_header(header.n_particles, header.state);
+        if (std::memcmp(&header.sections, &expected.sections, sizeof(ParticleFile::Sections)) != 0)
+            throw load_error(path, "corrupt section table");
+        if (file.size() < header.sections.file_size) throw load_error(path, "checkpoint is truncated");
+
+        Restart restart;
+        restart.state = header.state;
+        restart.buffers = GpuParticles::create_buffers(header.n_particles);
+        ParticleFile::upload(file, header.sections, restart.buffers);
+
+        return restart;
+
+    }
+
+    bool Writer::begin(const std::string &path, const GpuParticles::Buffers &buffers, const State &state) {
+
+        if (busy()) return false;
+        if (!ParticleFile::is_little_endian()) throw std::runtime_error("Error: Checkpoints can only be written on little endian hosts\n");
+
+        this->path = path;
+        this->state = state;
+        n_particles = buffers.n_particles;
+        sections = ParticleFile::sections(sizeof(Header), n_particles);
+        start_time = std::chrono::high_resolution_clock::now();
+
+        //The staging buffer mirrors the file from the first section on, the gaps stay zero
+        if (staging == 0) glGenBuffers(1, &staging);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging);
+        if (staging_size != sections.file_size) {
+            staging_size = sections.file_size;
+            glBufferData(GL_COPY_WRITE_BUFFER, staging_size, NULL, GL_STREAM_READ);
+            glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R8UI, GL_RED_INTEGER, GL_UNSIGNED_BYTE, NULL);
+        }
+
+        //The physics shader writes the particles through SSBOs
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        std::size_t n = buffers.n_particles;
+        copy_section(buffers.positions, sections.positions_offset, n*sizeof(glm::vec4));
+        copy_section(buffers.velocities, sections.velocities_offset, n*sizeof(glm::vec4));
+        copy_section(buffers.info, sections.info_offset, n*sizeof(ParticleLayout::ParticleInfo));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+
+        stage = Stage::copying;
+        return true;
+
+    }
+
+    void Writer::start_write() {
+
+        glDeleteSync(fence);
+        fence = 0;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging);
+        const unsigned char *mapped = static_cast<const unsigned char*>(glMapBufferRange(
+                    GL_COPY_WRITE_BUFFER, sections.positions_offset, sections.file_size - sections.positions_offset, GL_MAP_READ_BIT));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (mapped == NULL) {
+            stage = Stage::idle;
+            throw std::runtime_error("Error: Failed to map the checkpoint staging buffer\n");
+        }
+
+        Header header = make_header(n_particles, state);
+        std::string file_path = path;
+        write = std::async(std::launch::async, [header, mapped, file_path]() {
+            AsyncFile::Writer file(file_path);
+            file.write(&header, sizeof(header));
+            file.pad_to(header.sections.positions_offset);
+            file.write(mapped, header.sections.file_size - header.sections.positions_offset);
+            file.close();
+            return file.stats();
+        });
+
+        stage = Stage::writing;
+
+    }
+
+    bool Writer::complete_write() {
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, staging);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        stage = Stage::idle;
+
+        //Rethrows errors from the writer thread
+        AsyncFile::Stats io = write.get();
+
+        std::printf("checkpoint \"%s\" (step %llu, %llu particles) written in %f s, %f MB/s at queue depth %f\n", path.c_str(),
+                static_cast<unsigned long long>(state.step), static_cast<unsigned long long>(n_particles),
+                std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start_time).count(),
+                io.bandwidth()/1e6, io.mean_queue_depth());
+
+        return true;
+
+    }
+
+    bool Writer::poll() {
+
+        if (stage == Stage::copying) {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status == GL_WAIT_FAILED) {
+                glDeleteSync(fence);
+                fence = 0;
+                stage = Stage::idle;
+                throw std::runtime_error("Error: Waiting for the checkpoint copy failed\n");
+            }
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) start_write();
+        }
+
+        if (stage == Stage::writing && write.wait_for(std::chrono::seconds(0)) == std::future_status::ready) return complete_write();
+
+        return false;
+
+    }
+
+    void Writer::finish() {
+
+        if (stage == Stage::copying) {
+            GLenum status;
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            if (status == GL_WAIT_FAILED) {
+                glDeleteSync(fence);
+                fence = 0;
+                stage = Stage::idle;
+                throw std::runtime_error("Error: Waiting for the checkpoint copy failed\n");
+            }
+            start_write();
+        }
+
+        if (stage == Stage::writing) {
+            write.wait();
+            complete_write();
+        }
+
+    }
+
+    ForkWriter::~ForkWriter() {
+        try {
+            finish();
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+        }
+    }
+
+    bool ForkWriter::begin(const std::string &path, const Particles::HostParticleStore &store, const State &state) {
+
+        if (busy()) return false;
+        if (!ParticleFile::is_little_endian()) throw std::runtime_error("Error: Checkpoints can only be written on little endian hosts\n");
+
+        #ifdef __unix__
+            this->path = path;
+            step = state.step;
+            n_particles = store.size();
+
+            //Everything the child needs is prepared here, it can't allocate
+            Header header = make_header(n_particles, state);
+            std::string tmp_path = path + ".tmp";
+            std::size_t scratch_size = std::max<std::size_t>(fork_pack_particles*sizeof(glm::vec4), ParticleFile::section_alignment);
+            if (scratch.size() < scratch_size) scratch.resize(scratch_size);
+
+            //Output buffered in stdio would otherwise be flushed twice
+            std::fflush(stdout);
+            std::fflush(stderr);
+
+            start_time = std::chrono::high_resolution_clock::now();
+            pid_t pid = ::fork();
+            if (pid == 0) ::_exit(write_store(tmp_path.c_str(), path.c_str(), header, store, scratch.data()));
+            fork_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+
+            if (pid < 0) {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Failed to fork for checkpoint \"" << path << "\": " << std::strerror(errno) << "\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+
+            child = pid;
+            return true;
+        #else
+            (void)path; (void)store; (void)state;
+            throw std::runtime_error("Error: Fork checkpoints need fork(), which this platform doesn't have\n");
+        #endif
+
+    }
+
+    bool ForkWriter::reap(int status) {
+
+        child = -1;
+
+        #ifdef __unix__
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Failed to write checkpoint \"" << path << "\": ";
+                if (WIFEXITED(status)) err_msg_stream << std::strerror(WEXITSTATUS(status)) << "\n";
+                else err_msg_stream << "the writer process died\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+        #else
+            (void)status;
+        #endif
+
+        std::printf("checkpoint \"%s\" (step %llu, %llu particles) written by a child process in %f s, the step loop stalled %f ms for the fork\n",
+                path.c_str(), static_cast<unsigned long long>(step), static_cast<unsigned long long>(n_particles),
+                std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - start_time).count(), 1000.0*fork_seconds);
+
+        return true;
+
+    }
+
+    bool ForkWriter::poll() {
+
+        if (!busy()) return false;
+
+        #ifdef __unix__
+            int status = 0;
+            pid_t pid = ::waitpid(static_cast<pid_t>(child), &status, WNOHANG);
+            if (pid == 0 || (pid < 0 && errno == EINTR)) return false;
+            if (pid < 0) {
+                child = -1;
+                throw std::runtime_error("Error: Lost track of the checkpoint writer process for \"" + path + "\"\n");
+            }
+            return reap(status);
+        #else
+            return false;
+        #endif
+
+    }
+
+    void ForkWriter::finish() {
+
+        if (!busy()) return;
+
+        #ifdef __unix__
+            int status = 0;
+            pid_t pid;
+            do {
+                pid = ::waitpid(static_cast<pid_t>(child), &status, 0);
+            } while (pid < 0 && errno == EINTR);
+            if (pid < 0) {
+                child = -1;
+                throw std::runtime_error("Error: Lost track of the checkpoint writer process for \"" + path + "\"\n");
+            }
+            reap(status);
+        #endif
+
+    }
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "async_file.hpp"
+#include "camera.hpp"
+#include "gpu_particles.hpp"
+#include "particle_file.hpp"
+#include "particle_store.hpp"
+
+//Checkpoint/restart. A checkpoint is a little endian file with a versioned header holding the simulation state,
+//followed by the particle buffers in their GPU layout (see particle_file.hpp), so restarting is a map plus an upload.
+namespace Checkpoint {
+
+    //Everything besides the particles that a run needs to continue where it left off. The initial conditions come
+    //from counter based RNG streams, so seed and ic_hash are all the RNG state there is.
+    struct State {
+        double sim_time;
+        std::uint64_t step;
+        //Timestep of the last step
+        float delta_time;
+        std::uint32_t paused;
+
+        std::uint64_t seed;
+        std::uint64_t ic_hash;
+
+        float camera_position[3];
+        float camera_yaw;
+        float camera_pitch;
+        float camera_movement_speed;
+        float camera_zoom;
+        std::uint32_t padding;
+    };
+
+    static_assert(std::is_trivially_copyable<State>::value, "Checkpoint::State is written to disk as is");
+    static_assert(sizeof(State) == 72, "Checkpoint::State layout changed, bump the format version");
+
+    void save_camera(State &state, const Camera::Camera &camera);
+    void restore_camera(const State &state, Camera::Camera &camera);
+
+    struct Restart {
+        GpuParticles::Buffers buffers;
+        State state;
+    };
+
+    //Maps the checkpoint, creates particle buffers of the right size and uploads them straight from the mapping.
+    //Throws std::runtime_error if the file can't be read or isn't a compatible checkpoint.
+    Restart load(const std::string &path);
+
+    //Writes checkpoints without stalling the frame. begin() only queues a GPU side copy of the particle buffers
+    //into a staging buffer laid out like the file; poll() maps it once a fence says the copy is done and hands the
+    //mapping to a thread that streams it out through an AsyncFile::Writer. The staging buffer lives as long as
+    //the GL context.
+    class Writer {
+    public:
+
+        Writer() = default;
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        bool busy() const { return stage != Stage::idle; }
+
+        //Returns false without doing anything if the previous checkpoint isn't written yet
+        bool begin(const std::string &path, const GpuParticles::Buffers &buffers, const State &state);
+
+        //Call once per frame from the GL thread. Returns true when a checkpoint was completed by this call.
+        //Throws std::runtime_error if writing it failed.
+        bool poll();
+
+        //Blocks until the pending checkpoint is on disk, has to be called before the GL context goes away
+        void finish();
+
+    private:
+
+        enum class Stage {
+            idle,
+            copying,
+            writing,
+        };
+
+        void start_write();
+        bool complete_write();
+
+        Stage stage = Stage::idle;
+
+        GLuint staging = 0;
+        std::size_t staging_size = 0;
+        GLsync fence = 0;
+
+        std::string path;
+        std::uint64_t n_particles = 0;
+        State state;
+        ParticleFile::Sections sections;
+        std::future<AsyncFile::Stats> write;
+
+        std::chrono::high_resolution_clock::time_point start_time;
+
+    };
+
+    //Checkpoints of the CPU backend's host side particles without copying them. begin() forks at a step boundary and
+    //the child writes the store as it was at the fork while the parent keeps stepping, copy on write keeps the
+    //child's pages frozen. The step loop only stalls for the fork itself. Same file format as Writer.
+    class ForkWriter {
+    public:
+
+        ForkWriter() = default;
+        //Waits for a child that's still writing
+        ~ForkWriter();
+
+        ForkWriter(const ForkWriter&) = delete;
+        ForkWriter& operator=(const ForkWriter&) = delete;
+
+        bool busy() const { return child != -1; }
+
+        //Returns false without doing anything if the previous checkpoint isn't written yet.
+        //Throws std::runtime_error if the fork fails or on hosts without fork().
+        bool begin(const std::string &path, const Particles::HostParticleStore &store, const State &state);
+
+        //Call once per step. Returns true when the child finished a checkpoint, throws std::runtime_error if it failed.
+        bool poll();
+
+        //Blocks until the pending checkpoint is on disk
+        void finish();
+
+    private:
+
+        bool reap(int status);
+
+        long child = -1;
+
+        std::string path;
+        std::uint64_t step = 0;
+        std::uint64_t n_particles = 0;
+        double fork_seconds = 0.0;
+        //Packing space for the child, allocated before the fork since the child mustn't call malloc
+        std::vector<unsigned char> scratch;
+
+        std::chrono::high_resolution_clock::time_point start_time;
+
+    };
+
+}
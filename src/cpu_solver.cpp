@@ -0,0 +1,53 @@
+#include <cmath>
+#include <vector>
+
+#include "parallel.hpp"
+#include "physics_constants.hpp"
+#include "cpu_solver.hpp"
+
+namespace {
+
+    //Particles per parallel_for chunk, every particle costs a full pass over the store
+    constexpr std::size_t step_chunk_size = 64;
+
+}
+
+namespace CpuSolver {
+
+    void step(Particles::HostParticleStore &store, float delta_time) {
+
+        typedef Particles::HostParticleStore::vec3_type vec3_type;
+        typedef Particles::HostParticleStore::value_type value_type;
+
+        std::size_t n = store.size();
+        const value_type G = static_cast<value_type>(Physics::G);
+        const value_type softening2 = static_cast<value_type>(Physics::softening)*static_cast<value_type>(Physics::softening);
+        const value_type dt = static_cast<value_type>(delta_time);
+
+        std::vector<vec3_type> accelerations(n);
+        Parallel::parallel_for(n, step_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                vec3_type p = store.position(i);
+                vec3_type acceleration(0);
+                for (std::size_t j = 0; j < n; j++) {
+                    vec3_type diff = store.position(j) - p;
+                    value_type dist2 = glm::dot(diff, diff) + softening2;
+                    value_type inv_dist = value_type(1)/std::sqrt(dist2);
+                    //The self term has diff == 0, no need to skip it
+                    acceleration += diff*(G*store.mass(j)*inv_dist*inv_dist*inv_dist);
+                }
+                accelerations[i] = acceleration;
+            }
+        });
+
+        Parallel::parallel_for(n, 16384, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                vec3_type v = store.velocity(i) + accelerations[i]*dt;
+                store.set_velocity(i, v);
+                store.set_position(i, store.position(i) + v*dt);
+            }
+        });
+
+    }
+
+}
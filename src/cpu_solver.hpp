@@ -0,0 +1,14 @@
+#pragma once
+
+#include "particle_store.hpp"
+
+//Host side port of the integration in shaders/physics.comp, for machines without a usable compute shader and for
+//checking the GPU against. Direct summation like the shader, so it's only practical for small particle counts.
+//Lighting isn't computed here, the physics shader still does that in its paused mode.
+namespace CpuSolver {
+
+    //One semi-implicit Euler step with the softening of physics.comp. All accelerations are computed from the
+    //positions at the start of the step, the particles are split across the hardware threads.
+    void step(Particles::HostParticleStore &store, float delta_time);
+
+}
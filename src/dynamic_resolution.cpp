@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <cmath>
+
+#include "dynamic_resolution.hpp"
+
+namespace {
+
+    //The controller leaves the scale alone within this band around the budget, so it doesn't oscillate
+    constexpr double over_budget = 1.05;
+    constexpr double under_budget = 0.8;
+    //Largest change of the render scale at once
+    constexpr float max_scale_change = 0.15f;
+
+    float quantize(float scale) {
+        return std::round(scale/DynamicResolution::scale_step)*DynamicResolution::scale_step;
+    }
+
+}
+
+namespace DynamicResolution {
+
+    unsigned scaled_size(unsigned window_size, float render_scale) {
+        return std::max(1u, static_cast<unsigned>(std::lround(window_size*render_scale)));
+    }
+
+    Controller::Controller(double budget_ms, float render_scale) : budget_ms(budget_ms), scale(render_scale) {}
+
+    bool Controller::update(double gpu_frame_ms, bool bloom_used) {
+
+        if (budget_ms <= 0.0 || gpu_frame_ms <= 0.0) return false;
+
+        mean_ms = frames_since_change == 0 ? gpu_frame_ms : 0.8*mean_ms + 0.2*gpu_frame_ms;
+        if (++frames_since_change < settle_frames) return false;
+
+        //The fill cost goes with the pixel count, the square of the scale
+        float new_scale = scale;
+        unsigned new_divisor = divisor;
+        if (mean_ms > over_budget*budget_ms) {
+            if (bloom_used && divisor == fine_bloom_divisor) new_divisor = coarse_bloom_divisor;
+            else {
+                float target = scale*static_cast<float>(std::sqrt(budget_ms/mean_ms));
+                new_scale = quantize(std::max(target, scale - max_scale_change));
+                if (new_scale >= scale) new_scale = scale - scale_step;
+            }
+        }
+        else if (mean_ms < under_budget*budget_ms) {
+            if (scale < max_render_scale) {
+                //Aims at the middle of the band
+                float target = scale*static_cast<float>(std::sqrt(0.5*(over_budget + under_budget)*budget_ms/mean_ms));
+                new_scale = quantize(std::min(target, scale + max_scale_change));
+                if (new_scale <= scale) new_scale = scale + scale_step;
+            }
+            else if (bloom_used) new_divisor = fine_bloom_divisor;
+        }
+        new_scale = std::clamp(new_scale, min_render_scale, max_render_scale);
+
+        if (new_scale == scale && new_divisor == divisor) return false;
+
+        scale = new_scale;
+        divisor = new_divisor;
+        frames_since_change = 0;
+        n_changes++;
+        return true;
+
+    }
+
+}
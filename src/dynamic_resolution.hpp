@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+//Holds the GPU frame time to a budget by rendering the scene at a fraction of the window resolution, which the
+//composite magnifies back onto the window, and by computing the bloom from a smaller first level. Over budget the
+//bloom gets coarser first, being the cheaper loss, then the scene. Under budget the scene gets its pixels back first.
+namespace DynamicResolution {
+
+    constexpr float min_render_scale = 0.5f;
+    constexpr float max_render_scale = 1.f;
+    //Scales are multiples of this, so the render targets only come in a few sizes
+    constexpr float scale_step = 0.05f;
+    //Scene to first bloom level size ratios the controller picks from, see Bloom::MipChain
+    constexpr unsigned fine_bloom_divisor = 2;
+    constexpr unsigned coarse_bloom_divisor = 4;
+    //Frames to wait after a change before judging it, GPU times arrive a few frames late and are smoothed
+    constexpr unsigned settle_frames = 20;
+    //Windows smaller than this in either direction aren't drawn to, like minimized ones
+    constexpr int min_window_size = 16;
+
+    //Window pixels times render_scale, at least 1
+    unsigned scaled_size(unsigned window_size, float render_scale);
+
+    class Controller {
+    public:
+
+        //budget_ms 0 keeps render_scale and the fine bloom fixed
+        Controller(double budget_ms, float render_scale = max_render_scale);
+
+        //Takes a new GPU frame time, once per time measured, returns whether the render scale or bloom divisor
+        //changed. Without bloom_used the divisor stays as it is, changing it wouldn't save anything.
+        bool update(double gpu_frame_ms, bool bloom_used);
+
+        float render_scale() const { return scale; }
+        unsigned bloom_divisor() const { return divisor; }
+
+        double smoothed_ms() const { return mean_ms; }
+        std::uint64_t changes() const { return n_changes; }
+
+    private:
+
+        double budget_ms;
+        float scale;
+        unsigned divisor = fine_bloom_divisor;
+
+        double mean_ms = 0.0;
+        unsigned frames_since_change = 0;
+        std::uint64_t n_changes = 0;
+
+    };
+
+}
@@ -0,0 +1,477 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#ifdef HAVE_ZLIB
+    #include <zlib.h>
+#endif
+
+#include "frame_export.hpp"
+#include "particle_file.hpp"
+
+namespace {
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+    //Fast beats small here, the encoders have to keep up with the renderer
+    #ifdef HAVE_ZLIB
+        constexpr int png_deflate_level = 1;
+    #endif
+
+    const std::array<std::uint32_t, 256>& crc_table() {
+        static const std::array<std::uint32_t, 256> table = []() {
+            std::array<std::uint32_t, 256> t;
+            for (std::uint32_t n = 0; n < 256; n++) {
+                std::uint32_t c = n;
+                for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+        return table;
+    }
+
+    std::uint32_t crc32(const unsigned char *data, std::size_t size) {
+        const std::array<std::uint32_t, 256> &table = crc_table();
+        std::uint32_t c = 0xffffffffu;
+        for (std::size_t i = 0; i < size; i++) c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+        return c ^ 0xffffffffu;
+    }
+
+    void put_u32_be(std::vector<unsigned char> &out, std::uint32_t value) {
+        out.push_back(static_cast<unsigned char>(value >> 24));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    //Length, type, data and a CRC over type and data
+    void put_chunk(std::vector<unsigned char> &out, const char *type, const unsigned char *data, std::size_t size) {
+        put_u32_be(out, static_cast<std::uint32_t>(size));
+        std::size_t crc_start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + size);
+        std::uint32_t crc = crc32(out.data() + crc_start, out.size() - crc_start);
+        put_u32_be(out, crc);
+    }
+
+    #ifndef HAVE_ZLIB
+    //A zlib stream of stored deflate blocks, for builds without zlib
+    std::vector<unsigned char> store(const std::vector<unsigned char> &raw) {
+
+        constexpr std::size_t max_block = 65535;
+
+        std::vector<unsigned char> stream = {0x78, 0x01};
+        std::size_t offset = 0;
+        do {
+            std::size_t size = std::min(max_block, raw.size() - offset);
+            bool last = offset + size == raw.size();
+            stream.push_back(last);
+            stream.push_back(static_cast<unsigned char>(size));
+            stream.push_back(static_cast<unsigned char>(size >> 8));
+            stream.push_back(static_cast<unsigned char>(~size));
+            stream.push_back(static_cast<unsigned char>(~size >> 8));
+            stream.insert(stream.end(), raw.begin() + offset, raw.begin() + offset + size);
+            offset += size;
+        } while (offset < raw.size());
+
+        std::uint32_t a = 1, b = 0;
+        for (unsigned char byte : raw) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        put_u32_be(stream, (b << 16) | a);
+        return stream;
+
+    }
+    #endif
+
+    std::vector<unsigned char> deflate_scanlines(const std::vector<unsigned char> &raw) {
+        #ifdef HAVE_ZLIB
+            uLongf size = compressBound(raw.size());
+            std::vector<unsigned char> stream(size);
+            if (compress2(stream.data(), &size, raw.data(), raw.size(), png_deflate_level) != Z_OK)
+                throw std::runtime_error("Error: Failed to deflate a PNG frame\n");
+            stream.resize(size);
+            return stream;
+        #else
+            return store(raw);
+        #endif
+    }
+
+    unsigned char clamp_byte(float value) {
+        return static_cast<unsigned char>(std::min(std::max(value + 0.5f, 0.f), 255.f));
+    }
+
+}
+
+namespace FrameExport {
+
+    Format format_of(const std::string &path) {
+        const std::string extension = ".y4m";
+        bool video = path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+        return video ? Format::y4m : Format::png;
+    }
+
+    void encode_png(const unsigned char *rgba, unsigned width, unsigned height, std::vector<unsigned char> &out) {
+
+        //Every scanline starts with its filter type. Sub, the difference to the pixel on the left, is cheap and
+        //leaves the mostly black frames full of zeros.
+        std::size_t row_size = 1 + 3*static_cast<std::size_t>(width);
+        std::vector<unsigned char> scanlines(row_size*height);
+        for (unsigned y = 0; y < height; y++) {
+            const unsigned char *src = rgba + 4*static_cast<std::size_t>(width)*(height - 1 - y);
+            unsigned char *dst = scanlines.data() + row_size*y;
+            dst[0] = 1;
+            unsigned char left[3] = {0, 0, 0};
+            for (unsigned x = 0; x < width; x++) {
+                for (int c = 0; c < 3; c++) {
+                    dst[1 + 3*x + c] = static_cast<unsigned char>(src[4*x + c] - left[c]);
+                    left[c] = src[4*x + c];
+                }
+            }
+        }
+        std::vector<unsigned char> stream = deflate_scanlines(scanlines);
+
+        const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        out.assign(signature, signature + 8);
+
+        std::vector<unsigned char> header;
+        put_u32_be(header, width);
+        put_u32_be(header, height);
+        //8 bits per channel, RGB, deflate, adaptive filtering, not interlaced
+        header.insert(header.end(), {8, 2, 0, 0, 0});
+        put_chunk(out, "IHDR", header.data(), header.size());
+        put_chunk(out, "IDAT", stream.data(), stream.size());
+        put_chunk(out, "IEND", nullptr, 0);
+
+    }
+
+    void encode_y4m_frame(const unsigned char *rgba, unsigned width, unsigned height, std::vector<unsigned char> &out) {
+
+        const char marker[] = "FRAME\n";
+        std::size_t chroma_width = (width + 1)/2;
+        std::size_t chroma_height = (height + 1)/2;
+        std::size_t luma_size = static_cast<std::size_t>(width)*height;
+        std::size_t chroma_size = chroma_width*chroma_height;
+        out.resize(sizeof(marker) - 1 + luma_size + 2*chroma_size);
+        std::memcpy(out.data(), marker, sizeof(marker) - 1);
+
+        unsigned char *luma = out.data() + sizeof(marker) - 1;
+        unsigned char *cb = luma + luma_size;
+        unsigned char *cr = cb + chroma_size;
+
+        auto pixel = [&](std::size_t x, std::size_t y) {
+            return rgba + 4*(static_cast<std::size_t>(width)*(height - 1 - y) + x);
+        };
+
+        for (std::size_t y = 0; y < height; y++) {
+            for (std::size_t x = 0; x < width; x++) {
+                const unsigned char *p = pixel(x, y);
+                luma[width*y + x] = clamp_byte(0.299f*p[0] + 0.587f*p[1] + 0.114f*p[2]);
+            }
+        }
+
+        for (std::size_t y = 0; y < chroma_height; y++) {
+            for (std::size_t x = 0; x < chroma_width; x++) {
+                //The last row and column repeat when the size is odd
+                std::size_t x0 = 2*x, x1 = std::min<std::size_t>(2*x + 1, width - 1);
+                std::size_t y0 = 2*y, y1 = std::min<std::size_t>(2*y + 1, height - 1);
+                float r = 0.f, g = 0.f, b = 0.f;
+                for (const unsigned char *p : {pixel(x0, y0), pixel(x1, y0), pixel(x0, y1), pixel(x1, y1)}) {
+                    r += p[0];
+                    g += p[1];
+                    b += p[2];
+                }
+                r /= 4.f;
+                g /= 4.f;
+                b /= 4.f;
+                cb[chroma_width*y + x] = clamp_byte(128.f - 0.168736f*r - 0.331264f*g + 0.5f*b);
+                cr[chroma_width*y + x] = clamp_byte(128.f + 0.5f*r - 0.418688f*g - 0.081312f*b);
+            }
+        }
+
+    }
+
+    Exporter::Exporter(const std::string &path, unsigned width, unsigned height, unsigned fps, unsigned threads) :
+        path(path), output_format(format_of(path)), width(width), height(height),
+        frame_size(4*static_cast<std::size_t>(width)*height), persistent_mapping(GLAD_GL_VERSION_4_4),
+        //One buffer for every encoder, one being read back and one being rendered into
+        ring_size(std::max(threads, 1u) + 2), slots(new Slot[ring_size]), encoders(threads) {
+
+        if (this->path.empty()) throw std::runtime_error("Error: No path for the exported frames\n");
+        if (output_format == Format::png && this->path.back() != '/') this->path.push_back('/');
+
+        if (output_format == Format::y4m) {
+            video = std::fopen(path.c_str(), "wb");
+            if (video == nullptr) {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Couldn't open \"" << path << "\" for writing: " << std::strerror(errno) << "\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+            //Full range 4:2:0 with the chroma between the luma samples, square pixels, progressive
+            char header[128];
+            int size = std::snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, fps);
+            try {
+                ParticleFile::write_or_throw(video, header, size, path);
+            }
+            catch (...) {
+                close_video();
+                throw;
+            }
+        }
+
+        for (std::size_t i = 0; i < ring_size; i++) {
+            Slot &slot = slots[i];
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            if (persistent_mapping) {
+                GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_PIXEL_PACK_BUFFER, frame_size, NULL, flags);
+                slot.mapped = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_size, flags));
+                if (slot.mapped == nullptr) {
+                    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                    close_video();
+                    throw std::runtime_error("Error: Failed to persistently map a frame readback buffer\n");
+                }
+            }
+            else {
+                glBufferData(GL_PIXEL_PACK_BUFFER, frame_size, NULL, GL_STREAM_READ);
+            }
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    }
+
+    Exporter::~Exporter() {
+        //Only waits for the frames already being encoded, the buffers go away with the GL context
+        encoders.wait();
+        close_video();
+    }
+
+    void Exporter::capture(GLuint framebuffer) {
+
+        Clock::time_point start = Clock::now();
+
+        reclaim_written();
+
+        auto free_slot = [this]() {
+            std::size_t slot_idx = 0;
+            while (slot_idx < ring_size && slots[slot_idx].in_use) slot_idx++;
+            return slot_idx;
+        };
+
+        std::size_t slot_idx = free_slot();
+        if (slot_idx == ring_size) {
+            //Dropping frames would leave holes in the movie, so rendering waits for the readbacks and encoders
+            statistics.stalls++;
+            Clock::time_point stall_start = Clock::now();
+            while ((slot_idx = free_slot()) == ring_size) {
+                if (!copying.empty()) collect(true);
+                else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                reclaim_written();
+                rethrow_error();
+            }
+            statistics.stall_seconds += std::chrono::duration<double>(Clock::now() - stall_start).count();
+        }
+
+        Slot &slot = slots[slot_idx];
+        slot.in_use = true;
+        slot.written.store(false, std::memory_order_relaxed);
+        slot.frame = next_frame++;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+        //poll() checks the fence without flushing, so it's sent on here. Headless runs have no swap that would.
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        copying.push_back(slot_idx);
+
+        statistics.captured++;
+        statistics.render_thread_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+    }
+
+    void Exporter::collect(bool block) {
+
+        //Readbacks finish in submission order, so the first unsignaled fence ends the scan
+        while (!copying.empty()) {
+            std::size_t slot_idx = copying.front();
+            GLenum status = glClientWaitSync(slots[slot_idx].fence, block ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, block ? 1000000000 : 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                if (block) continue;
+                break;
+            }
+            copying.pop_front();
+            if (status == GL_WAIT_FAILED) {
+                glDeleteSync(slots[slot_idx].fence);
+                slots[slot_idx].fence = 0;
+                drop(slot_idx);
+                throw std::runtime_error("Error: Waiting for a frame readback failed\n");
+            }
+            hand_over(slot_idx);
+            block = false;
+        }
+
+    }
+
+    void Exporter::hand_over(std::size_t slot_idx) {
+
+        Slot &slot = slots[slot_idx];
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        if (!persistent_mapping) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            slot.mapped = static_cast<const unsigned char*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_size, GL_MAP_READ_BIT));
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            if (slot.mapped == nullptr) {
+                drop(slot_idx);
+                throw std::runtime_error("Error: Failed to map a frame readback buffer\n");
+            }
+        }
+
+        encoders.submit([this, slot_idx]() { encode(slot_idx); });
+
+    }
+
+    void Exporter::drop(std::size_t slot_idx) {
+        Slot &slot = slots[slot_idx];
+        slot.in_use = false;
+        //The slot may be reused before the turn comes, so the frame number is copied
+        std::uint64_t frame = slot.frame;
+        if (output_format == Format::y4m) encoders.submit([this, frame]() { write_video_frame(frame, nullptr); });
+    }
+
+    void Exporter::encode(std::size_t slot_idx) {
+
+        Slot &slot = slots[slot_idx];
+        Clock::time_point start = Clock::now();
+
+        bool encoded = false;
+        try {
+            if (output_format == Format::png) {
+                encode_png(slot.mapped, width, height, slot.encoded);
+                char name[32];
+                std::snprintf(name, sizeof(name), "frame_%06llu.png", static_cast<unsigned long long>(slot.frame));
+                ParticleFile::write_atomically(path + name, [&](std::FILE *file, const std::string &tmp_path) {
+                    ParticleFile::write_or_throw(file, slot.encoded.data(), slot.encoded.size(), tmp_path);
+                });
+            }
+            else {
+                encode_y4m_frame(slot.mapped, width, height, slot.encoded);
+            }
+            encoded = true;
+        }
+        catch (...) {
+            record_error();
+        }
+
+        if (output_format == Format::y4m) write_video_frame(slot.frame, encoded ? &slot.encoded : nullptr);
+
+        slot.encode_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        slot.written.store(true, std::memory_order_release);
+
+    }
+
+    void Exporter::write_video_frame(std::uint64_t frame, const std::vector<unsigned char> *encoded) {
+        {
+            std::unique_lock<std::mutex> lock(video_mutex);
+            video_turn.wait(lock, [&]() { return next_video_frame == frame; });
+            try {
+                if (encoded != nullptr) ParticleFile::write_or_throw(video, encoded->data(), encoded->size(), path);
+            }
+            catch (...) {
+                record_error();
+            }
+            //A frame that failed still passes its turn on, or the later ones would wait forever
+            next_video_frame++;
+        }
+        video_turn.notify_all();
+    }
+
+    void Exporter::reclaim_written() {
+        for (std::size_t i = 0; i < ring_size; i++) {
+            Slot &slot = slots[i];
+            if (!slot.in_use || !slot.written.load(std::memory_order_acquire)) continue;
+            if (!persistent_mapping) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                slot.mapped = nullptr;
+            }
+            slot.in_use = false;
+            statistics.written++;
+            statistics.encode_seconds += slot.encode_seconds;
+        }
+    }
+
+    void Exporter::record_error() {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!encode_error) encode_error = std::current_exception();
+    }
+
+    void Exporter::rethrow_error() {
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            std::swap(error, encode_error);
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    void Exporter::close_video() {
+        if (video != nullptr) std::fclose(video);
+        video = nullptr;
+    }
+
+    void Exporter::poll() {
+
+        Clock::time_point start = Clock::now();
+
+        try {
+            collect(false);
+            reclaim_written();
+        }
+        catch (...) {
+            statistics.render_thread_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            throw;
+        }
+
+        statistics.render_thread_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+        rethrow_error();
+
+    }
+
+    void Exporter::finish() {
+
+        while (!copying.empty()) collect(true);
+        encoders.wait();
+        reclaim_written();
+
+        if (video != nullptr) {
+            bool flushed = std::fflush(video) == 0;
+            close_video();
+            if (!flushed) {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Failed to write \"" << path << "\": " << std::strerror(errno) << "\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+        }
+
+        rethrow_error();
+
+    }
+
+}
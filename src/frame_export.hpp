@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "parallel.hpp"
+
+//Movie output. Every frame is read back with glReadPixels into one of a ring of pixel pack buffers, fences are polled
+//once per frame without blocking and the finished readbacks are encoded by a thread pool, so rendering the next
+//frames, reading back the last ones and encoding those before overlap. Unlike snapshots no frame is ever dropped: when
+//the encoders fall behind, capturing waits for a free buffer.
+namespace FrameExport {
+
+    enum class Format {
+        //One numbered file per frame in a folder
+        png,
+        //A single uncompressed YUV 4:2:0 video, which ffmpeg and most players read
+        y4m
+    };
+
+    //Paths ending in ".y4m" are videos, anything else is a folder for PNGs
+    Format format_of(const std::string &path);
+
+    //The images come as glReadPixels returns them, RGBA rows from the bottom up, and are flipped while encoding.
+    //Replaces out.
+
+    //8 bit RGB, deflated with zlib where the build has it, else stored uncompressed
+    void encode_png(const unsigned char *rgba, unsigned width, unsigned height, std::vector<unsigned char> &out);
+    //The "FRAME" marker and full range BT.601 planes, chroma averaged over 2x2 pixels
+    void encode_y4m_frame(const unsigned char *rgba, unsigned width, unsigned height, std::vector<unsigned char> &out);
+
+    class Exporter {
+    public:
+
+        struct Stats {
+            std::uint64_t captured = 0;
+            std::uint64_t written = 0;
+            //Captures that had to wait for a buffer, and how long, because the encoders fell behind
+            std::uint64_t stalls = 0;
+            double stall_seconds = 0.0;
+            //Time spent in capture() and poll() on the render thread, stalls included
+            double render_thread_seconds = 0.0;
+            //Encoding and writing, summed over the threads
+            double encode_seconds = 0.0;
+        };
+
+        //Frames of width x height go to path, see format_of(). fps only ends up in the Y4M header. Persistent mapping
+        //needs GL 4.4, older contexts map each buffer once its readback is done instead.
+        Exporter(const std::string &path, unsigned width, unsigned height, unsigned fps, unsigned threads = Parallel::n_threads());
+        //Waits for the encoders, but finish() has to be called for the last frames to be read back
+        ~Exporter();
+
+        Exporter(const Exporter&) = delete;
+        Exporter& operator=(const Exporter&) = delete;
+
+        //Queues a readback of framebuffer's color buffer, 0 reads the window's back buffer. Waits if every buffer is
+        //busy. Leaves the pixel pack buffer and the read frame buffer unbound.
+        void capture(GLuint framebuffer);
+
+        //Call once per frame from the GL thread. Never blocks. Rethrows errors from the encoders.
+        void poll();
+
+        //Waits until every captured frame is written and closes the output. Has to be called before the GL context
+        //goes away.
+        void finish();
+
+        const Stats& stats() const { return statistics; }
+        Format format() const { return output_format; }
+        bool persistent() const { return persistent_mapping; }
+
+    private:
+
+        struct Slot {
+            GLuint buffer = 0;
+            const unsigned char *mapped = nullptr;
+            GLsync fence = 0;
+            std::uint64_t frame = 0;
+            //Owned by the render thread, set from capture() until the frame has been written
+            bool in_use = false;
+            //Owned by the encoding thread while the frame is being encoded
+            std::vector<unsigned char> encoded;
+            double encode_seconds = 0.0;
+            //Set by the encoding thread once it's done with the slot
+            std::atomic<bool> written{false};
+        };
+
+        //Hands the finished readbacks to the encoders, oldest first. Blocking waits for at least one.
+        void collect(bool block);
+        void hand_over(std::size_t slot_idx);
+        //Frees the slot of a frame whose readback failed, its turn in the video is passed on all the same
+        void drop(std::size_t slot_idx);
+        void encode(std::size_t slot_idx);
+        //Appends encoded to the video once all earlier frames are in, nullptr only passes the turn on
+        void write_video_frame(std::uint64_t frame, const std::vector<unsigned char> *encoded);
+        void reclaim_written();
+        void record_error();
+        void rethrow_error();
+        void close_video();
+
+        std::string path;
+        Format output_format;
+        unsigned width;
+        unsigned height;
+        std::size_t frame_size;
+        bool persistent_mapping;
+
+        std::size_t ring_size;
+        std::unique_ptr<Slot[]> slots;
+        //Slots with a pending fence, oldest first
+        std::deque<std::size_t> copying;
+        std::uint64_t next_frame = 0;
+
+        //Frames go into the video in capture order, whichever thread encoded them first
+        std::FILE *video = nullptr;
+        std::mutex video_mutex;
+        std::condition_variable video_turn;
+        std::uint64_t next_video_frame = 0;
+
+        std::mutex error_mutex;
+        std::exception_ptr encode_error;
+
+        Stats statistics;
+
+        //Last, so its threads are joined before anything they use goes away
+        Parallel::ThreadPool encoders;
+
+    };
+
+}
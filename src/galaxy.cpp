@@ -1,67 +1,180 @@
+#include <algorithm>
 #include <cmath>
+#include <glm/geometric.hpp>
 
+#include "physics_constants.hpp"
 #include "random.hpp"
+#include "star.hpp"
 #include "galaxy.hpp"
 
 namespace {
 
     constexpr float PI = 3.141592;
 
-    constexpr float core_x_dist = 66.f;
-    constexpr float core_z_dist = 66.f;
-    
-    constexpr float outer_core_x_dist = 100.f;
-    constexpr float outer_core_z_dist = 100.f;
-
-    constexpr float galaxy_thickness = 10.f;
-
-    constexpr float arm_x_dist = 100.f;
-    constexpr float arm_z_dist = 50.f;
-    constexpr float arm_x_mean = 200.f;
-    constexpr float arm_z_mean = 100.f;
-
-    constexpr unsigned spiral = 3;
-    constexpr unsigned arms = 2;
+    const Galaxy::Shape &shape = Galaxy::shape;
 
     glm::vec4 spiral_point(glm::vec3 p, float offset) {
         float r = std::sqrt(p.x*p.x+p.z*p.z);
         float theta = offset;
         theta += p.x > 0.f ? std::atan(p.z/p.x) : std::atan(p.z/p.x)*PI;
-        theta += (r/arm_x_dist) * spiral;
+        theta += (r/shape.arm_x_dist) * shape.spiral;
         return glm::vec4(r*std::cos(theta), p.y, r*std::sin(theta), 1.f);
     }
 
+    //Position of star i out of n_points relative to the galaxy center. The first quarter is the core,
+    //the second the outer core and the rest is split evenly between the arms. Leftovers from n_points
+    //not dividing evenly go to the core.
+    glm::vec3 galaxy_point(std::size_t i, std::size_t n_points, RandomNum::Philox &rng) {
+
+        std::size_t core_end = n_points/4;
+        std::size_t outer_core_end = core_end + n_points/4;
+        std::size_t stars_per_arm = n_points/(shape.arms*2);
+        std::size_t arms_end = outer_core_end + stars_per_arm*shape.arms;
+
+        //Drawn in x, y, z order like galaxy.comp does
+        float g[3];
+        for (float &value : g) value = rng.gaus_rand(0.f, 1.f);
+
+        if (i < core_end || i >= arms_end)
+            return glm::vec3(g[0]*shape.core_x_dist, g[1]*shape.galaxy_thickness, g[2]*shape.core_z_dist);
+        else if (i < outer_core_end)
+            return glm::vec3(g[0]*shape.outer_core_x_dist, g[1]*shape.galaxy_thickness, g[2]*shape.outer_core_z_dist);
+
+        std::size_t arm = (i - outer_core_end)/stars_per_arm;
+        glm::vec3 p(g[0]*shape.arm_x_dist + shape.arm_x_mean, g[1]*shape.galaxy_thickness, g[2]*shape.arm_z_dist + shape.arm_z_mean);
+        return glm::vec3(spiral_point(p, (float)arm*2.f*PI/(float)shape.arms));
+
+    }
+
+    //Circular velocity around the galaxy's local y axis, position is relative to the galaxy center. The enclosed
+    //mass is treated as spherical and softened like in physics.comp, only the part of its pull in the disk plane
+    //keeps the star on its orbit.
+    glm::vec3 starting_velocity(glm::vec3 position, const Galaxy::MassProfile &profile) {
+
+        float plane_dist_sq = position.x*position.x + position.z*position.z;
+        if (plane_dist_sq == 0.f) return glm::vec3(0.f, 0.f, 0.f);
+
+        float dist_sq = glm::dot(position, position) + Physics::softening*Physics::softening;
+        float enclosed_mass = profile.enclosed(glm::length(position));
+        float speed = std::sqrt(Physics::G*enclosed_mass*plane_dist_sq/(dist_sq*std::sqrt(dist_sq)));
+
+        glm::vec3 dir = glm::vec3(position.z, 0.f, -position.x)/std::sqrt(plane_dist_sq);
+
+        return dir*speed;
+
+    }
+
 }
 
 namespace Galaxy {
 
-    std::vector<glm::vec4> generate_galaxy(std::size_t n_points, glm::vec3 center) {
+    const Shape shape = {
+        66.f, 66.f,     //core
+        100.f, 100.f,   //outer core
+        10.f,           //thickness
+        100.f, 50.f,    //arm spread
+        200.f, 100.f,   //arm mean
+        3, 2,           //spiral, arms
+    };
 
-        std::vector<glm::vec4> points;
+    Basis basis(glm::vec3 axis) {
 
-        glm::vec4 center_as_vec4 = glm::vec4(center, 0.f);
+        Basis b;
+        b.y = glm::normalize(axis);
 
-        for (std::size_t i = 0; i < n_points/4; i++) {
-            points.push_back(glm::vec4(
-                        RandomNum::gaus_rand(0, core_x_dist), RandomNum::gaus_rand(0, galaxy_thickness), RandomNum::gaus_rand(0, core_z_dist), 0.f
-                    )+center_as_vec4);
-        }
+        //Any vector that isn't parallel to the axis will do, picked so +y gives the identity
+        glm::vec3 ref = std::abs(b.y.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 0.f, 1.f);
+        b.z = glm::normalize(glm::cross(ref, b.y));
+        b.x = glm::cross(b.y, b.z);
 
-        for (std::size_t i = 0; i < n_points/4; i++) {
-            points.push_back(glm::vec4(
-                        RandomNum::gaus_rand(0, outer_core_x_dist), RandomNum::gaus_rand(0, galaxy_thickness), RandomNum::gaus_rand(0, outer_core_z_dist), 0.f
-                    )+center_as_vec4);
-        }
+        return b;
 
-        for (std::size_t i = 0; i < arms; i++) {
-            for (std::size_t j = 0; j < n_points/(arms*2); j++) {
-                points.push_back(
-                        spiral_point(glm::vec3(RandomNum::gaus_rand(arm_x_mean, arm_x_dist), RandomNum::gaus_rand(0.f, galaxy_thickness), RandomNum::gaus_rand(arm_z_mean, arm_z_dist)), (float)i*2.f*PI/(float)arms)+center_as_vec4
-                        );
+    }
+
+    float MassProfile::enclosed(float radius) const {
+
+        if (radii.empty()) return 0.f;
+
+        std::size_t j = std::upper_bound(radii.begin(), radii.end(), radius) - radii.begin();
+        if (j == radii.size()) return enclosed_mass.back();
+
+        float r0 = j == 0 ? 0.f : radii[j-1];
+        float m0 = j == 0 ? 0.f : enclosed_mass[j-1];
+        float t = radii[j] > r0 ? (radius - r0)/(radii[j] - r0) : 1.f;
+
+        return m0 + (enclosed_mass[j] - m0)*t;
+
+    }
+
+    MassProfile mass_profile(std::size_t first, std::size_t n_points, const Placement &placement, std::uint64_t seed) {
+
+        struct Sample {
+            float radius;
+            float mass;
+        };
+
+        //Same streams and draws as galaxy_star, so these are the distances of stars it will generate. Each sample
+        //stands for n_points/n_samples stars, so the last knot still holds the whole galaxy's mass.
+        std::size_t n_samples = std::min(n_points, profile_samples);
+        float sample_mass = static_cast<float>(placement.star_mass*(static_cast<double>(n_points)/std::max<std::size_t>(n_samples, 1)));
+        std::vector<Sample> samples(n_samples);
+        Parallel::parallel_for(n_samples, generation_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t s = begin; s < end; s++) {
+                std::size_t i = s*n_points/n_samples;
+                RandomNum::Philox rng(seed, first+i);
+                samples[s] = {glm::length(galaxy_point(i, n_points, rng)), sample_mass};
             }
+        });
+
+        Parallel::parallel_sort(samples, [](const Sample &a, const Sample &b) { return a.radius < b.radius; });
+
+        //Summed in double, a float sum of a million stars loses the last ones
+        std::vector<double> enclosed(n_samples);
+        Parallel::parallel_for(n_samples, generation_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) enclosed[i] = samples[i].mass;
+        });
+        Parallel::inclusive_scan(enclosed);
+
+        MassProfile profile;
+        std::size_t n_knots = std::min(n_samples, profile_knots);
+        for (std::size_t k = 0; k < n_knots; k++) {
+            std::size_t idx = (k+1)*n_samples/n_knots - 1;
+            profile.radii.push_back(samples[idx].radius);
+            profile.enclosed_mass.push_back(static_cast<float>(enclosed[idx]));
         }
 
-        return points;
+        return profile;
+
+    }
+
+    GalaxyStar galaxy_star(std::size_t i, std::size_t n_points, const Placement &placement, const MassProfile &profile, std::uint64_t seed, std::uint64_t stream) {
+
+        RandomNum::Philox rng(seed, stream);
+
+        glm::vec3 local_position = galaxy_point(i, n_points, rng);
+        glm::vec3 local_velocity = starting_velocity(local_position, profile);
+
+        std::size_t type_idx = Star::rand_star_type_idx(rng);
+
+        //Drawn last so the positions and types don't depend on the dispersion
+        if (placement.velocity_dispersion > 0.f) {
+            float stddev = placement.velocity_dispersion*glm::length(local_velocity);
+            float x = rng.gaus_rand(0.f, stddev);
+            float y = rng.gaus_rand(0.f, stddev);
+            float z = rng.gaus_rand(0.f, stddev);
+            local_velocity += glm::vec3(x, y, z);
+        }
+
+        const Basis &b = placement.frame;
+
+        GalaxyStar star;
+        star.position = placement.center + b.x*local_position.x + b.y*local_position.y + b.z*local_position.z;
+        star.velocity = placement.velocity + b.x*local_velocity.x + b.y*local_velocity.y + b.z*local_velocity.z;
+        star.mass = placement.star_mass;
+        star.type_idx = static_cast<std::uint32_t>(type_idx);
+        star.radius = Star::star_size_mults[type_idx];
+
+        return star;
 
     }
 
@@ -1,10 +1,114 @@
 #pragma once
 
-#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
+#include <glm/glm.hpp>
+
+#include "parallel.hpp"
 
 namespace Galaxy {
 
-    std::vector<glm::vec4> generate_galaxy(std::size_t n_points, glm::vec3 center);
+    //Standard deviations and means of the gaussian components a galaxy is built from
+    struct Shape {
+        float core_x_dist;
+        float core_z_dist;
+
+        float outer_core_x_dist;
+        float outer_core_z_dist;
+
+        float galaxy_thickness;
+
+        float arm_x_dist;
+        float arm_z_dist;
+        float arm_x_mean;
+        float arm_z_mean;
+
+        unsigned spiral;
+        unsigned arms;
+    };
+
+    extern const Shape shape;
+
+    //Bump whenever galaxy_star changes in a way that Shape doesn't capture, it invalidates cached initial conditions
+    constexpr std::uint32_t generator_version = 4;
+
+    //Orthonormal frame the local galaxy coordinates are rotated into, y is the normalized spin axis.
+    //An axis of +y gives the identity.
+    struct Basis {
+        glm::vec3 x;
+        glm::vec3 y;
+        glm::vec3 z;
+    };
+
+    Basis basis(glm::vec3 axis);
+
+    //Where a galaxy is and how it moves. Stars are generated with the disk in the xz plane spinning around +y,
+    //then rotated into frame.
+    struct Placement {
+        glm::vec3 center;
+        glm::vec3 velocity;
+        Basis frame;
+        float star_mass;
+        //Standard deviation of the random velocity added to every star, as a fraction of its circular speed
+        float velocity_dispersion;
+    };
+
+    //Knots of the profile
+    constexpr std::size_t profile_knots = 4096;
+    //Stars the profile is built from at most, evenly strided over larger galaxies. Plenty for profile_knots
+    //quantiles, and it keeps the profile a fixed cost next to generating the stars, on the GPU too.
+    constexpr std::size_t profile_samples = std::size_t(1) << 20;
+
+    //Mass enclosed within a distance from the galaxy center, sampled at profile_knots quantiles of the sorted
+    //star distances. Stars orbit at the circular speed this mass gives, so the disk starts close to equilibrium.
+    struct MassProfile {
+
+        std::vector<float> radii;
+        std::vector<float> enclosed_mass;
+
+        //Linear interpolation between the knots, the innermost knot is interpolated towards 0 at the center
+        float enclosed(float radius) const;
+
+    };
+
+    //Builds the profile of the galaxy generated with the same arguments, from up to profile_samples of its stars
+    //weighted to the galaxy's total mass. Their distances are computed and sorted in parallel and the masses prefix
+    //summed.
+    MassProfile mass_profile(std::size_t first, std::size_t n_points, const Placement &placement, std::uint64_t seed);
+
+    struct GalaxyStar {
+        glm::vec3 position;
+        glm::vec3 velocity;
+        float radius;
+        float mass;
+        std::uint32_t type_idx;
+    };
+
+    //Stars per parallel_for chunk
+    constexpr std::size_t generation_chunk_size = 16384;
+
+    //Star i out of a galaxy of n_points. It only depends on seed and stream (usually the global particle index),
+    //so any subset of stars can be generated independently and in any order.
+    GalaxyStar galaxy_star(std::size_t i, std::size_t n_points, const Placement &placement, const MassProfile &profile, std::uint64_t seed, std::uint64_t stream);
+
+    //Writes n_points stars into particles[first, first+n_points) in parallel chunks. Particles is anything with a
+    //set_particle(i, position, velocity, radius, mass, type_idx) member, e.g. a ParticleStore or mapped GPU buffers.
+    //The result doesn't depend on the number of threads.
+    template<typename Particles>
+    void generate_galaxy(Particles &particles, std::size_t first, std::size_t n_points, const Placement &placement, std::uint64_t seed) {
+
+        typedef typename Particles::vec3_type vec3_type;
+
+        MassProfile profile = mass_profile(first, n_points, placement, seed);
+
+        Parallel::parallel_for(n_points, generation_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                GalaxyStar star = galaxy_star(i, n_points, placement, profile, seed, first+i);
+                particles.set_particle(first+i, vec3_type(star.position), vec3_type(star.velocity), star.radius, star.mass, star.type_idx);
+            }
+        });
+
+    }
 
 }
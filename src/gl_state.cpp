@@ -0,0 +1,98 @@
+#include "gl_state.hpp"
+
+namespace GlState {
+
+    void Cache::use_program(GLuint new_program) {
+        if (update(program, new_program)) glUseProgram(new_program);
+    }
+
+    void Cache::bind_framebuffer(GLuint new_framebuffer) {
+        if (update(framebuffer, new_framebuffer)) glBindFramebuffer(GL_FRAMEBUFFER, new_framebuffer);
+    }
+
+    void Cache::bind_vertex_array(GLuint new_vao) {
+        if (update(vao, new_vao)) glBindVertexArray(new_vao);
+    }
+
+    void Cache::viewport(int x, int y, int width, int height) {
+        if (update(viewport_rect, std::array<int, 4>{x, y, width, height})) glViewport(x, y, width, height);
+    }
+
+    void Cache::set_enabled(GLenum capability, bool enabled) {
+
+        std::optional<bool> *current = nullptr;
+        if (capability == GL_DEPTH_TEST) current = &depth_test;
+        else if (capability == GL_BLEND) current = &blend;
+        else if (capability == GL_CULL_FACE) current = &cull;
+
+        if (current && !update(*current, enabled)) return;
+        if (!current) n_issued++;
+
+        if (enabled) glEnable(capability);
+        else glDisable(capability);
+
+    }
+
+    void Cache::cull_face(GLenum mode) {
+        if (update(cull_mode, mode)) glCullFace(mode);
+    }
+
+    void Cache::blend_func(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha) {
+        if (update(blend_funcs, std::array<GLenum, 4>{src_rgb, dst_rgb, src_alpha, dst_alpha}))
+            glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+    }
+
+    void Cache::depth_mask(bool write) {
+        if (update(depth_write, write)) glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void Cache::clear_color(float r, float g, float b, float a) {
+        if (update(clear_rgba, std::array<float, 4>{r, g, b, a})) glClearColor(r, g, b, a);
+    }
+
+    void Cache::bind_texture(unsigned unit, GLuint texture) {
+
+        if (unit >= tracked_texture_units) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            active_unit = unit;
+            n_issued += 2;
+            return;
+        }
+
+        if (textures[unit] == texture) {
+            n_skipped++;
+            return;
+        }
+        if (update(active_unit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+        update(textures[unit], texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+    }
+
+    GLint Cache::uniform_location(GLuint program, const char *name) {
+        std::map<std::string, GLint, std::less<>> &locations = uniform_locations[program];
+        auto found = locations.find(name);
+        if (found != locations.end()) return found->second;
+        GLint location = glGetUniformLocation(program, name);
+        locations.emplace(name, location);
+        return location;
+    }
+
+    void Cache::invalidate() {
+        program.reset();
+        framebuffer.reset();
+        vao.reset();
+        viewport_rect.reset();
+        depth_test.reset();
+        blend.reset();
+        cull.reset();
+        cull_mode.reset();
+        blend_funcs.reset();
+        depth_write.reset();
+        clear_rgba.reset();
+        active_unit.reset();
+        for (std::optional<GLuint> &texture : textures) texture.reset();
+    }
+
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <glad/glad.h>
+
+//Shadow copy of the GL state the frame loop sets, so setting what's already set costs no driver call, and a cache of
+//uniform locations so they're looked up once per program instead of every frame. The modules the frame loop calls
+//take the cache and set their state through it, code that changes tracked state without it has to be followed by
+//invalidate(). Only the draw side of the frame buffer binding matters, readbacks may bind GL_READ_FRAMEBUFFER.
+namespace GlState {
+
+    //Texture units whose bindings are tracked, higher ones are always set
+    constexpr unsigned tracked_texture_units = 8;
+
+    class Cache {
+    public:
+
+        void use_program(GLuint program);
+        void bind_framebuffer(GLuint framebuffer);
+        void bind_vertex_array(GLuint vao);
+        void viewport(int x, int y, int width, int height);
+
+        //GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE are tracked, other capabilities are always set
+        void set_enabled(GLenum capability, bool enabled);
+        void cull_face(GLenum mode);
+        void blend_func(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha);
+        void blend_func(GLenum src, GLenum dst) { blend_func(src, dst, src, dst); }
+        void depth_mask(bool write);
+        void clear_color(float r, float g, float b, float a);
+
+        //GL_TEXTURE_2D of unit
+        void bind_texture(unsigned unit, GLuint texture);
+
+        //-1 like glGetUniformLocation if program has no active uniform called name. Survives invalidate(), a
+        //program keeps its locations until it's deleted.
+        GLint uniform_location(GLuint program, const char *name);
+
+        //Forgets the tracked state, every next call is passed on to GL
+        void invalidate();
+        //Only forgets the vertex array, for draws that bind their own
+        void invalidate_vertex_array() { vao.reset(); }
+
+        //Calls passed on to GL and dropped as redundant since the start
+        std::uint64_t issued() const { return n_issued; }
+        std::uint64_t skipped() const { return n_skipped; }
+
+    private:
+
+        //Counts the call and returns whether it has to be made
+        template<typename T>
+        bool update(std::optional<T> &current, const T &value) {
+            if (current == value) {
+                n_skipped++;
+                return false;
+            }
+            current = value;
+            n_issued++;
+            return true;
+        }
+
+        std::optional<GLuint> program;
+        std::optional<GLuint> framebuffer;
+        std::optional<GLuint> vao;
+        std::optional<std::array<int, 4>> viewport_rect;
+        std::optional<bool> depth_test;
+        std::optional<bool> blend;
+        std::optional<bool> cull;
+        std::optional<GLenum> cull_mode;
+        std::optional<std::array<GLenum, 4>> blend_funcs;
+        std::optional<bool> depth_write;
+        std::optional<std::array<float, 4>> clear_rgba;
+        std::optional<unsigned> active_unit;
+        std::array<std::optional<GLuint>, tracked_texture_units> textures;
+
+        //std::less<> looks names up as they come, without building a std::string per call. C++17's unordered_map
+        //has no heterogeneous lookup, and a program only has a handful of uniforms.
+        std::unordered_map<GLuint, std::map<std::string, GLint, std::less<>>> uniform_locations;
+
+        std::uint64_t n_issued = 0;
+        std::uint64_t n_skipped = 0;
+
+    };
+
+}
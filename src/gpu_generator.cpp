@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "galaxy.hpp"
+#include "particle_layout.hpp"
+#include "particle_store.hpp"
+#include "physics_constants.hpp"
+#include "star.hpp"
+#include "gpu_generator.hpp"
+
+namespace {
+
+    //Must match the local size in galaxy.comp
+    constexpr std::size_t local_size_x = 64;
+
+    //Must match the mass_profile block in galaxy.comp, after the particle buffers
+    constexpr GLuint profile_binding = 3;
+
+    struct Moments {
+        double mean;
+        double stddev;
+    };
+
+    Moments moments(const std::vector<double> &values) {
+        double sum = 0.0, sum_sq = 0.0;
+        for (double v : values) {
+            sum += v;
+            sum_sq += v*v;
+        }
+        double n = static_cast<double>(values.size());
+        double mean = sum/n;
+        return {mean, std::sqrt(std::max(sum_sq/n - mean*mean, 0.0))};
+    }
+
+    //Two sample Kolmogorov-Smirnov statistic, sorts both inputs
+    double ks_statistic(std::vector<double> &a, std::vector<double> &b) {
+
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+
+        double max_diff = 0.0;
+        std::size_t i = 0, j = 0;
+        while (i < a.size() && j < b.size()) {
+            double x = std::min(a[i], b[j]);
+            while (i < a.size() && a[i] <= x) i++;
+            while (j < b.size() && b[j] <= x) j++;
+            double diff = std::abs(static_cast<double>(i)/a.size() - static_cast<double>(j)/b.size());
+            max_diff = std::max(max_diff, diff);
+        }
+
+        return max_diff;
+
+    }
+
+    bool report(const char *name, double value, double limit) {
+        bool passed = value <= limit;
+        std::printf("  %-28s %12.6f (limit %.6f) %s\n", name, value, limit, passed ? "ok" : "FAILED");
+        return passed;
+    }
+
+}
+
+namespace GpuGenerator {
+
+    void generate_galaxy(GLuint program, const GpuParticles::Buffers &buffers, std::size_t first, std::size_t n_points, const Galaxy::Placement &placement,
+                         const Galaxy::MassProfile &profile, std::uint64_t seed) {
+
+        std::vector<glm::vec2> knots(profile.radii.size());
+        for (std::size_t k = 0; k < knots.size(); k++) knots[k] = glm::vec2(profile.radii[k], profile.enclosed_mass[k]);
+
+        GLuint profile_buffer;
+        glGenBuffers(1, &profile_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, profile_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<std::size_t>(knots.size(), 1)*sizeof(glm::vec2), knots.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glUseProgram(program);
+
+        glUniform1ui(glGetUniformLocation(program, "first"), static_cast<GLuint>(first));
+        glUniform1ui(glGetUniformLocation(program, "n_points"), static_cast<GLuint>(n_points));
+        glUniform2ui(glGetUniformLocation(program, "seed"), static_cast<GLuint>(seed), static_cast<GLuint>(seed >> 32));
+
+        glUniform3fv(glGetUniformLocation(program, "center"), 1, glm::value_ptr(placement.center));
+        glUniform3fv(glGetUniformLocation(program, "bulk_velocity"), 1, glm::value_ptr(placement.velocity));
+        glUniform3fv(glGetUniformLocation(program, "frame_x"), 1, glm::value_ptr(placement.frame.x));
+        glUniform3fv(glGetUniformLocation(program, "frame_y"), 1, glm::value_ptr(placement.frame.y));
+        glUniform3fv(glGetUniformLocation(program, "frame_z"), 1, glm::value_ptr(placement.frame.z));
+        glUniform1f(glGetUniformLocation(program, "star_mass"), placement.star_mass);
+        glUniform1f(glGetUniformLocation(program, "velocity_dispersion"), placement.velocity_dispersion);
+
+        glUniform1ui(glGetUniformLocation(program, "n_knots"), static_cast<GLuint>(knots.size()));
+        glUniform1f(glGetUniformLocation(program, "G"), Physics::G);
+        glUniform1f(glGetUniformLocation(program, "softening"), Physics::softening);
+
+        const Galaxy::Shape &shape = Galaxy::shape;
+        glUniform1f(glGetUniformLocation(program, "core_x_dist"), shape.core_x_dist);
+        glUniform1f(glGetUniformLocation(program, "core_z_dist"), shape.core_z_dist);
+        glUniform1f(glGetUniformLocation(program, "outer_core_x_dist"), shape.outer_core_x_dist);
+        glUniform1f(glGetUniformLocation(program, "outer_core_z_dist"), shape.outer_core_z_dist);
+        glUniform1f(glGetUniformLocation(program, "galaxy_thickness"), shape.galaxy_thickness);
+        glUniform1f(glGetUniformLocation(program, "arm_x_dist"), shape.arm_x_dist);
+        glUniform1f(glGetUniformLocation(program, "arm_z_dist"), shape.arm_z_dist);
+        glUniform1f(glGetUniformLocation(program, "arm_x_mean"), shape.arm_x_mean);
+        glUniform1f(glGetUniformLocation(program, "arm_z_mean"), shape.arm_z_mean);
+        glUniform1ui(glGetUniformLocation(program, "spiral"), shape.spiral);
+        glUniform1ui(glGetUniformLocation(program, "arms"), shape.arms);
+
+        glUniform1fv(glGetUniformLocation(program, "star_probabilities"), Star::n_star_colors, Star::star_probabilities.data());
+        glUniform1fv(glGetUniformLocation(program, "star_size_mults"), Star::n_star_colors, Star::star_size_mults.data());
+
+        GpuParticles::bind(buffers);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, profile_binding, profile_buffer);
+
+        GpuParticles::dispatch_chunked(glGetUniformLocation(program, "dispatch_offset"), n_points, local_size_x);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT | GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+        glUseProgram(0);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, profile_binding, 0);
+        glDeleteBuffers(1, &profile_buffer);
+
+    }
+
+    bool check_against_cpu(GLuint program, std::size_t n_points, const Galaxy::Placement &placement, std::uint64_t seed) {
+
+        glm::vec3 center = placement.center;
+
+        //GPU side
+        GpuParticles::Buffers buffers = GpuParticles::create_buffers(n_points);
+        generate_galaxy(program, buffers, 0, n_points, placement, Galaxy::mass_profile(0, n_points, placement, seed), seed);
+
+        std::vector<glm::vec4> gpu_positions(n_points);
+        std::vector<glm::vec4> gpu_velocities(n_points);
+        std::vector<ParticleLayout::ParticleInfo> gpu_info(n_points);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.positions);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n_points*sizeof(glm::vec4), gpu_positions.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.velocities);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n_points*sizeof(glm::vec4), gpu_velocities.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.info);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, n_points*sizeof(ParticleLayout::ParticleInfo), gpu_info.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        GpuParticles::delete_buffers(buffers);
+
+        //CPU side
+        Particles::HostParticleStore cpu(n_points);
+        Galaxy::generate_galaxy(cpu, 0, n_points, placement, seed);
+
+        std::printf("Comparing GPU and CPU initial conditions for %zu stars:\n", n_points);
+
+        bool passed = true;
+
+        //Per axis offset from the center
+        const char *axis_names[3] = {"x", "y", "z"};
+        for (int axis = 0; axis < 3; axis++) {
+            std::vector<double> gpu_values(n_points), cpu_values(n_points);
+            for (std::size_t i = 0; i < n_points; i++) {
+                gpu_values[i] = gpu_positions[i][axis] - center[axis];
+                cpu_values[i] = cpu.position(i)[axis] - center[axis];
+            }
+            Moments gpu_moments = moments(gpu_values);
+            Moments cpu_moments = moments(cpu_values);
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "position.%s mean diff/stddev", axis_names[axis]);
+            passed &= report(name, std::abs(gpu_moments.mean - cpu_moments.mean)/cpu_moments.stddev, 0.02);
+            std::snprintf(name, sizeof(name), "position.%s stddev rel diff", axis_names[axis]);
+            passed &= report(name, std::abs(gpu_moments.stddev - cpu_moments.stddev)/cpu_moments.stddev, 0.02);
+        }
+
+        //Radial distribution in the disk plane and speeds, two sample KS at the 1% level
+        double ks_limit = 1.63*std::sqrt(2.0/static_cast<double>(n_points));
+        {
+            std::vector<double> gpu_radii(n_points), cpu_radii(n_points);
+            std::vector<double> gpu_speeds(n_points), cpu_speeds(n_points);
+            for (std::size_t i = 0; i < n_points; i++) {
+                glm::vec3 gpu_offset = glm::vec3(gpu_positions[i]) - center;
+                glm::vec3 cpu_offset = glm::vec3(cpu.position(i)) - center;
+                gpu_radii[i] = std::sqrt(gpu_offset.x*gpu_offset.x + gpu_offset.z*gpu_offset.z);
+                cpu_radii[i] = std::sqrt(cpu_offset.x*cpu_offset.x + cpu_offset.z*cpu_offset.z);
+                gpu_speeds[i] = glm::length(glm::vec3(gpu_velocities[i]));
+                cpu_speeds[i] = glm::length(glm::vec3(cpu.velocity(i)));
+            }
+            passed &= report("radius KS statistic", ks_statistic(gpu_radii, cpu_radii), ks_limit);
+            passed &= report("speed KS statistic", ks_statistic(gpu_speeds, cpu_speeds), ks_limit);
+        }
+
+        //Star type frequencies and the matching radii
+        {
+            std::vector<double> gpu_counts(Star::n_star_colors, 0.0), cpu_counts(Star::n_star_colors, 0.0);
+            std::size_t bad_radii = 0;
+            for (std::size_t i = 0; i < n_points; i++) {
+                if (gpu_info[i].type_idx >= Star::n_star_colors) {
+                    bad_radii++;
+                    continue;
+                }
+                gpu_counts[gpu_info[i].type_idx] += 1.0;
+                cpu_counts[cpu.type_idx(i)] += 1.0;
+                if (gpu_positions[i].w != Star::star_size_mults[gpu_info[i].type_idx]) bad_radii++;
+                if (gpu_velocities[i].w != placement.star_mass) bad_radii++;
+            }
+            double max_freq_diff = 0.0;
+            for (std::size_t t = 0; t < Star::n_star_colors; t++)
+                max_freq_diff = std::max(max_freq_diff, std::abs(gpu_counts[t] - cpu_counts[t])/static_cast<double>(n_points));
+            passed &= report("star type max freq diff", max_freq_diff, ks_limit);
+            passed &= report("bad types/radii/masses", static_cast<double>(bad_radii), 0.0);
+        }
+
+        //Both generators draw from the same Philox streams, so most stars should also match individually
+        {
+            std::size_t matching = 0;
+            for (std::size_t i = 0; i < n_points; i++)
+                if (glm::distance(glm::vec3(gpu_positions[i]), glm::vec3(cpu.position(i))) < 1e-2f) matching++;
+            std::printf("  %-28s %12.6f\n", "stars matching exactly", static_cast<double>(matching)/n_points);
+        }
+
+        std::printf("%s\n", passed ? "GPU initial conditions match the CPU reference" : "GPU initial conditions DO NOT match the CPU reference");
+
+        return passed;
+
+    }
+
+}
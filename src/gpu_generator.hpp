@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "galaxy.hpp"
+#include "gpu_particles.hpp"
+
+//Initial condition generation on the GPU, see shaders/galaxy.comp. Galaxy::generate_galaxy is the reference.
+namespace GpuGenerator {
+
+    //Writes the same stars as Galaxy::generate_galaxy would into buffers[first, first+n_points). profile comes from
+    //Galaxy::mass_profile with the same arguments. program has to be linked from shaders/galaxy.comp.
+    void generate_galaxy(GLuint program, const GpuParticles::Buffers &buffers, std::size_t first, std::size_t n_points, const Galaxy::Placement &placement,
+                         const Galaxy::MassProfile &profile, std::uint64_t seed);
+
+    //Generates a galaxy of n_points with both generators and checks that the position, velocity and star type
+    //distributions match. Prints a report and returns whether every check passed.
+    bool check_against_cpu(GLuint program, std::size_t n_points, const Galaxy::Placement &placement, std::uint64_t seed);
+
+}
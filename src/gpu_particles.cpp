@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "parallel.hpp"
+#include "particle_layout.hpp"
+#include "gpu_particles.hpp"
+
+namespace {
+
+    //Particles per parallel_for chunk when packing into mapped buffers
+    constexpr std::size_t upload_chunk_size = 16384;
+
+    GLuint create_ssbo(std::size_t size) {
+
+        GLuint ssbo;
+        glGenBuffers(1, &ssbo);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        return ssbo;
+
+    }
+
+    void* map_for_write(GLuint ssbo, std::size_t size) {
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        void *ptr = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (ptr == NULL) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Failed to map particle buffer " << ssbo << " (" << size << " bytes)\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+
+        return ptr;
+
+    }
+
+    const void* map_for_read(GLuint ssbo, std::size_t size) {
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        const void *ptr = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (ptr == NULL) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Failed to map particle buffer " << ssbo << " (" << size << " bytes) for reading\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+
+        return ptr;
+
+    }
+
+    void unmap_ssbo(GLuint ssbo) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+}
+
+namespace GpuParticles {
+
+    Buffers create_buffers(std::size_t n_particles) {
+
+        Buffers buffers;
+        buffers.n_particles = n_particles;
+        buffers.positions = create_ssbo(n_particles*sizeof(glm::vec4));
+        buffers.velocities = create_ssbo(n_particles*sizeof(glm::vec4));
+        buffers.info = create_ssbo(n_particles*sizeof(ParticleLayout::ParticleInfo));
+
+        return buffers;
+
+    }
+
+    void delete_buffers(Buffers &buffers) {
+        glDeleteBuffers(1, &buffers.positions);
+        glDeleteBuffers(1, &buffers.velocities);
+        glDeleteBuffers(1, &buffers.info);
+        buffers.n_particles = 0;
+    }
+
+    void upload(const Buffers &buffers, const Particles::HostParticleStore &store) {
+
+        std::size_t n = buffers.n_particles < store.size() ? buffers.n_particles : store.size();
+
+        MappedParticles mapped = map(buffers);
+
+        Parallel::parallel_for(n, upload_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                mapped.positions[i] = glm::vec4(glm::vec3(store.position(i)), static_cast<float>(store.radius(i)));
+                mapped.velocities[i] = glm::vec4(glm::vec3(store.velocity(i)), static_cast<float>(store.mass(i)));
+                mapped.info[i] = {static_cast<float>(store.lighting(i)), store.type_idx(i)};
+            }
+        });
+
+        unmap(buffers);
+
+    }
+
+    void upload_motion(const Buffers &buffers, const Particles::HostParticleStore &store) {
+
+        std::size_t n = buffers.n_particles < store.size() ? buffers.n_particles : store.size();
+
+        glm::vec4 *positions = static_cast<glm::vec4*>(map_for_write(buffers.positions, buffers.n_particles*sizeof(glm::vec4)));
+        glm::vec4 *velocities = static_cast<glm::vec4*>(map_for_write(buffers.velocities, buffers.n_particles*sizeof(glm::vec4)));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        Parallel::parallel_for(n, upload_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                positions[i] = glm::vec4(glm::vec3(store.position(i)), static_cast<float>(store.radius(i)));
+                velocities[i] = glm::vec4(glm::vec3(store.velocity(i)), static_cast<float>(store.mass(i)));
+            }
+        });
+
+        unmap_ssbo(buffers.positions);
+        unmap_ssbo(buffers.velocities);
+
+    }
+
+    void download(const Buffers &buffers, Particles::HostParticleStore &store) {
+
+        typedef Particles::HostParticleStore::vec3_type vec3_type;
+        typedef Particles::HostParticleStore::value_type value_type;
+
+        std::size_t n = buffers.n_particles;
+        store.resize(n);
+
+        //The physics shader writes the particles through SSBOs
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+        const glm::vec4 *positions = static_cast<const glm::vec4*>(map_for_read(buffers.positions, n*sizeof(glm::vec4)));
+        const glm::vec4 *velocities = static_cast<const glm::vec4*>(map_for_read(buffers.velocities, n*sizeof(glm::vec4)));
+        const ParticleLayout::ParticleInfo *info = static_cast<const ParticleLayout::ParticleInfo*>(map_for_read(buffers.info, n*sizeof(ParticleLayout::ParticleInfo)));
+
+        Parallel::parallel_for(n, upload_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                store.set_particle(i, vec3_type(glm::vec3(positions[i])), vec3_type(glm::vec3(velocities[i])),
+                                   static_cast<value_type>(positions[i].w), static_cast<value_type>(velocities[i].w), info[i].type_idx);
+                store.lighting(i) = static_cast<value_type>(info[i].lighting);
+            }
+        });
+
+        unmap_ssbo(buffers.positions);
+        unmap_ssbo(buffers.velocities);
+        unmap_ssbo(buffers.info);
+
+    }
+
+    MappedParticles map(const Buffers &buffers) {
+
+        MappedParticles mapped;
+        mapped.n_particles = buffers.n_particles;
+        mapped.positions = static_cast<glm::vec4*>(map_for_write(buffers.positions, buffers.n_particles*sizeof(glm::vec4)));
+        mapped.velocities = static_cast<glm::vec4*>(map_for_write(buffers.velocities, buffers.n_particles*sizeof(glm::vec4)));
+        mapped.info = static_cast<ParticleLayout::ParticleInfo*>(map_for_write(buffers.info, buffers.n_particles*sizeof(ParticleLayout::ParticleInfo)));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        return mapped;
+
+    }
+
+    void unmap(const Buffers &buffers) {
+        unmap_ssbo(buffers.positions);
+        unmap_ssbo(buffers.velocities);
+        unmap_ssbo(buffers.info);
+    }
+
+    void bind(const Buffers &buffers) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ParticleLayout::positions_binding, buffers.positions);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ParticleLayout::velocities_binding, buffers.velocities);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ParticleLayout::info_binding, buffers.info);
+    }
+
+    void dispatch_chunked(GLint dispatch_offset_location, std::size_t n, std::size_t local_size) {
+        std::size_t max_per_dispatch = max_groups_per_dispatch*local_size;
+        for (std::size_t offset = 0; offset < n; offset += max_per_dispatch) {
+            std::size_t chunk = std::min(n - offset, max_per_dispatch);
+            glUniform1ui(dispatch_offset_location, static_cast<GLuint>(offset));
+            glDispatchCompute(static_cast<GLuint>((chunk + local_size - 1)/local_size), 1, 1);
+        }
+    }
+
+}
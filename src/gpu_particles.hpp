@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "particle_layout.hpp"
+
+#include "particle_store.hpp"
+
+//The particle SSBOs described by particle_layout.hpp
+namespace GpuParticles {
+
+    struct Buffers {
+        GLuint positions;
+        GLuint velocities;
+        GLuint info;
+        std::size_t n_particles;
+    };
+
+    //Host view of the mapped particle buffers. The memory may be write-combined, so it should only be written,
+    //one whole particle at a time. Different particles can be written from different threads.
+    struct MappedParticles {
+
+        typedef glm::vec3 vec3_type;
+
+        glm::vec4 *positions;
+        glm::vec4 *velocities;
+        ParticleLayout::ParticleInfo *info;
+        std::size_t n_particles;
+
+        std::size_t size() const { return n_particles; }
+
+        void set_particle(std::size_t i, const glm::vec3 &p, const glm::vec3 &v, float r, float m, std::uint32_t type) {
+            positions[i] = glm::vec4(p, r);
+            velocities[i] = glm::vec4(v, m);
+            info[i] = {0.f, type};
+        }
+
+    };
+
+    Buffers create_buffers(std::size_t n_particles);
+    void delete_buffers(Buffers &buffers);
+
+    //Packs the store straight into the mapped buffers, no intermediate host copy is made
+    void upload(const Buffers &buffers, const Particles::HostParticleStore &store);
+
+    //Only the positions and velocities (with the radii and masses), everything a host side step changes
+    void upload_motion(const Buffers &buffers, const Particles::HostParticleStore &store);
+
+    //Unpacks the buffers into the store, which is resized to hold them. Waits for the GPU.
+    void download(const Buffers &buffers, Particles::HostParticleStore &store);
+
+    //Maps all of the buffers for writing, their previous contents are discarded.
+    //No GL calls may touch the buffers until unmap() is called.
+    MappedParticles map(const Buffers &buffers);
+    void unmap(const Buffers &buffers);
+
+    void bind(const Buffers &buffers);
+
+    //GL only guarantees 65535 work groups per dimension
+    constexpr std::size_t max_groups_per_dispatch = 65535;
+
+    //Runs the bound compute program over n items with local_size invocations per group, in as many dispatches as
+    //that limit needs. Before each, the uniform uint at dispatch_offset_location is set to the first item, which
+    //the shader adds to gl_GlobalInvocationID.x.
+    void dispatch_chunked(GLint dispatch_offset_location, std::size_t n, std::size_t local_size);
+
+}
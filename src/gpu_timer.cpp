@@ -0,0 +1,64 @@
+#include "gpu_timer.hpp"
+
+namespace GpuTimer {
+
+    Timer::Timer() {
+        for (Section &section : sections) glGenQueries(2, section.queries.data());
+    }
+
+    void Timer::begin() {
+
+        collect();
+
+        current = max_pending;
+        for (std::size_t i = 0; i < max_pending; i++) {
+            if (!sections[i].pending) {
+                current = i;
+                break;
+            }
+        }
+        if (current == max_pending) return;
+
+        glQueryCounter(sections[current].queries[0], GL_TIMESTAMP);
+
+    }
+
+    void Timer::end() {
+
+        if (current == max_pending) return;
+
+        glQueryCounter(sections[current].queries[1], GL_TIMESTAMP);
+        sections[current].pending = true;
+        current = max_pending;
+
+    }
+
+    void Timer::reset() {
+        last_seconds = 0.0;
+        total_seconds = 0.0;
+        n_samples = 0;
+    }
+
+    void Timer::collect() {
+
+        for (Section &section : sections) {
+            if (!section.pending) continue;
+
+            //The end timestamp is written last, once it's there so is the start
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(section.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+
+            GLuint64 start, end;
+            glGetQueryObjectui64v(section.queries[0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(section.queries[1], GL_QUERY_RESULT, &end);
+            section.pending = false;
+
+            last_seconds = (end - start)*1e-9;
+            total_seconds += last_seconds;
+            n_samples++;
+        }
+
+    }
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+//GPU time of a section of the frame, measured with a pair of GL_TIMESTAMP queries around it. Results are collected
+//once the GPU has them, a few frames later, so measuring never stalls the pipeline. Unlike GL_TIME_ELAPSED
+//timestamps can be nested and overlapped freely.
+namespace GpuTimer {
+
+    //Sections in flight at once, a section is skipped if all of them are still waiting for the GPU
+    constexpr std::size_t max_pending = 4;
+
+    class Timer {
+    public:
+
+        //Needs a current GL context, the queries go away with it
+        Timer();
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+        //Call around the GL commands to measure, at most once per frame
+        void begin();
+        void end();
+
+        //Of the newest section whose results arrived, in milliseconds
+        double last_ms() const { return last_seconds*1e3; }
+        //Over every section measured so far
+        double mean_ms() const { return n_samples > 0 ? total_seconds*1e3/n_samples : 0.0; }
+        std::uint64_t samples() const { return n_samples; }
+
+        //Forgets the sums, sections still in flight count towards the new ones
+        void reset();
+
+    private:
+
+        struct Section {
+            std::array<GLuint, 2> queries;
+            bool pending = false;
+        };
+
+        //Reads every section the GPU has finished
+        void collect();
+
+        std::array<Section, max_pending> sections;
+        std::size_t current = max_pending;
+
+        double last_seconds = 0.0;
+        double total_seconds = 0.0;
+        std::uint64_t n_samples = 0;
+
+    };
+
+}
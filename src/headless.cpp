@@ -0,0 +1,133 @@
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef HAVE_EGL
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#endif
+
+#include "headless.hpp"
+
+#ifdef HAVE_EGL
+
+namespace {
+
+    std::runtime_error egl_error(const char *what) {
+        std::ostringstream err_msg_stream;
+        err_msg_stream << "Error: " << what << " (EGL error 0x" << std::hex << eglGetError() << ")\n";
+        return std::runtime_error(err_msg_stream.str());
+    }
+
+    bool has_extension(const char *extensions, const char *name) {
+        if (extensions == nullptr) return false;
+        std::size_t length = std::strlen(name);
+        for (const char *found = std::strstr(extensions, name); found != nullptr; found = std::strstr(found + length, name)) {
+            bool starts = found == extensions || found[-1] == ' ';
+            bool ends = found[length] == ' ' || found[length] == '\0';
+            if (starts && ends) return true;
+        }
+        return false;
+    }
+
+    //The surfaceless platform needs no X server, Wayland compositor or DRM device node. Drivers without it get the
+    //default display, which works headless too as long as it doesn't need a display server.
+    EGLDisplay open_display() {
+        const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        if (has_extension(client_extensions, "EGL_EXT_platform_base") && has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+            auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+            if (get_platform_display != nullptr) {
+                EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+                if (display != EGL_NO_DISPLAY) return display;
+            }
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+}
+
+namespace Headless {
+
+    Context::Context(bool debug) {
+
+        EGLDisplay egl_display = open_display();
+        if (egl_display == EGL_NO_DISPLAY) throw egl_error("No EGL display for headless rendering");
+        EGLint major, minor;
+        if (!eglInitialize(egl_display, &major, &minor)) throw egl_error("Failed to initialize EGL");
+        display = egl_display;
+
+        const char *extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+        if (!has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+            eglTerminate(egl_display);
+            throw std::runtime_error("Error: The EGL driver can't make a context current without a surface\n");
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            eglTerminate(egl_display);
+            throw egl_error("The EGL driver has no desktop GL");
+        }
+
+        //Nothing is drawn to an EGL surface, so any config will do, or none where the driver allows that
+        EGLConfig config = nullptr;
+        const EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+        EGLint n_configs = 0;
+        if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &n_configs) || n_configs == 0) {
+            if (!has_extension(extensions, "EGL_KHR_no_config_context")) {
+                eglTerminate(egl_display);
+                throw egl_error("No EGL config with desktop GL");
+            }
+            config = nullptr;
+        }
+
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_CONTEXT_OPENGL_DEBUG, debug ? EGL_TRUE : EGL_FALSE,
+            EGL_NONE
+        };
+        EGLContext egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+        if (egl_context == EGL_NO_CONTEXT) {
+            std::runtime_error error = egl_error("Failed to create a headless GL 4.3 core context");
+            eglTerminate(egl_display);
+            throw error;
+        }
+        context = egl_context;
+
+        if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context)) {
+            std::runtime_error error = egl_error("Failed to make the headless context current");
+            eglDestroyContext(egl_display, egl_context);
+            eglTerminate(egl_display);
+            throw error;
+        }
+
+    }
+
+    Context::~Context() {
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    void* get_proc_address(const char *name) {
+        return reinterpret_cast<void*>(eglGetProcAddress(name));
+    }
+
+}
+
+#else
+
+namespace Headless {
+
+    Context::Context(bool) {
+        throw std::runtime_error("Error: This build has no EGL, headless rendering isn't available\n");
+    }
+
+    Context::~Context() {}
+
+    void* get_proc_address(const char*) {
+        return nullptr;
+    }
+
+}
+
+#endif
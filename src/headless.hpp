@@ -0,0 +1,31 @@
+#pragma once
+
+//A GL 4.3 core context without a window or a display server, for rendering on machines without either. It's a
+//surfaceless EGL context, which Mesa also provides on top of its software rasterizer (llvmpipe, picked with
+//LIBGL_ALWAYS_SOFTWARE=1) when there is no GPU. There is no default frame buffer, everything is drawn into
+//frame buffer objects. Builds without EGL throw when a context is created.
+namespace Headless {
+
+    class Context {
+    public:
+
+        //Makes the context current on the calling thread. Throws std::runtime_error if there is no EGL device or
+        //it can't do GL 4.3 core.
+        explicit Context(bool debug);
+        ~Context();
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+    private:
+
+        //EGLDisplay and EGLContext, kept opaque so including this doesn't pull in the EGL headers
+        void *display = nullptr;
+        void *context = nullptr;
+
+    };
+
+    //For gladLoadGLLoader(), GL functions of the current headless context
+    void* get_proc_address(const char *name);
+
+}
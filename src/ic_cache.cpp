@@ -0,0 +1,162 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "galaxy.hpp"
+#include "mapped_file.hpp"
+#include "particle_file.hpp"
+#include "physics_constants.hpp"
+#include "particle_layout.hpp"
+#include "star.hpp"
+#include "ic_cache.hpp"
+
+namespace {
+
+    constexpr char magic[8] = {'G', 'S', 'I', 'M', 'I', 'C', 0, 0};
+    constexpr std::uint32_t format_version = 1;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t endian_marker;
+        std::uint64_t hash;
+        std::uint64_t n_particles;
+        ParticleFile::Sections sections;
+    };
+
+    Header make_header(std::uint64_t hash, std::uint64_t n_particles) {
+        Header header;
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = format_version;
+        header.endian_marker = ParticleFile::endian_marker;
+        header.hash = hash;
+        header.n_particles = n_particles;
+        header.sections = ParticleFile::sections(sizeof(Header), n_particles);
+        return header;
+    }
+
+    //Streams a buffer from a read mapping straight into the file
+    void write_buffer(std::FILE *file, GLuint buffer, std::size_t size, const std::string &path) {
+
+        if (size == 0) return;
+
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        const void *ptr = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (ptr == NULL) {
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            throw std::runtime_error("Error: Failed to map a particle buffer for reading\n");
+        }
+
+        try {
+            ParticleFile::write_or_throw(file, ptr, size, path);
+        }
+        catch (...) {
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            throw;
+        }
+
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    }
+
+}
+
+namespace ICCache {
+
+    void Hasher::add_bytes(const void *data, std::size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char*>(data);
+        for (std::size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3;
+        }
+    }
+
+    void add_generator_constants(Hasher &hasher) {
+
+        hasher.add(Galaxy::generator_version);
+        hasher.add(Galaxy::profile_knots);
+        hasher.add(Physics::G);
+        hasher.add(Physics::softening);
+
+        const Galaxy::Shape &shape = Galaxy::shape;
+        hasher.add(shape.core_x_dist);
+        hasher.add(shape.core_z_dist);
+        hasher.add(shape.outer_core_x_dist);
+        hasher.add(shape.outer_core_z_dist);
+        hasher.add(shape.galaxy_thickness);
+        hasher.add(shape.arm_x_dist);
+        hasher.add(shape.arm_z_dist);
+        hasher.add(shape.arm_x_mean);
+        hasher.add(shape.arm_z_mean);
+        hasher.add(shape.spiral);
+        hasher.add(shape.arms);
+
+        for (std::size_t i = 0; i < Star::n_star_colors; i++) {
+            hasher.add(Star::star_size_mults[i]);
+            hasher.add(Star::star_probabilities[i]);
+        }
+
+    }
+
+    std::string cache_path(const std::string &cache_folder, std::uint64_t hash) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "ic_%016llx.bin", static_cast<unsigned long long>(hash));
+        return cache_folder + name;
+    }
+
+    bool load(const std::string &path, std::uint64_t hash, const GpuParticles::Buffers &buffers) {
+
+        if (!std::filesystem::exists(path)) return false;
+
+        File::MappedFile file(path);
+
+        Header expected = make_header(hash, buffers.n_particles);
+        Header header;
+        if (file.size() < sizeof(Header)) return false;
+        std::memcpy(&header, file.data(), sizeof(Header));
+
+        if (std::memcmp(header.magic, expected.magic, sizeof(magic)) != 0 ||
+                header.version != expected.version ||
+                header.endian_marker != expected.endian_marker ||
+                header.hash != expected.hash ||
+                header.n_particles != expected.n_particles ||
+                std::memcmp(&header.sections, &expected.sections, sizeof(ParticleFile::Sections)) != 0 ||
+                file.size() < header.sections.file_size) {
+            std::fprintf(stderr, "Warning: Ignoring stale or foreign IC cache file \"%s\"\n", path.c_str());
+            return false;
+        }
+
+        ParticleFile::upload(file, header.sections, buffers);
+
+        return true;
+
+    }
+
+    void store(const std::string &path, std::uint64_t hash, const GpuParticles::Buffers &buffers) {
+
+        Header header = make_header(hash, buffers.n_particles);
+        std::size_t n = buffers.n_particles;
+
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+        ParticleFile::write_atomically(path, [&](std::FILE *file, const std::string &tmp_path) {
+            ParticleFile::write_or_throw(file, &header, sizeof(header), tmp_path);
+            ParticleFile::pad_to(file, header.sections.positions_offset, tmp_path);
+            write_buffer(file, buffers.positions, n*sizeof(glm::vec4), tmp_path);
+            ParticleFile::pad_to(file, header.sections.velocities_offset, tmp_path);
+            write_buffer(file, buffers.velocities, n*sizeof(glm::vec4), tmp_path);
+            ParticleFile::pad_to(file, header.sections.info_offset, tmp_path);
+            write_buffer(file, buffers.info, n*sizeof(ParticleLayout::ParticleInfo), tmp_path);
+        });
+
+    }
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "gpu_particles.hpp"
+
+//Content addressed cache of generated initial conditions. Files are named after a hash of everything the
+//generator depends on and hold the particle buffers in their GPU layout, so a hit is a map plus an upload.
+namespace ICCache {
+
+    //64 bit FNV-1a
+    class Hasher {
+    public:
+
+        void add_bytes(const void *data, std::size_t size);
+
+        template<typename T>
+        void add(const T &value) { add_bytes(&value, sizeof(T)); }
+
+        std::uint64_t value() const { return hash; }
+
+    private:
+
+        std::uint64_t hash = 0xcbf29ce484222325;
+
+    };
+
+    //Adds the constants from galaxy.cpp and star.cpp that the generated stars depend on
+    void add_generator_constants(Hasher &hasher);
+
+    std::string cache_path(const std::string &cache_folder, std::uint64_t hash);
+
+    //Uploads the cached initial conditions into buffers. Returns false if there is no valid cache file
+    //for this hash and particle count.
+    bool load(const std::string &path, std::uint64_t hash, const GpuParticles::Buffers &buffers);
+
+    //Reads the buffers back and writes them to path. Throws std::runtime_error on failure.
+    void store(const std::string &path, std::uint64_t hash, const GpuParticles::Buffers &buffers);
+
+}
@@ -1,9 +1,11 @@
 #include <array>
 #include <cerrno>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
+#include <memory>
 #include <glm/ext/matrix_projection.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/geometric.hpp>
@@ -34,10 +36,32 @@
 
 #include "debug.hpp"
 #include "shaders.hpp"
-#include "sphere.hpp"
+#include "star_culling.hpp"
 #include "camera.hpp"
 #include "galaxy.hpp"
 #include "star.hpp"
+#include "particle_layout.hpp"
+#include "gpu_particles.hpp"
+#include "gpu_generator.hpp"
+#include "settings.hpp"
+#include "ic_cache.hpp"
+#include "physics_constants.hpp"
+#include "scenario.hpp"
+#include "catalog.hpp"
+#include "checkpoint.hpp"
+#include "async_file.hpp"
+#include "snapshot.hpp"
+#include "trajectory.hpp"
+#include "playback.hpp"
+#include "cpu_solver.hpp"
+#include "bloom.hpp"
+#include "blur.hpp"
+#include "gl_state.hpp"
+#include "dynamic_resolution.hpp"
+#include "frame_export.hpp"
+#include "gpu_timer.hpp"
+#include "headless.hpp"
+#include "render_graph.hpp"
 
 std::string get_exe_path() {
 
@@ -70,40 +94,99 @@ std::string get_exe_path() {
 
 }
 
+//Headless runs have no window, the cursor stays put and every key stays released
+
 glm::vec2 get_cursor_pos(GLFWwindow *window) {
+    if (window == NULL) return glm::vec2(0.f);
+
     double x, y;
     glfwGetCursorPos(window, &x, &y);
 
     return glm::vec2(x, y);
 }
 
-int main() {
+int get_key(GLFWwindow *window, int key) {
+    return window == NULL ? GLFW_RELEASE : glfwGetKey(window, key);
+}
+
+int main(int argc, char **argv) {
+
+    Settings::Settings settings;
+    try {
+        settings = Settings::parse_args(argc, argv);
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
+        Settings::print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!settings.use_io_uring) AsyncFile::disable_io_uring();
+
+    Scenario::Scenario scenario;
+    //Only counts the rows for now, the particles are parsed once the buffers exist. A restart doesn't need it.
+    std::unique_ptr<Catalog::Catalog> catalog;
+    try {
+        if (!settings.catalog_path.empty()) {
+            if (settings.restart_path.empty()) {
+                Catalog::Schema schema = Catalog::parse_schema(settings.catalog_schema.empty() ? Catalog::default_schema : settings.catalog_schema);
+                catalog = std::make_unique<Catalog::Catalog>(settings.catalog_path, schema);
+            }
+        }
+        else {
+            scenario = settings.scenario_path.empty() ?
+                Scenario::default_scenario(settings.n_particles) : Scenario::load_scenario(settings.scenario_path);
+        }
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
+        return EXIT_FAILURE;
+    }
 
     std::string exe_path = get_exe_path();
     std::string exe_folder = exe_path;
     while (exe_folder.back() != '/' && exe_folder.length() != 0) exe_folder.pop_back();
 
-    //Initialize and configure glfw
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    //Vertical field of view in degrees
+    constexpr float fov_y = 60.f;
 
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+    //Without a window the GL context comes from EGL, and the frames only go to the exported movie
+    std::unique_ptr<Headless::Context> headless_context;
+    GLFWwindow* window = NULL;
+    if (settings.headless) {
+        try {
+            headless_context = std::make_unique<Headless::Context>(true);
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+            return EXIT_FAILURE;
+        }
 
-    //Create a glfw window
-    constexpr unsigned screen_width = 1280;
-    constexpr unsigned screen_height = 720;
-    GLFWwindow* window = glfwCreateWindow(screen_width, screen_height, "Gravity Simulator", NULL, NULL);
-    if (window == NULL) {
-        fprintf(stderr, "Failed to create GLFW window\n");
-        glfwTerminate();
-        return EXIT_FAILURE;
+        gladLoadGLLoader(Headless::get_proc_address);
     }
+    else {
+        //Initialize and configure glfw
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+        //The render targets follow the window's size, but a movie has the same size throughout
+        glfwWindowHint(GLFW_RESIZABLE, settings.movie_path.empty() ? GLFW_TRUE : GLFW_FALSE);
+
+        //Create a glfw window
+        window = glfwCreateWindow(settings.width, settings.height, "Gravity Simulator", NULL, NULL);
+        if (window == NULL) {
+            fprintf(stderr, "Failed to create GLFW window\n");
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
 
-    glfwMakeContextCurrent(window);
+        glfwMakeContextCurrent(window);
 
-    gladLoadGL();
+        gladLoadGL();
+    }
 
     {
         int flags; glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
@@ -137,6 +220,60 @@ int main() {
         return EXIT_FAILURE;
     }
 
+    //Load in the sphere impostor shaders
+    GLuint impostor_shader_program;
+    try {
+        GLuint vertex_shader = Shaders::create_shader(exe_folder + "../src/shaders/impostor.vert", GL_VERTEX_SHADER);
+
+        GLuint fragment_shader = Shaders::create_shader(exe_folder + "../src/shaders/impostor.frag", GL_FRAGMENT_SHADER);
+
+        std::vector<GLuint> shaders = {vertex_shader, fragment_shader};
+        impostor_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "impostor_shader_program");
+
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
+    //Load in the splat shaders, for the stars summed into the grid hierarchy
+    GLuint splat_shader_program;
+    try {
+        GLuint vertex_shader = Shaders::create_shader(exe_folder + "../src/shaders/splat.vert", GL_VERTEX_SHADER);
+
+        GLuint fragment_shader = Shaders::create_shader(exe_folder + "../src/shaders/splat.frag", GL_FRAGMENT_SHADER);
+
+        std::vector<GLuint> shaders = {vertex_shader, fragment_shader};
+        splat_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "splat_shader_program");
+
+        glDeleteShader(vertex_shader);
+        glDeleteShader(fragment_shader);
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
+    //Load in the star culling compute shader
+    GLuint star_cull_shader_program;
+    try {
+        GLuint compute_shader = Shaders::create_shader(exe_folder + "../src/shaders/star_cull.comp", GL_COMPUTE_SHADER);
+
+        std::vector<GLuint> shaders = {compute_shader};
+        star_cull_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "star_cull_shader_program");
+
+        glDeleteShader(compute_shader);
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
     //Load in the physics compute shader
     GLuint physics_shader_program;
     unsigned physics_shader_local_group_size_x = 64;
@@ -154,17 +291,15 @@ int main() {
         return EXIT_FAILURE;
     }
 
-    //Load in the bloom shader
-    GLuint bloom_shader_program;
+    //Load in the initial condition generator compute shader
+    GLuint galaxy_shader_program;
     try {
-        GLuint vertex_shader = Shaders::create_shader(exe_folder + "../src/shaders/bloom.vert", GL_VERTEX_SHADER);
-        GLuint fragment_shader = Shaders::create_shader(exe_folder + "../src/shaders/bloom.frag", GL_FRAGMENT_SHADER);
+        GLuint compute_shader = Shaders::create_shader(exe_folder + "../src/shaders/galaxy.comp", GL_COMPUTE_SHADER);
 
-        std::vector<GLuint> shaders = {vertex_shader, fragment_shader};
-        bloom_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "bloom_shader_program");
+        std::vector<GLuint> shaders = {compute_shader};
+        galaxy_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "galaxy_shader_program");
 
-        glDeleteShader(vertex_shader);
-        glDeleteShader(fragment_shader);
+        glDeleteShader(compute_shader);
     }
     catch (std::exception &e) {
         std::fprintf(stderr, "%s", e.what());
@@ -172,17 +307,15 @@ int main() {
         return EXIT_FAILURE;
     }
 
-    //Load in the blurring shader
-    GLuint blur_shader_program;
+    //Load in the playback interpolation compute shader
+    GLuint interpolate_shader_program;
     try {
-        GLuint vertex_shader = Shaders::create_shader(exe_folder + "../src/shaders/blur.vert", GL_VERTEX_SHADER);
-        GLuint fragment_shader = Shaders::create_shader(exe_folder + "../src/shaders/blur.frag", GL_FRAGMENT_SHADER);
+        GLuint compute_shader = Shaders::create_shader(exe_folder + "../src/shaders/interpolate.comp", GL_COMPUTE_SHADER);
 
-        std::vector<GLuint> shaders = {vertex_shader, fragment_shader};
-        blur_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "blur_shader_program");
+        std::vector<GLuint> shaders = {compute_shader};
+        interpolate_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "interpolate_shader_program");
 
-        glDeleteShader(vertex_shader);
-        glDeleteShader(fragment_shader);
+        glDeleteShader(compute_shader);
     }
     catch (std::exception &e) {
         std::fprintf(stderr, "%s", e.what());
@@ -190,40 +323,76 @@ int main() {
         return EXIT_FAILURE;
     }
 
-    //Load in the gas shader
-    GLuint gas_shader_program;
+    if (settings.check_gpu_ic) {
+        bool passed = GpuGenerator::check_against_cpu(galaxy_shader_program, settings.n_particles, Scenario::default_scenario(settings.n_particles).placement(0), settings.seed);
+        glfwTerminate();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    //Load in the composite shader, one variant per combination of the bloom (R) and gas (F) toggles, indexed by
+    //use_bloom + 2*render_gas
+    std::array<GLuint, 4> composite_shader_programs;
     try {
-        GLuint vertex_shader = Shaders::create_shader(exe_folder + "../src/shaders/gas.vert", GL_VERTEX_SHADER);
-        GLuint fragment_shader = Shaders::create_shader(exe_folder + "../src/shaders/gas.frag", GL_FRAGMENT_SHADER);
+        GLuint vertex_shader = Shaders::create_shader(exe_folder + "../src/shaders/bloom.vert", GL_VERTEX_SHADER);
 
-        std::vector<GLuint> shaders = {vertex_shader, fragment_shader};
-        gas_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "gas_shader_program");
+        for (unsigned variant = 0; variant < composite_shader_programs.size(); variant++) {
+            std::vector<std::string> defines;
+            if (variant & 1) defines.push_back("BLOOM");
+            if (variant & 2) defines.push_back("GAS");
+            GLuint fragment_shader = Shaders::create_shader(exe_folder + "../src/shaders/composite.frag", GL_FRAGMENT_SHADER, defines);
+
+            std::vector<GLuint> shaders = {vertex_shader, fragment_shader};
+            composite_shader_programs[variant] = Shaders::link_shaders(shaders.data(), shaders.size(), "composite_shader_program");
+
+            glDeleteShader(fragment_shader);
+        }
 
         glDeleteShader(vertex_shader);
-        glDeleteShader(fragment_shader);
     }
     catch (std::exception &e) {
         std::fprintf(stderr, "%s", e.what());
         glfwTerminate();
         return EXIT_FAILURE;
     }
-    
-    std::vector<float> sphere_vertices = Sphere::sphere_vertices(10, 10, 1.f);
 
-    GLuint vao;
-    glGenVertexArrays(1, &vao);
+    //Load in the blurring shader
+    GLuint blur_shader_program;
+    try {
+        GLuint compute_shader = Shaders::create_shader(exe_folder + "../src/shaders/blur.comp", GL_COMPUTE_SHADER);
 
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
+        std::vector<GLuint> shaders = {compute_shader};
+        blur_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "blur_shader_program");
 
-    {
-        glBindVertexArray(vao);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, sphere_vertices.size()*sizeof(float), sphere_vertices.data(), GL_STATIC_DRAW);
+        glDeleteShader(compute_shader);
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
+        glfwTerminate();
+        return EXIT_FAILURE;
     }
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    //Load in the mip chain bloom shaders
+    GLuint bloom_down_shader_program;
+    GLuint bloom_up_shader_program;
+    try {
+        GLuint vertex_shader = Shaders::create_shader(exe_folder + "../src/shaders/bloom.vert", GL_VERTEX_SHADER);
+        GLuint down_shader = Shaders::create_shader(exe_folder + "../src/shaders/bloom_down.frag", GL_FRAGMENT_SHADER);
+        GLuint up_shader = Shaders::create_shader(exe_folder + "../src/shaders/bloom_up.frag", GL_FRAGMENT_SHADER);
+
+        std::vector<GLuint> shaders = {vertex_shader, down_shader};
+        bloom_down_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "bloom_down_shader_program");
+        shaders = {vertex_shader, up_shader};
+        bloom_up_shader_program = Shaders::link_shaders(shaders.data(), shaders.size(), "bloom_up_shader_program");
+
+        glDeleteShader(vertex_shader);
+        glDeleteShader(down_shader);
+        glDeleteShader(up_shader);
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
 
     GLuint screen_vao;
     glGenVertexArrays(1, &screen_vao);
@@ -253,167 +422,208 @@ int main() {
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4*sizeof(float), (void*)(2*sizeof(float)));
 
-    std::size_t n_particles = 40000;
-    float particle_mass = 10.f/(static_cast<float>(n_particles)/2000.f);
-
-    std::array<glm::vec3, 1> galaxy_centers = {
-        glm::vec3(-500.f, 0.f, 0.f),
-        //glm::vec3(500.f, 0.f, 0.f)
-    };
-
-    //w component is ignored
-    std::vector<glm::vec4> particle_positions = Galaxy::generate_galaxy(n_particles/galaxy_centers.size(), galaxy_centers[0]);
-    for (std::size_t i = 0; i < galaxy_centers.size()-1; i++){
-        std::vector<glm::vec4> other_particle_positions = Galaxy::generate_galaxy(n_particles/galaxy_centers.size(), galaxy_centers[1]);
-        for (auto& particle_pos : other_particle_positions) particle_positions.push_back(particle_pos);
-    }
-
-    std::printf("particle_positions size = %zu\n", particle_positions.size());
-
-    //w component is ignored
-    std::vector<glm::vec4> particle_velocities(n_particles, glm::vec4(0.f, 0.f, 0.f, 0.f));
-
-    //y, z and w components are ignored, std430 rounds everything up to vec4 sizes
-    std::vector<glm::vec4> particle_lighting(n_particles);
+    //SSBOs
 
-    //same as with particle_lighting
-    std::vector<glm::vec4> particle_radii(n_particles);
+    std::size_t n_particles;
+    GpuParticles::Buffers particle_buffers;
 
-    std::vector<glm::vec4> particle_base_colors(n_particles);
+    std::uint64_t seed = settings.seed;
+    std::uint64_t ic_hash = 0;
 
-    for (std::size_t i = 0; i < n_particles; i++) {
+    bool restarted = !settings.restart_path.empty();
+    Checkpoint::State restart_state{};
 
-        //Starting velocities
+    if (restarted) {
+        auto restart_start = std::chrono::high_resolution_clock::now();
+        try {
+            Checkpoint::Restart restart = Checkpoint::load(settings.restart_path);
+            particle_buffers = restart.buffers;
+            restart_state = restart.state;
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+        n_particles = particle_buffers.n_particles;
+        seed = restart_state.seed;
+        ic_hash = restart_state.ic_hash;
+        std::printf("restarted from \"%s\" at step %llu, t = %f, in %f s\n", settings.restart_path.c_str(),
+                static_cast<unsigned long long>(restart_state.step), restart_state.sim_time,
+                std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - restart_start).count());
+    }
+    else {
+        n_particles = catalog ? catalog->n_particles() : scenario.n_particles();
+        particle_buffers = GpuParticles::create_buffers(n_particles);
 
-        glm::vec3 galaxy_center = galaxy_centers[i/(n_particles/galaxy_centers.size())];
+        //The initial conditions are loaded from the cache if they've been generated before. Otherwise they're
+        //generated straight into the buffers, either by the compute shader or on the CPU through a mapping,
+        //no host copy is ever made.
+        auto generation_start = std::chrono::high_resolution_clock::now();
 
-        float dist = glm::distance(glm::vec3(particle_positions[i]), galaxy_center);
-        glm::vec3 up(0.f, 1.f, 0.f);
-        glm::vec3 dir = glm::cross(glm::normalize(galaxy_center - glm::vec3(particle_positions[i])), up);
+        {
+            ICCache::Hasher hasher;
+            hasher.add(n_particles);
+            hasher.add(seed);
+            if (catalog) {
+                catalog->add_to_hash(hasher);
+            }
+            else {
+                hasher.add(settings.gpu_ic);
+                for (const Scenario::GalaxyDesc &galaxy : scenario.galaxies) {
+                    hasher.add(galaxy.center);
+                    hasher.add(galaxy.velocity);
+                    hasher.add(galaxy.axis);
+                    hasher.add(galaxy.n_particles);
+                    hasher.add(galaxy.mass);
+                    hasher.add(galaxy.velocity_dispersion);
+                }
+            }
+            ICCache::add_generator_constants(hasher);
+            ic_hash = hasher.value();
+        }
 
-        float mult = 23.f/3.f;
-        if (dist < 100.f) mult = 10.f/3.f;
-        particle_velocities[i] = glm::vec4(dir*mult, 1.f);
+        std::string ic_cache_folder = settings.ic_cache_folder.empty() ? exe_folder + "../ic_cache/" : settings.ic_cache_folder;
+        std::string ic_cache_path = ICCache::cache_path(ic_cache_folder, ic_hash);
 
-        //Base colors
+        //A catalog already is a file of initial conditions, caching it would only make a copy
+        bool use_ic_cache = settings.use_ic_cache && !catalog;
 
-        std::size_t idx = Star::rand_star_type_idx();
-        particle_base_colors[i] = glm::vec4(glm::normalize(glm::vec3(Star::star_colors[idx])), 1.f);
+        bool ic_cache_hit = false;
+        if (use_ic_cache) {
+            try {
+                ic_cache_hit = ICCache::load(ic_cache_path, ic_hash, particle_buffers);
+            }
+            catch (std::exception &e) {
+                std::fprintf(stderr, "%s", e.what());
+            }
+        }
 
-        //Radii
+        if (ic_cache_hit) {
+            std::printf("loaded initial conditions from \"%s\"\n", ic_cache_path.c_str());
+        }
+        else if (catalog) {
+            try {
+                auto import_start = std::chrono::high_resolution_clock::now();
 
-        particle_radii[i] = glm::vec4(Star::star_size_mults[idx], 0.f, 0.f, 0.f);
+                GpuParticles::MappedParticles particles = GpuParticles::map(particle_buffers);
 
-    }
+                catalog->read(particles, seed);
 
-    //SSBOs
+                GpuParticles::unmap(particle_buffers);
 
-    GLuint particle_positions_ssbo;
-    glGenBuffers(1, &particle_positions_ssbo);
-    
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_positions_ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, particle_positions.size()*sizeof(particle_positions[0]), glm::value_ptr(particle_positions[0]), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                float import_seconds = std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - import_start).count();
+                std::printf("imported \"%s\" (%s, %zu bytes) in %f s, %f GB/s\n", settings.catalog_path.c_str(), catalog->binary() ? "binary" : "text",
+                        catalog->size_bytes(), import_seconds, catalog->size_bytes()/1e9/import_seconds);
+            }
+            catch (std::exception &e) {
+                std::fprintf(stderr, "%s", e.what());
+                glfwTerminate();
+                return EXIT_FAILURE;
+            }
+            catalog.reset();
+        }
+        else if (settings.gpu_ic) {
+            std::vector<std::size_t> offsets = scenario.offsets();
+            std::vector<Galaxy::MassProfile> profiles = scenario.mass_profiles(seed);
+            for (std::size_t i = 0; i < scenario.galaxies.size(); i++)
+                GpuGenerator::generate_galaxy(galaxy_shader_program, particle_buffers, offsets[i], scenario.galaxies[i].n_particles, scenario.placement(i), profiles[i], seed);
+            glFinish();
+        }
+        else {
+            try {
+                GpuParticles::MappedParticles particles = GpuParticles::map(particle_buffers);
 
-    GLuint particle_velocities_ssbo;
-    glGenBuffers(1, &particle_velocities_ssbo);
+                Scenario::generate(scenario, particles, seed);
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_velocities_ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, particle_velocities.size()*sizeof(particle_velocities[0]), glm::value_ptr(particle_velocities[0]), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                GpuParticles::unmap(particle_buffers);
+            }
+            catch (std::exception &e) {
+                std::fprintf(stderr, "%s", e.what());
+                glfwTerminate();
+                return EXIT_FAILURE;
+            }
+        }
 
-    GLuint particle_lighting_ssbo;
-    glGenBuffers(1, &particle_lighting_ssbo);
+        if (!ic_cache_hit && use_ic_cache) {
+            try {
+                ICCache::store(ic_cache_path, ic_hash, particle_buffers);
+            }
+            catch (std::exception &e) {
+                std::fprintf(stderr, "%s", e.what());
+            }
+        }
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_lighting_ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, particle_lighting.size()*sizeof(particle_lighting[0]), particle_lighting.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (settings.catalog_path.empty())
+            std::printf("initial conditions for %zu particles in %zu galaxies ready in %f s\n", n_particles,
+                    scenario.galaxies.size(), std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - generation_start).count());
+        else
+            std::printf("initial conditions for %zu particles ready in %f s\n", n_particles,
+                    std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - generation_start).count());
+    }
 
-    GLuint particle_base_colors_ssbo;
-    glGenBuffers(1, &particle_base_colors_ssbo);
+    std::printf("particle buffers = %zu bytes\n", n_particles*ParticleLayout::bytes_per_particle);
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_base_colors_ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, particle_base_colors.size()*sizeof(particle_base_colors[0]), glm::value_ptr(particle_base_colors[0]), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    StarCulling::Culler star_culler(n_particles, settings.min_star_pixels, settings.splat_pixels);
 
-    GLuint particle_radii_ssbo;
-    glGenBuffers(1, &particle_radii_ssbo);
+    //Playback replaces the simulation, the initial conditions above only provide the radii, masses and star types
+    std::unique_ptr<Playback::Player> player;
+    if (!settings.playback_path.empty()) {
+        try {
+            player = std::make_unique<Playback::Player>(settings.playback_path);
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+        if (player->n_particles() != n_particles) {
+            std::fprintf(stderr, "Error: \"%s\" holds %zu particles but the initial conditions have %zu, pass the scenario it was recorded with\n",
+                    settings.playback_path.c_str(), player->n_particles(), n_particles);
+            player->finish();
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+        if (player->ic_hash() != ic_hash)
+            std::fprintf(stderr, "Warning: \"%s\" was recorded from different initial conditions, star sizes and colors may not match\n",
+                    settings.playback_path.c_str());
+        std::printf("playing back %zu frames from t = %f to t = %f\n", player->n_frames(), player->start_time(), player->end_time());
+    }
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_radii_ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, particle_radii.size()*sizeof(particle_radii[0]), particle_radii.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    //Nothing else uses these binding points, so the buffers only have to be bound once
+    GpuParticles::bind(particle_buffers);
 
     Camera::Camera camera(glm::vec3(0.f, 0.f, 100.f));
     camera.MovementSpeed = 100.f;
     camera.MouseSensitivity = 0.05f;
     camera.Zoom = 1.f;
+    if (restarted) Checkpoint::restore_camera(restart_state, camera);
 
-    GLuint hdr_fbo;
-    glGenFramebuffers(1, &hdr_fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, hdr_fbo);
-
-    GLuint hdr_rbo;
-    glGenRenderbuffers(1, &hdr_rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, hdr_rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screen_width, screen_height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, hdr_rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-    std::array<GLuint, 2> color_buffers;
-    glGenTextures(2, color_buffers.data());
-    for (unsigned i = 0; i < 2; i++) {
-        glBindTexture(GL_TEXTURE_2D, color_buffers[i]);
-        glTexImage2D(
-                GL_TEXTURE_2D, 0, GL_RGBA16F, screen_width, screen_height, 0, GL_RGBA, GL_FLOAT, NULL
-                );
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        //Attach the texture to the frame buffer
-        glFramebufferTexture2D(
-                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+i, GL_TEXTURE_2D, color_buffers[i], 0
-                );
-    }
+    //The scene is rendered at a fraction of the window's resolution picked to hold the frame budget, if there is one
+    DynamicResolution::Controller resolution(settings.frame_budget_ms, settings.render_scale);
+    GpuTimer::Timer frame_timer;
+    Blur::ComputeBlur gaussian_blur(settings.blur_radius, settings.blur_passes);
 
-    {
-        std::array<GLuint, 2> attachments = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
-        glDrawBuffers(2, attachments.data());
-    }
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) std::fprintf(stderr, "Error: hdr_fbo not ready!\n");
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    std::array<GLuint, 2> ping_pong_fbo;
-    std::array<GLuint, 2> ping_pong_color_buffers;
-    glGenFramebuffers(2, ping_pong_fbo.data());
-    glGenTextures(2, ping_pong_color_buffers.data());
-    for (unsigned i = 0; i < 2; i++) {
-        glBindFramebuffer(GL_FRAMEBUFFER, ping_pong_fbo[i]);
-        glBindTexture(GL_TEXTURE_2D, ping_pong_color_buffers[i]);
-        glTexImage2D(
-                GL_TEXTURE_2D, 0, GL_RGBA16F, screen_width, screen_height, 0, GL_RGBA, GL_FLOAT, NULL
-                );
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glFramebufferTexture2D(
-                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ping_pong_color_buffers[i], 0
-                );
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) std::fprintf(stderr, "Error: hdr_fbo not ready!\n");
-    }
+    //The frame is declared as passes of a graph every frame, the state they set goes through gl_state
+    GlState::Cache gl_state;
+    RenderGraph::Graph render_graph;
 
     //Setup the shader uniforms
-    glUseProgram(blur_shader_program);
-    glUniform1i(glGetUniformLocation(blur_shader_program, "image"), 0);
-    glUseProgram(bloom_shader_program);
-    glUniform1i(glGetUniformLocation(bloom_shader_program, "scene"), 0);
-    glUniform1i(glGetUniformLocation(bloom_shader_program, "bloom_blur"), 1);
-    glUseProgram(gas_shader_program);
-    glUniform1i(glGetUniformLocation(gas_shader_program, "bloom_blur"), 0);
+    for (GLuint program : composite_shader_programs) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "scene"), 0);
+        glUniform1i(glGetUniformLocation(program, "bloom_blur"), 1);
+    }
+    {
+        std::array<glm::vec3, Star::n_star_colors> star_colors;
+        for (std::size_t i = 0; i < Star::n_star_colors; i++) star_colors[i] = glm::normalize(glm::vec3(Star::star_colors[i]));
+        for (GLuint program : {shader_program, impostor_shader_program, star_cull_shader_program}) {
+            glUseProgram(program);
+            glUniform3fv(glGetUniformLocation(program, "star_colors"), Star::n_star_colors, glm::value_ptr(star_colors[0]));
+        }
+    }
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    if (window != NULL) glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     bool use_bloom = true;
     bool r_still_down = false;
@@ -421,189 +631,550 @@ int main() {
     bool render_gas = true;
     bool f_still_down = false;
 
-    bool paused = false;
+    bool paused = restarted && restart_state.paused;
     bool space_still_down = false;
 
+    bool c_still_down = false;
+
+    bool use_impostors = !settings.sphere_meshes;
+    bool m_still_down = false;
+
+    //B switches between the mip chain and the full resolution gaussian bloom, each timed on the GPU
+    bool use_mip_bloom = !settings.gaussian_bloom;
+    bool b_still_down = false;
+    GpuTimer::Timer mip_bloom_timer;
+    GpuTimer::Timer gaussian_bloom_timer;
+    //[ and ] narrow and widen the gaussian blur
+    bool left_bracket_still_down = false;
+    bool right_bracket_still_down = false;
+
+    //Simulation clock, carried over by checkpoints
+    double sim_time = restarted ? restart_state.sim_time : 0.0;
+    std::uint64_t step = restarted ? restart_state.step : 0;
+    float last_delta_time = restarted ? restart_state.delta_time : 0.f;
+
+    std::string checkpoint_path = settings.checkpoint_path.empty() ? exe_folder + "../checkpoint.bin" : settings.checkpoint_path;
+    Checkpoint::Writer checkpoint_writer;
+
+    std::unique_ptr<Snapshot::Pipeline> snapshots;
+    std::shared_ptr<Trajectory::Writer> trajectory;
+    if (settings.snapshot_interval != 0 && !player) {
+        std::string snapshot_folder = settings.snapshot_folder.empty() ? exe_folder + "../snapshots/" : settings.snapshot_folder;
+        try {
+            Snapshot::Sink sink;
+            if (settings.raw_snapshots) sink = Snapshot::raw_sink(snapshot_folder);
+            else {
+                trajectory = std::make_shared<Trajectory::Writer>(snapshot_folder + "trajectory.gtrj", n_particles, ic_hash, settings.trajectory_bits);
+                sink = Trajectory::sink(trajectory);
+            }
+            snapshots = std::make_unique<Snapshot::Pipeline>(n_particles, sink);
+            if (!snapshots->persistent()) std::fprintf(stderr, "Warning: No GL 4.4, snapshot buffers are mapped per frame instead of persistently\n");
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+            snapshots.reset();
+            trajectory.reset();
+        }
+    }
+
+    //Headless frames are composited into this instead of a window's back buffer
+    RenderGraph::Target offscreen_screen;
+    if (settings.headless) {
+        glGenTextures(1, &offscreen_screen.texture);
+        glBindTexture(GL_TEXTURE_2D, offscreen_screen.texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, settings.width, settings.height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &offscreen_screen.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreen_screen.framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, offscreen_screen.texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) std::fprintf(stderr, "Error: offscreen_screen not ready!\n");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    //Every frame is read back and encoded while the next ones render, the simulation steps one movie frame at a time
+    std::unique_ptr<FrameExport::Exporter> movie;
+    if (!settings.movie_path.empty()) {
+        try {
+            int movie_width = settings.width, movie_height = settings.height;
+            if (window != NULL) glfwGetFramebufferSize(window, &movie_width, &movie_height);
+            movie = std::make_unique<FrameExport::Exporter>(settings.movie_path, movie_width, movie_height, settings.movie_fps);
+            std::printf("exporting %dx%d frames to %s\n", movie_width, movie_height, settings.movie_path.c_str());
+            if (!movie->persistent()) std::fprintf(stderr, "Warning: No GL 4.4, frame readback buffers are mapped per frame instead of persistently\n");
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+    }
+
+    //The CPU backend steps a host copy of the particles and uploads it for rendering every frame
+    Particles::HostParticleStore host_particles;
+    Checkpoint::ForkWriter fork_checkpoint_writer;
+    if (settings.cpu_backend) {
+        try {
+            GpuParticles::download(particle_buffers, host_particles);
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+            glfwTerminate();
+            return EXIT_FAILURE;
+        }
+    }
+
+    double total_frame_seconds = 0.0;
+
     auto start_time = std::chrono::high_resolution_clock::now();
     auto end_time = start_time;
 
     glm::vec2 start_cursor_pos = get_cursor_pos(window);
     glm::vec2 end_cursor_pos = start_cursor_pos;
 
-    while (!glfwWindowShouldClose(window) && glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS) {
+    std::uint64_t frame = 0;
+    while (settings.max_frames == 0 || frame < settings.max_frames) {
+
+        if (window != NULL && (glfwWindowShouldClose(window) || get_key(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)) break;
 
         float delta_time = std::chrono::duration<float>(end_time - start_time).count();
         float fps = (delta_time == 0.f) ? 0.f : 1.f/delta_time;
+        //A movie plays back at its frame rate however long the frames took to render
+        if (movie) delta_time = 1.f/settings.movie_fps;
 
         glm::vec2 cursor_delta = end_cursor_pos - start_cursor_pos;
 
-        std::printf("fps = %f\n", fps);
+        const StarCulling::Counts &star_counts = star_culler.counts();
+        std::printf("fps = %f, %zu stars visible, %zu in %zu splats, %zu culled, %zu render passes (%zu culled) submitted in %f ms\n", fps,
+                star_counts.visible, star_counts.splatted, star_counts.splats, star_counts.culled,
+                render_graph.passes_run(), render_graph.passes_culled(), render_graph.submit_ms());
 
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+        if (get_key(window, GLFW_KEY_W) == GLFW_PRESS)
             camera.ProcessKeyboard(Camera::Camera_Movement::FORWARD, delta_time);
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+        if (get_key(window, GLFW_KEY_S) == GLFW_PRESS)
             camera.ProcessKeyboard(Camera::Camera_Movement::BACKWARD, delta_time);
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+        if (get_key(window, GLFW_KEY_A) == GLFW_PRESS)
             camera.ProcessKeyboard(Camera::Camera_Movement::LEFT, delta_time);
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+        if (get_key(window, GLFW_KEY_D) == GLFW_PRESS)
             camera.ProcessKeyboard(Camera::Camera_Movement::RIGHT, delta_time);
-        if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+        if (get_key(window, GLFW_KEY_Q) == GLFW_PRESS)
             camera.Position.y -= camera.MovementSpeed*delta_time;
-        if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+        if (get_key(window, GLFW_KEY_E) == GLFW_PRESS)
             camera.Position.y += camera.MovementSpeed*delta_time;
 
-        if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS && !r_still_down) {
+        if (get_key(window, GLFW_KEY_R) == GLFW_PRESS && !r_still_down) {
             use_bloom = !use_bloom;
             r_still_down = true;
         }
-        else if (glfwGetKey(window, GLFW_KEY_R) == GLFW_RELEASE) r_still_down = false;
+        else if (get_key(window, GLFW_KEY_R) == GLFW_RELEASE) r_still_down = false;
 
-        if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS && !f_still_down) {
+        if (get_key(window, GLFW_KEY_F) == GLFW_PRESS && !f_still_down) {
             render_gas = !render_gas;
             f_still_down = true;
         }
-        else if (glfwGetKey(window, GLFW_KEY_F) == GLFW_RELEASE) f_still_down = false;
+        else if (get_key(window, GLFW_KEY_F) == GLFW_RELEASE) f_still_down = false;
 
-        if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && !space_still_down) {
+        if (get_key(window, GLFW_KEY_SPACE) == GLFW_PRESS && !space_still_down) {
             paused = !paused;
             space_still_down = true;
         }
-        else if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_RELEASE) space_still_down = false;
-
-        camera.ProcessMouseMovement(cursor_delta.x, -cursor_delta.y);
-
-        glm::mat4 cam_projection_mat = glm::perspective(glm::radians(60.f), static_cast<float>(screen_width)/static_cast<float>(screen_height), 0.01f, 10000.f);
-        glm::mat4 cam_mat = cam_projection_mat * camera.GetViewMatrix();
+        else if (get_key(window, GLFW_KEY_SPACE) == GLFW_RELEASE) space_still_down = false;
 
-        glBindFramebuffer(GL_FRAMEBUFFER, hdr_fbo);
-        glClearColor(0.f, 0.f, 0.f, 0.f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        bool write_checkpoint = false;
+        if (get_key(window, GLFW_KEY_C) == GLFW_PRESS && !c_still_down) {
+            //Playback has no simulation state to save
+            write_checkpoint = !player;
+            c_still_down = true;
+        }
+        else if (get_key(window, GLFW_KEY_C) == GLFW_RELEASE) c_still_down = false;
 
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
+        if (get_key(window, GLFW_KEY_M) == GLFW_PRESS && !m_still_down) {
+            use_impostors = !use_impostors;
+            m_still_down = true;
+            if (use_impostors) std::printf("stars drawn as impostors, 4 vertices each\n");
+            else std::printf("stars drawn as meshes, %zu to %zu vertices each by size on screen\n", star_culler.vertices(0), star_culler.vertices(StarCulling::n_lods-1));
+        }
+        else if (get_key(window, GLFW_KEY_M) == GLFW_RELEASE) m_still_down = false;
 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
+        if (get_key(window, GLFW_KEY_B) == GLFW_PRESS && !b_still_down) {
+            use_mip_bloom = !use_mip_bloom;
+            b_still_down = true;
+            std::printf("bloom: %s, the mip chain took %f ms and the gaussian blur %f ms last time\n",
+                    use_mip_bloom ? "mip chain" : "gaussian blur", mip_bloom_timer.last_ms(), gaussian_bloom_timer.last_ms());
+        }
+        else if (get_key(window, GLFW_KEY_B) == GLFW_RELEASE) b_still_down = false;
 
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particle_positions_ssbo);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particle_lighting_ssbo);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, particle_velocities_ssbo);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_base_colors_ssbo);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, particle_radii_ssbo);
+        if (get_key(window, GLFW_KEY_LEFT_BRACKET) == GLFW_PRESS && !left_bracket_still_down) {
+            gaussian_blur.set_radius(gaussian_blur.radius() - 1);
+            left_bracket_still_down = true;
+            std::printf("gaussian blur radius: %d\n", gaussian_blur.radius());
+        }
+        else if (get_key(window, GLFW_KEY_LEFT_BRACKET) == GLFW_RELEASE) left_bracket_still_down = false;
 
-        //physics
+        if (get_key(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS && !right_bracket_still_down) {
+            gaussian_blur.set_radius(gaussian_blur.radius() + 1);
+            right_bracket_still_down = true;
+            std::printf("gaussian blur radius: %d\n", gaussian_blur.radius());
+        }
+        else if (get_key(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_RELEASE) right_bracket_still_down = false;
 
-        glUseProgram(physics_shader_program);
+        camera.ProcessMouseMovement(cursor_delta.x, -cursor_delta.y);
 
-        {
-            glUniform1f(glGetUniformLocation(physics_shader_program, "G"), 1.f);
-            glUniform1f(glGetUniformLocation(physics_shader_program, "particle_mass"), particle_mass);
-            glUniform1f(glGetUniformLocation(physics_shader_program, "particle_light_strength"), 0.5f);
-            glUniform1f(glGetUniformLocation(physics_shader_program, "delta_time"), delta_time);
-            glUniform1i(glGetUniformLocation(physics_shader_program, "n_particles"), n_particles);
-            glUniform3fv(glGetUniformLocation(physics_shader_program, "cam_pos"), 1, glm::value_ptr(camera.Position));
-            glUniform1i(glGetUniformLocation(physics_shader_program, "paused"), paused);
+        //The render targets are sized for this frame, the pool reallocates them when the window was resized or the
+        //render scale changed. Nothing is presented while the window is minimized, so every pass is culled.
+        int screen_width = settings.width, screen_height = settings.height;
+        if (window != NULL) glfwGetFramebufferSize(window, &screen_width, &screen_height);
+        bool minimized = screen_width < DynamicResolution::min_window_size || screen_height < DynamicResolution::min_window_size;
+        if (minimized) {
+            screen_width = DynamicResolution::min_window_size;
+            screen_height = DynamicResolution::min_window_size;
+        }
+        unsigned render_width = DynamicResolution::scaled_size(screen_width, resolution.render_scale());
+        unsigned render_height = DynamicResolution::scaled_size(screen_height, resolution.render_scale());
+        //A minimized window can't be captured, so the simulation waits for it rather than leaving a gap in the movie
+        bool held = paused || (movie && minimized);
+        Bloom::MipChain bloom_chain(render_width, render_height, resolution.bloom_divisor());
 
-            glDispatchCompute(static_cast<GLuint>(std::ceil(static_cast<float>(n_particles)/physics_shader_local_group_size_x)), 1, 1);
+        glm::mat4 cam_projection_mat = glm::perspective(glm::radians(fov_y), static_cast<float>(screen_width)/static_cast<float>(screen_height), 0.01f, 10000.f);
+        glm::mat4 cam_mat = cam_projection_mat * camera.GetViewMatrix();
 
-            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        //Playback, the recorded positions replace the integration. Holding left or right scrubs.
+        if (player) {
+            double playback_delta = held ? 0.0 : delta_time;
+            if (get_key(window, GLFW_KEY_LEFT) == GLFW_PRESS) playback_delta = -Playback::scrub_speed*delta_time;
+            if (get_key(window, GLFW_KEY_RIGHT) == GLFW_PRESS) playback_delta = Playback::scrub_speed*delta_time;
+            player->advance(playback_delta);
+            try {
+                player->update(gl_state, interpolate_shader_program, particle_buffers);
+            }
+            catch (std::exception &e) {
+                std::fprintf(stderr, "%s", e.what());
+                break;
+            }
+        }
 
-            glUseProgram(0);
+        if (settings.cpu_backend && !held) {
+            CpuSolver::step(host_particles, delta_time);
+            try {
+                GpuParticles::upload_motion(particle_buffers, host_particles);
+            }
+            catch (std::exception &e) {
+                std::fprintf(stderr, "%s", e.what());
+                break;
+            }
         }
 
-        //Rendering everything
+        //physics, only the lighting while playing back or stepping on the CPU
 
-        glUseProgram(shader_program);
+        gl_state.use_program(physics_shader_program);
 
         {
-            glUniformMatrix4fv(glGetUniformLocation(shader_program, "vp_mat"), 1, GL_FALSE, glm::value_ptr(cam_mat)); //View and projection matrix
-            glUniform3fv(glGetUniformLocation(shader_program, "cam_pos"), 1, glm::value_ptr(camera.Position));
-            
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, 0);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, 0);
+            glUniform1f(gl_state.uniform_location(physics_shader_program, "G"), Physics::G);
+            glUniform1f(gl_state.uniform_location(physics_shader_program, "particle_light_strength"), 0.5f);
+            glUniform1f(gl_state.uniform_location(physics_shader_program, "delta_time"), delta_time);
+            glUniform1i(gl_state.uniform_location(physics_shader_program, "n_particles"), n_particles);
+            glUniform3fv(gl_state.uniform_location(physics_shader_program, "cam_pos"), 1, glm::value_ptr(camera.Position));
+            glUniform1i(gl_state.uniform_location(physics_shader_program, "paused"), held || player || settings.cpu_backend);
 
-            glBindVertexArray(vao);
-            glDrawArraysInstanced(GL_TRIANGLES, 0, sphere_vertices.size(), n_particles);
+            glDispatchCompute(static_cast<GLuint>(std::ceil(static_cast<float>(n_particles)/physics_shader_local_group_size_x)), 1, 1);
 
-            glUseProgram(0);
-        }
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-        //Blur bright fragments via a gaussian blur
-        bool blur_horizontal = true;
-        {
-            bool first_iter = true;
-            unsigned amount = 10;
-            
-            glUseProgram(blur_shader_program);
-
-            glBindVertexArray(screen_vao);
-            for (unsigned i = 0; i < amount; i++) {
-                glBindFramebuffer(GL_FRAMEBUFFER, ping_pong_fbo[blur_horizontal]);
-                glUniform1i(glGetUniformLocation(blur_shader_program, "horizontal"), blur_horizontal);
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, first_iter ? color_buffers[1] : ping_pong_color_buffers[!blur_horizontal]);
-                glDrawArrays(GL_TRIANGLES, 0, 6);
-                blur_horizontal = !blur_horizontal;
-                first_iter = false;
+            if (!held && !player) {
+                sim_time += delta_time;
+                step++;
+                last_delta_time = delta_time;
+                if (settings.checkpoint_interval != 0 && step % settings.checkpoint_interval == 0) write_checkpoint = true;
+                if (snapshots && step % settings.snapshot_interval == 0) snapshots->capture(particle_buffers.positions, step, sim_time);
             }
-
-            glUseProgram(0);
         }
 
-        //Render the screen textures
-        
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClearColor(0.f, 0.f, 0.f, 1.f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-        glEnable(GL_BLEND);
-
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
-
-        glUseProgram(bloom_shader_program);
-        {
-            glBindVertexArray(screen_vao);
+        if (snapshots) {
+            try {
+                snapshots->poll();
+            }
+            catch (std::exception &e) {
+                std::fprintf(stderr, "%s", e.what());
+            }
+        }
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, color_buffers[0]);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, ping_pong_color_buffers[!blur_horizontal]);
+        //Checkpoints are copied on the GPU and written by a background thread, so the frame doesn't wait for them
+        try {
+            if (write_checkpoint) {
+                Checkpoint::State state{};
+                state.sim_time = sim_time;
+                state.step = step;
+                state.delta_time = last_delta_time;
+                state.paused = paused;
+                state.seed = seed;
+                state.ic_hash = ic_hash;
+                Checkpoint::save_camera(state, camera);
+                //The CPU backend's state is also in the buffers, forking only saves copying it
+                bool started = settings.fork_checkpoints ?
+                    fork_checkpoint_writer.begin(checkpoint_path, host_particles, state) :
+                    checkpoint_writer.begin(checkpoint_path, particle_buffers, state);
+                if (!started)
+                    std::fprintf(stderr, "Warning: Skipping checkpoint at step %llu, the previous one is still being written\n", static_cast<unsigned long long>(step));
+            }
+            checkpoint_writer.poll();
+            fork_checkpoint_writer.poll();
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+        }
 
-            glUniform1i(glGetUniformLocation(bloom_shader_program, "bloom"), use_bloom);
-            glUniform1f(glGetUniformLocation(bloom_shader_program, "exposure"), 0.1f);
+        //Rendering everything, declared as the passes of this frame's graph. The passes nothing on screen depends on
+        //are skipped, so with both the bloom (R) and the gas (F) off no bloom is computed.
+
+        RenderGraph::Resource scene = render_graph.create_target("scene", {render_width, render_height, GL_RGBA16F, true});
+        RenderGraph::Resource screen = render_graph.import_target("screen", offscreen_screen);
+        RenderGraph::Resource star_lists = render_graph.create_virtual("star lists");
+
+        float projection_scale = render_height/(2.f*std::tan(glm::radians(fov_y)/2.f));
+        render_graph.add_pass("star culling", {}, {star_lists}, [&]() {
+            star_culler.cull(gl_state, star_cull_shader_program, use_impostors, cam_mat, camera.Position, projection_scale);
+        });
+
+        //Stars are either camera facing quads the fragment shader ray casts a sphere into, or sphere meshes with a level
+        //of detail picked per star. Both write the same colors and depths to the HDR target, and both only draw the
+        //stars the culling pass found visible.
+        render_graph.add_pass("stars", {star_lists}, {scene}, [&]() {
+            gl_state.bind_framebuffer(render_graph.target(scene).framebuffer);
+            gl_state.viewport(0, 0, render_width, render_height);
+            gl_state.clear_color(0.f, 0.f, 0.f, 0.f);
+            gl_state.depth_mask(true);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+            gl_state.set_enabled(GL_DEPTH_TEST, true);
+            gl_state.set_enabled(GL_BLEND, false);
+            gl_state.set_enabled(GL_CULL_FACE, true);
+            gl_state.cull_face(GL_BACK);
+
+            GLuint star_program = use_impostors ? impostor_shader_program : shader_program;
+            gl_state.use_program(star_program);
+            glUniformMatrix4fv(gl_state.uniform_location(star_program, "vp_mat"), 1, GL_FALSE, glm::value_ptr(cam_mat)); //View and projection matrix
+            glUniform3fv(gl_state.uniform_location(star_program, "cam_pos"), 1, glm::value_ptr(camera.Position));
+
+            //The scene can't be sampled while it's drawn to
+            gl_state.bind_texture(0, 0);
+            gl_state.bind_texture(1, 0);
+
+            if (use_impostors) star_culler.draw_impostors(gl_state);
+            else star_culler.draw_meshes(gl_state);
+        });
+
+        //The splats add their light on top of the stars in front of which they are. The alpha channels keep the
+        //distance like a star would leave it.
+        if (star_culler.splatting()) {
+            render_graph.add_pass("splats", {star_lists, scene}, {scene}, [&]() {
+                gl_state.use_program(splat_shader_program);
+                glUniformMatrix4fv(gl_state.uniform_location(splat_shader_program, "vp_mat"), 1, GL_FALSE, glm::value_ptr(cam_mat));
+                glUniform3fv(gl_state.uniform_location(splat_shader_program, "cam_pos"), 1, glm::value_ptr(camera.Position));
+                glUniform1f(gl_state.uniform_location(splat_shader_program, "projection_scale"), projection_scale);
+
+                gl_state.set_enabled(GL_BLEND, true);
+                gl_state.blend_func(GL_ONE, GL_ONE, GL_ONE, GL_ZERO);
+                gl_state.depth_mask(false);
+
+                star_culler.draw_splats(gl_state);
+            });
+        }
 
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-            
-            glUseProgram(0);
+        //Blur bright fragments, through the mip chain or via a full resolution gaussian blur. Their targets come from
+        //the graph's pool, so those of the bloom not in use are freed after a while.
+        RenderGraph::Resource bloom;
+        float bloom_scale;
+        if (use_mip_bloom) {
+            std::vector<RenderGraph::Resource> levels;
+            for (std::size_t level = 0; level < bloom_chain.levels(); level++)
+                levels.push_back(render_graph.create_target("bloom level", bloom_chain.level_desc(level)));
+            bloom = levels[0];
+            bloom_scale = bloom_chain.scale();
+
+            render_graph.add_pass("mip chain bloom", {scene}, levels, [&, levels]() {
+                std::vector<RenderGraph::Target> level_targets;
+                for (RenderGraph::Resource level : levels) level_targets.push_back(render_graph.target(level));
+
+                mip_bloom_timer.begin();
+                bloom_chain.render(gl_state, bloom_down_shader_program, bloom_up_shader_program, render_graph.texture(scene), screen_vao, level_targets);
+                mip_bloom_timer.end();
+            });
+        }
+        else {
+            RenderGraph::TextureDesc image_desc{render_width, render_height, Blur::image_format};
+            RenderGraph::Resource horizontal = render_graph.create_target("gaussian bloom horizontal", image_desc);
+            bloom = render_graph.create_target("gaussian bloom", image_desc);
+            bloom_scale = 1.f;
+
+            render_graph.add_pass("gaussian bloom", {scene}, {horizontal, bloom}, [&, horizontal, bloom]() {
+                gaussian_bloom_timer.begin();
+                gaussian_blur.render(gl_state, blur_shader_program, render_graph.texture(scene),
+                        {render_graph.texture(horizontal), render_graph.texture(bloom)}, render_width, render_height);
+                gaussian_bloom_timer.end();
+            });
         }
 
-        glUseProgram(gas_shader_program);
-        if (render_gas) {
-            glDisable(GL_DEPTH_TEST);
+        //Tone mapping, bloom and gas haze in a single pass over the screen, by the composite variant built for the
+        //effects that are on. Every pixel is written, so the screen needs no clearing. Sampling the scene bilinearly
+        //magnifies it to the window when it's rendered at a lower resolution.
 
-            glBindVertexArray(screen_vao);
+        std::vector<RenderGraph::Resource> composite_reads = {scene};
+        if (use_bloom || render_gas) composite_reads.push_back(bloom);
+        render_graph.add_pass("composite", composite_reads, {screen}, [&]() {
+            gl_state.bind_framebuffer(render_graph.target(screen).framebuffer);
+            gl_state.viewport(0, 0, screen_width, screen_height);
+            gl_state.set_enabled(GL_DEPTH_TEST, false);
+            gl_state.set_enabled(GL_BLEND, false);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, ping_pong_color_buffers[!blur_horizontal]);
+            GLuint composite_program = composite_shader_programs[use_bloom + 2*render_gas];
+            gl_state.use_program(composite_program);
+            gl_state.bind_vertex_array(screen_vao);
+            gl_state.bind_texture(0, render_graph.texture(scene));
+            gl_state.bind_texture(1, use_bloom || render_gas ? render_graph.texture(bloom) : 0);
+
+            glUniform1f(gl_state.uniform_location(composite_program, "bloom_scale"), bloom_scale);
+            glUniform1f(gl_state.uniform_location(composite_program, "exposure"), 0.1f);
 
             glDrawArrays(GL_TRIANGLES, 0, 6);
+        });
+
+        //Queues the readback of the finished frame, the movie's encoders pick it up once it's done
+        RenderGraph::Resource presented = screen;
+        if (movie) {
+            presented = render_graph.create_virtual("movie frame");
+            render_graph.add_pass("frame export", {screen}, {presented}, [&]() {
+                movie->capture(render_graph.target(screen).framebuffer);
+            });
+        }
 
-            glUseProgram(0);
+        //The GPU time of the rendering steers the render scale, only the fill cost depends on it. Each time arriving
+        //is taken once, minimized frames measure nothing.
+        std::uint64_t frame_samples = frame_timer.samples();
+        if (!minimized) {
+            render_graph.present(presented);
+            frame_timer.begin();
+        }
+        try {
+            render_graph.execute();
+            if (!minimized) frame_timer.end();
+            if (movie) movie->poll();
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+            break;
+        }
+        bool mip_chain_used = use_mip_bloom && (use_bloom || render_gas);
+        if (frame_timer.samples() != frame_samples && resolution.update(frame_timer.last_ms(), mip_chain_used)) {
+            std::printf("render scale %f, first bloom level at 1/%u of it, rendering took %f ms on average\n",
+                    resolution.render_scale(), resolution.bloom_divisor(), resolution.smoothed_ms());
+        }
 
-            glEnable(GL_DEPTH_TEST);
+        if (window != NULL) {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
         }
-        
-        glfwSwapBuffers(window);
-        glfwPollEvents();
 
         start_cursor_pos = end_cursor_pos;
         end_cursor_pos = get_cursor_pos(window);
 
         start_time = end_time;
         end_time = std::chrono::high_resolution_clock::now();
+        total_frame_seconds += std::chrono::duration<double>(end_time - start_time).count();
+
+        //Frames the movie didn't get don't count towards --frames
+        if (!movie || !minimized) frame++;
+    }
+
+    if (star_culler.frames_counted() > 0) {
+        std::printf("culling: %f stars visible, %f in splats and %f culled per frame on average\n",
+                static_cast<double>(star_culler.total_visible())/star_culler.frames_counted(),
+                static_cast<double>(star_culler.total_splatted())/star_culler.frames_counted(),
+                static_cast<double>(star_culler.total_culled())/star_culler.frames_counted());
+    }
+
+    if (mip_bloom_timer.samples() > 0 || gaussian_bloom_timer.samples() > 0) {
+        std::printf("bloom: mip chain %f ms over %llu frames, gaussian blur %f ms over %llu frames\n",
+                mip_bloom_timer.mean_ms(), static_cast<unsigned long long>(mip_bloom_timer.samples()),
+                gaussian_bloom_timer.mean_ms(), static_cast<unsigned long long>(gaussian_bloom_timer.samples()));
+    }
+    if (gaussian_bloom_timer.samples() > 0) {
+        for (unsigned pass = 0; pass < gaussian_blur.passes(); pass++) {
+            std::printf("gaussian blur pass %u: horizontal %f ms, vertical %f ms\n",
+                    pass, gaussian_blur.horizontal_timer(pass).mean_ms(), gaussian_blur.vertical_timer(pass).mean_ms());
+        }
+    }
+
+    if (frame_timer.samples() > 0) {
+        std::printf("dynamic resolution: rendering took %f ms per frame, %llu changes, ended at render scale %f with the first bloom level at 1/%u\n",
+                frame_timer.mean_ms(), static_cast<unsigned long long>(resolution.changes()), resolution.render_scale(), resolution.bloom_divisor());
+    }
+
+    if (render_graph.frames() > 0) {
+        std::printf("render graph: %f passes run and %f culled per frame, %f ms per frame submitting, %zu pooled targets holding %f MB\n",
+                render_graph.mean_passes_run(), render_graph.mean_passes_culled(), render_graph.mean_submit_ms(),
+                render_graph.pool().targets(), render_graph.pool().bytes()/1e6);
+        std::printf("gl state: %llu calls made, %llu redundant ones skipped\n",
+                static_cast<unsigned long long>(gl_state.issued()), static_cast<unsigned long long>(gl_state.skipped()));
+    }
+
+    if (snapshots) {
+        try {
+            snapshots->finish();
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+        }
+        const Snapshot::Pipeline::Stats &stats = snapshots->stats();
+        std::printf("snapshots: %llu captured, %llu written, %llu dropped, %f%% of the frame time spent on them\n",
+                static_cast<unsigned long long>(stats.captured), static_cast<unsigned long long>(stats.written),
+                static_cast<unsigned long long>(stats.dropped),
+                total_frame_seconds > 0.0 ? 100.0*stats.render_thread_seconds/total_frame_seconds : 0.0);
+    }
+
+    if (movie) {
+        try {
+            movie->finish();
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+        }
+        const FrameExport::Exporter::Stats &stats = movie->stats();
+        std::printf("movie: %llu frames captured, %llu written, %llu stalls waiting %f s for the encoders, %f%% of the frame time spent on the export, %f ms encoding per frame\n",
+                static_cast<unsigned long long>(stats.captured), static_cast<unsigned long long>(stats.written),
+                static_cast<unsigned long long>(stats.stalls), stats.stall_seconds,
+                total_frame_seconds > 0.0 ? 100.0*stats.render_thread_seconds/total_frame_seconds : 0.0,
+                stats.written > 0 ? stats.encode_seconds*1e3/stats.written : 0.0);
+    }
+
+    if (trajectory) {
+        try {
+            trajectory->close();
+            std::printf("trajectory: %llu bytes of positions stored in %llu bytes, ratio %f\n",
+                    static_cast<unsigned long long>(trajectory->bytes_in()), static_cast<unsigned long long>(trajectory->bytes_out()),
+                    trajectory->bytes_out() > 0 ? static_cast<double>(trajectory->bytes_in())/trajectory->bytes_out() : 0.0);
+            const AsyncFile::Writer &output = trajectory->output();
+            std::printf("trajectory: written with %s%s at %f MB/s, queue depth %f mean, %zu max, %f s waiting for the disk\n",
+                    AsyncFile::backend_name(output.backend()), output.direct() ? " (O_DIRECT)" : "", output.stats().bandwidth()/1e6,
+                    output.stats().mean_queue_depth(), output.stats().max_queue_depth, output.stats().stall_seconds);
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+        }
+    }
+
+    if (player) {
+        player->finish();
+        Playback::Player::Stats stats = player->stats();
+        std::printf("playback: %llu frames decoded, %llu uploaded, %llu stalls\n",
+                static_cast<unsigned long long>(stats.decoded), static_cast<unsigned long long>(stats.uploaded),
+                static_cast<unsigned long long>(stats.stalls));
+    }
+
+    try {
+        checkpoint_writer.finish();
+        fork_checkpoint_writer.finish();
+    }
+    catch (std::exception &e) {
+        std::fprintf(stderr, "%s", e.what());
     }
 
     glfwTerminate();
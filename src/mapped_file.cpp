@@ -0,0 +1,92 @@
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __unix__
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "mapped_file.hpp"
+
+namespace File {
+
+    MappedFile::MappedFile(const std::string &path) : ptr(nullptr), length(0), mapped(false) {
+
+        #ifdef __unix__
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd == -1) {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Failed to open \"" << path << "\": " << std::strerror(errno) << "\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+
+            struct stat file_stat;
+            if (::fstat(fd, &file_stat) == -1) {
+                int err = errno;
+                ::close(fd);
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Failed to stat \"" << path << "\": " << std::strerror(err) << "\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+
+            length = static_cast<std::size_t>(file_stat.st_size);
+            if (length != 0) {
+                void *addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr == MAP_FAILED) {
+                    int err = errno;
+                    ::close(fd);
+                    std::ostringstream err_msg_stream;
+                    err_msg_stream << "Error: Failed to map \"" << path << "\": " << std::strerror(err) << "\n";
+                    throw std::runtime_error(err_msg_stream.str());
+                }
+                ptr = static_cast<const unsigned char*>(addr);
+                mapped = true;
+            }
+
+            ::close(fd);
+        #else
+            std::ifstream file(path, std::ios::binary);
+            if (file.fail()) {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Failed to open \"" << path << "\": " << std::strerror(errno) << "\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+            fallback.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            ptr = fallback.data();
+            length = fallback.size();
+        #endif
+
+    }
+
+    MappedFile::~MappedFile() {
+        #ifdef __unix__
+            if (mapped) ::munmap(const_cast<unsigned char*>(ptr), length);
+        #endif
+    }
+
+    void MappedFile::will_need(std::size_t offset, std::size_t size) const {
+        #ifdef __unix__
+            if (!mapped || offset >= length) return;
+            //madvise wants a page aligned start
+            std::size_t page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            std::size_t aligned_offset = offset/page_size*page_size;
+            if (size > length - offset) size = length - offset;
+            ::madvise(const_cast<unsigned char*>(ptr) + aligned_offset, size + (offset - aligned_offset), MADV_WILLNEED);
+        #else
+            (void)offset; (void)size;
+        #endif
+    }
+
+    void MappedFile::sequential() const {
+        #ifdef __unix__
+            if (mapped) ::madvise(const_cast<unsigned char*>(ptr), length, MADV_SEQUENTIAL);
+        #endif
+    }
+
+}
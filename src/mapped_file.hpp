@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace File {
+
+    //Read only view of a whole file. Uses mmap where available and falls back to reading the file into memory.
+    class MappedFile {
+    public:
+
+        //Throws std::runtime_error if the file can't be opened
+        explicit MappedFile(const std::string &path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const unsigned char* data() const { return ptr; }
+        std::size_t size() const { return length; }
+
+        //Hints that [offset, offset+size) will be read soon / sequentially. No-op without mmap.
+        void will_need(std::size_t offset, std::size_t size) const;
+        void sequential() const;
+
+    private:
+
+        const unsigned char *ptr;
+        std::size_t length;
+
+        bool mapped;
+        std::vector<unsigned char> fallback;
+
+    };
+
+}
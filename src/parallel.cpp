@@ -0,0 +1,101 @@
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+
+namespace Parallel {
+
+    unsigned n_threads() {
+        unsigned n = std::thread::hardware_concurrency();
+        return n == 0 ? 1 : n;
+    }
+
+    void parallel_for(std::size_t n, std::size_t chunk_size, const std::function<void(std::size_t, std::size_t)> &fn) {
+
+        if (chunk_size == 0) chunk_size = 1;
+
+        std::size_t n_chunks = (n + chunk_size - 1)/chunk_size;
+        unsigned n_workers = n_threads();
+        if (n_chunks < n_workers) n_workers = static_cast<unsigned>(n_chunks);
+
+        if (n_workers <= 1) {
+            for (std::size_t begin = 0; begin < n; begin += chunk_size)
+                fn(begin, begin + chunk_size < n ? begin + chunk_size : n);
+            return;
+        }
+
+        std::atomic<std::size_t> next_chunk(0);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+
+        auto worker = [&]() {
+            try {
+                for (std::size_t chunk = next_chunk++; chunk < n_chunks; chunk = next_chunk++) {
+                    std::size_t begin = chunk*chunk_size;
+                    fn(begin, begin + chunk_size < n ? begin + chunk_size : n);
+                }
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                next_chunk = n_chunks;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < n_workers; i++) threads.emplace_back(worker);
+        worker();
+        for (auto &thread : threads) thread.join();
+
+        if (error) std::rethrow_exception(error);
+
+    }
+
+    ThreadPool::ThreadPool(unsigned threads) {
+        if (threads == 0) threads = 1;
+        for (unsigned i = 0; i < threads; i++) workers.emplace_back(&ThreadPool::work, this);
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        task_ready.notify_all();
+        for (auto &worker : workers) worker.join();
+    }
+
+    void ThreadPool::submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        task_ready.notify_one();
+    }
+
+    void ThreadPool::wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return tasks.empty() && running == 0; });
+    }
+
+    void ThreadPool::work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            task_ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+
+            std::function<void()> task = std::move(tasks.front());
+            tasks.pop_front();
+            running++;
+            lock.unlock();
+            task();
+            lock.lock();
+            running--;
+            if (tasks.empty() && running == 0) idle.notify_all();
+        }
+    }
+
+}
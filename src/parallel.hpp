@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Parallel {
+
+    unsigned n_threads();
+
+    //Calls fn(begin, end) on chunks of [0, n) from all hardware threads and returns once every chunk is done.
+    //Chunks are handed out dynamically, so fn must not depend on which thread runs it.
+    void parallel_for(std::size_t n, std::size_t chunk_size, const std::function<void(std::size_t, std::size_t)> &fn);
+
+    //Threads that run tasks in the background while the submitting thread goes on, unlike parallel_for. Tasks start
+    //in submission order. They must not throw, a task's errors have to be handed back some other way.
+    class ThreadPool {
+    public:
+
+        explicit ThreadPool(unsigned threads = n_threads());
+        //Runs the tasks still queued, then joins the threads
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(std::function<void()> task);
+        //Blocks until every task submitted so far has run
+        void wait();
+
+        unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    private:
+
+        void work();
+
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable task_ready;
+        std::condition_variable idle;
+        std::size_t running = 0;
+        bool stopping = false;
+
+    };
+
+    //Sorts every thread's share of values with std::sort, then merges neighbouring runs pairwise until one is
+    //left. O(n log n) work, not stable.
+    template<typename T, typename Compare>
+    void parallel_sort(std::vector<T> &values, Compare less) {
+
+        std::size_t n = values.size();
+        std::size_t run_size = (n + n_threads() - 1)/n_threads();
+        if (run_size < 4096) run_size = 4096;
+
+        if (run_size >= n) {
+            std::sort(values.begin(), values.end(), less);
+            return;
+        }
+
+        parallel_for(n, run_size, [&](std::size_t begin, std::size_t end) {
+            std::sort(values.begin() + begin, values.begin() + end, less);
+        });
+
+        std::vector<T> merged(n);
+        for (; run_size < n; run_size *= 2) {
+            std::size_t n_pairs = (n + 2*run_size - 1)/(2*run_size);
+            parallel_for(n_pairs, 1, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t pair = begin; pair < end; pair++) {
+                    std::size_t first = pair*2*run_size;
+                    std::size_t middle = std::min(first + run_size, n);
+                    std::size_t last = std::min(first + 2*run_size, n);
+                    std::merge(std::make_move_iterator(values.begin() + first), std::make_move_iterator(values.begin() + middle),
+                               std::make_move_iterator(values.begin() + middle), std::make_move_iterator(values.begin() + last),
+                               merged.begin() + first, less);
+                }
+            });
+            values.swap(merged);
+        }
+
+    }
+
+    //In place inclusive prefix sum. Chunks are summed in parallel, the chunk totals are scanned serially and
+    //then added back in parallel.
+    template<typename T>
+    void inclusive_scan(std::vector<T> &values) {
+
+        std::size_t n = values.size();
+        std::size_t chunk_size = (n + n_threads() - 1)/n_threads();
+        if (chunk_size < 16384) chunk_size = 16384;
+        std::size_t n_chunks = (n + chunk_size - 1)/chunk_size;
+
+        std::vector<T> chunk_totals(n_chunks, T(0));
+        parallel_for(n, chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin+1; i < end; i++) values[i] += values[i-1];
+            chunk_totals[begin/chunk_size] = values[end-1];
+        });
+
+        for (std::size_t c = 1; c < n_chunks; c++) chunk_totals[c] += chunk_totals[c-1];
+
+        parallel_for(n, chunk_size, [&](std::size_t begin, std::size_t end) {
+            if (begin == 0) return;
+            T offset = chunk_totals[begin/chunk_size - 1];
+            for (std::size_t i = begin; i < end; i++) values[i] += offset;
+        });
+
+    }
+
+}
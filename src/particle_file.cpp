@@ -0,0 +1,103 @@
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "particle_layout.hpp"
+#include "particle_file.hpp"
+
+namespace {
+
+    void upload_section(GLuint buffer, const unsigned char *data, std::size_t size) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+}
+
+namespace ParticleFile {
+
+    std::uint64_t align_up(std::uint64_t x) {
+        return (x + section_alignment - 1)/section_alignment*section_alignment;
+    }
+
+    Sections sections(std::uint64_t header_size, std::uint64_t n_particles) {
+        Sections s;
+        s.positions_offset = align_up(header_size);
+        s.velocities_offset = align_up(s.positions_offset + n_particles*sizeof(glm::vec4));
+        s.info_offset = align_up(s.velocities_offset + n_particles*sizeof(glm::vec4));
+        s.file_size = s.info_offset + n_particles*sizeof(ParticleLayout::ParticleInfo);
+        return s;
+    }
+
+    bool is_little_endian() {
+        std::uint32_t marker = endian_marker;
+        unsigned char first_byte;
+        std::memcpy(&first_byte, &marker, 1);
+        return first_byte == 0x04;
+    }
+
+    void write_or_throw(std::FILE *file, const void *data, std::size_t size, const std::string &path) {
+        if (size != 0 && std::fwrite(data, 1, size, file) != size) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Failed to write \"" << path << "\": " << std::strerror(errno) << "\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+    }
+
+    void pad_to(std::FILE *file, std::uint64_t offset, const std::string &path) {
+        static const char zeros[section_alignment] = {};
+        long pos = std::ftell(file);
+        if (pos < 0 || static_cast<std::uint64_t>(pos) > offset) throw std::runtime_error("Error: Bad particle file offset\n");
+        for (std::uint64_t left = offset - static_cast<std::uint64_t>(pos); left > 0; ) {
+            std::size_t n = left < section_alignment ? static_cast<std::size_t>(left) : section_alignment;
+            write_or_throw(file, zeros, n, path);
+            left -= n;
+        }
+    }
+
+    void upload(const File::MappedFile &file, const Sections &sections, const GpuParticles::Buffers &buffers) {
+        file.sequential();
+        std::size_t n = buffers.n_particles;
+        upload_section(buffers.positions, file.data() + sections.positions_offset, n*sizeof(glm::vec4));
+        upload_section(buffers.velocities, file.data() + sections.velocities_offset, n*sizeof(glm::vec4));
+        upload_section(buffers.info, file.data() + sections.info_offset, n*sizeof(ParticleLayout::ParticleInfo));
+    }
+
+    std::FILE* open_tmp(const std::string &path) {
+
+        std::filesystem::path folder = std::filesystem::path(path).parent_path();
+        if (!folder.empty()) std::filesystem::create_directories(folder);
+
+        std::string tmp_path = path + ".tmp";
+        std::FILE *file = std::fopen(tmp_path.c_str(), "wb");
+        if (file == NULL) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Failed to create \"" << tmp_path << "\": " << std::strerror(errno) << "\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+        return file;
+
+    }
+
+    void commit_tmp(std::FILE *file, const std::string &path) {
+        std::string tmp_path = path + ".tmp";
+        if (std::fclose(file) != 0 || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            std::remove(tmp_path.c_str());
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Failed to write \"" << path << "\": " << std::strerror(errno) << "\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+    }
+
+    void discard_tmp(std::FILE *file, const std::string &path) {
+        std::fclose(file);
+        std::remove((path + ".tmp").c_str());
+    }
+
+}
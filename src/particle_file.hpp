@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "gpu_particles.hpp"
+#include "mapped_file.hpp"
+
+//Pieces shared by the files that store the particle buffers in their GPU layout (IC cache, checkpoints).
+//Such a file is a format specific header followed by the positions, velocities and info sections, each
+//starting on a 64 byte boundary so they can be uploaded straight from a mapping.
+namespace ParticleFile {
+
+    constexpr std::uint64_t section_alignment = 64;
+    constexpr std::uint32_t endian_marker = 0x01020304;
+
+    struct Sections {
+        std::uint64_t positions_offset;
+        std::uint64_t velocities_offset;
+        std::uint64_t info_offset;
+        std::uint64_t file_size;
+    };
+
+    std::uint64_t align_up(std::uint64_t x);
+
+    //Where the sections of n_particles go after a header of header_size bytes
+    Sections sections(std::uint64_t header_size, std::uint64_t n_particles);
+
+    bool is_little_endian();
+
+    //Throws std::runtime_error naming path on a short write
+    void write_or_throw(std::FILE *file, const void *data, std::size_t size, const std::string &path);
+
+    //Writes zeros up to offset
+    void pad_to(std::FILE *file, std::uint64_t offset, const std::string &path);
+
+    //glBufferSubData from the mapped sections into the buffers
+    void upload(const File::MappedFile &file, const Sections &sections, const GpuParticles::Buffers &buffers);
+
+    //Non template part of write_atomically
+    std::FILE* open_tmp(const std::string &path);
+    void commit_tmp(std::FILE *file, const std::string &path);
+    void discard_tmp(std::FILE *file, const std::string &path);
+
+    //Writes to path + ".tmp" through write(file, tmp_path) and renames it into place, so a crash never leaves a
+    //truncated file behind. Creates missing parent folders. Throws std::runtime_error on failure.
+    template<typename WriteFn>
+    void write_atomically(const std::string &path, WriteFn write) {
+        std::FILE *file = open_tmp(path);
+        try {
+            write(file, path + ".tmp");
+        }
+        catch (...) {
+            discard_tmp(file, path);
+            throw;
+        }
+        commit_tmp(file, path);
+    }
+
+}
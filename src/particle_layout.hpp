@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+//Host side mirror of shaders/particle_layout.glsl, the two have to be kept in sync.
+//Every attribute is packed so that no std430 padding is uploaded:
+//  binding 0: vec4 per particle, xyz = position, w = radius
+//  binding 1: vec4 per particle, xyz = velocity, w = mass
+//  binding 2: ParticleInfo per particle, lighting and star type index packed into 8 bytes
+namespace ParticleLayout {
+
+    constexpr unsigned positions_binding = 0;
+    constexpr unsigned velocities_binding = 1;
+    constexpr unsigned info_binding = 2;
+
+    constexpr unsigned n_bindings = 3;
+
+    struct ParticleInfo {
+        float lighting;
+        std::uint32_t type_idx;
+    };
+
+    static_assert(sizeof(glm::vec4) == 16, "glm::vec4 must match the std430 vec4 layout");
+    static_assert(sizeof(ParticleInfo) == 8, "ParticleInfo must match the std430 ParticleInfo layout");
+
+    constexpr std::size_t bytes_per_particle = 2*sizeof(glm::vec4) + sizeof(ParticleInfo);
+
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+//Host side particle container. The memory layout and the scalar precision are template parameters,
+//so the generator, solvers and uploaders can be written once against the accessors below and the
+//layouts can be benchmarked against each other by only changing HostParticleStore.
+namespace Particles {
+
+    //Scalar attributes held by the store. The star type index is kept separately since it's an integer.
+    enum class Attr : std::size_t {
+        pos_x, pos_y, pos_z,
+        radius,
+        vel_x, vel_y, vel_z,
+        mass,
+        lighting,
+    };
+
+    constexpr std::size_t n_attrs = 9;
+
+    //The storage starts on this many bytes and its capacity is padded to a multiple of them. SoA attribute arrays and
+    //AoSoA lanes of at least this many bytes therefore start aligned, narrower AoSoA lanes and AoS records don't.
+    constexpr std::size_t alignment = 64;
+
+    template<typename T, std::size_t Align>
+    struct AlignedAllocator {
+
+        typedef T value_type;
+
+        template<typename U>
+        struct rebind { typedef AlignedAllocator<U, Align> other; };
+
+        AlignedAllocator() = default;
+        template<typename U>
+        AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+        T* allocate(std::size_t n) {
+            if (n > std::numeric_limits<std::size_t>::max()/sizeof(T)) throw std::bad_alloc();
+            return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(Align)));
+        }
+
+        void deallocate(T* p, std::size_t) {
+            ::operator delete(p, std::align_val_t(Align));
+        }
+
+        template<typename U>
+        bool operator==(const AlignedAllocator<U, Align>&) const { return true; }
+        template<typename U>
+        bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+
+    };
+
+    //Contiguous run of one attribute
+    template<typename T>
+    struct Span {
+
+        T* ptr;
+        std::size_t size;
+
+        T& operator[](std::size_t i) const { return ptr[i]; }
+        T* begin() const { return ptr; }
+        T* end() const { return ptr + size; }
+
+    };
+
+    //Array of structures, every particle is one record of n_attrs scalars
+    struct AoS {
+
+        static constexpr std::size_t block_width = 1;
+
+        static constexpr std::size_t offset(std::size_t i, std::size_t attr, std::size_t) {
+            return i*n_attrs + attr;
+        }
+
+    };
+
+    //Structure of arrays, one aligned array per attribute
+    struct SoA {
+
+        static constexpr std::size_t block_width = 1;
+
+        static constexpr std::size_t offset(std::size_t i, std::size_t attr, std::size_t capacity) {
+            return attr*capacity + i;
+        }
+
+    };
+
+    //Array of structures of arrays, blocks of W particles with one W-wide lane per attribute
+    template<std::size_t W>
+    struct AoSoA {
+
+        static_assert(W > 0 && (W & (W-1)) == 0, "AoSoA block width has to be a power of 2");
+
+        static constexpr std::size_t block_width = W;
+
+        static constexpr std::size_t offset(std::size_t i, std::size_t attr, std::size_t) {
+            return (i/W)*W*n_attrs + attr*W + i%W;
+        }
+
+    };
+
+    template<typename Layout, typename Precision>
+    class ParticleStore {
+
+        static_assert(std::is_floating_point<Precision>::value, "ParticleStore precision has to be a floating point type");
+
+    public:
+
+        typedef Layout layout_type;
+        typedef Precision value_type;
+        typedef glm::vec<3, Precision> vec3_type;
+
+        //Number of particles that fit in one alignment unit, the capacity is always a multiple of this
+        static constexpr std::size_t lane_width =
+            (alignment/sizeof(Precision)) > Layout::block_width ? (alignment/sizeof(Precision)) : Layout::block_width;
+
+        //Length of the spans returned by block()
+        static constexpr std::size_t block_size = std::is_same<Layout, SoA>::value ? lane_width : Layout::block_width;
+
+        ParticleStore() : n_particles(0), capacity(0) {}
+
+        explicit ParticleStore(std::size_t n) { resize(n); }
+
+        //Discards the current contents, everything is zero initialized
+        void resize(std::size_t n) {
+            n_particles = n;
+            capacity = (n + lane_width - 1)/lane_width*lane_width;
+            data.assign(capacity*n_attrs, Precision(0));
+            type_indices.assign(capacity, 0);
+        }
+
+        std::size_t size() const { return n_particles; }
+        std::size_t padded_size() const { return capacity; }
+
+        Precision& get(Attr attr, std::size_t i) {
+            return data[Layout::offset(i, static_cast<std::size_t>(attr), capacity)];
+        }
+        Precision get(Attr attr, std::size_t i) const {
+            return data[Layout::offset(i, static_cast<std::size_t>(attr), capacity)];
+        }
+
+        vec3_type position(std::size_t i) const {
+            return vec3_type(get(Attr::pos_x, i), get(Attr::pos_y, i), get(Attr::pos_z, i));
+        }
+        void set_position(std::size_t i, const vec3_type &p) {
+            get(Attr::pos_x, i) = p.x; get(Attr::pos_y, i) = p.y; get(Attr::pos_z, i) = p.z;
+        }
+
+        vec3_type velocity(std::size_t i) const {
+            return vec3_type(get(Attr::vel_x, i), get(Attr::vel_y, i), get(Attr::vel_z, i));
+        }
+        void set_velocity(std::size_t i, const vec3_type &v) {
+            get(Attr::vel_x, i) = v.x; get(Attr::vel_y, i) = v.y; get(Attr::vel_z, i) = v.z;
+        }
+
+        //Writes everything a generator produces for one particle, lighting is reset
+        void set_particle(std::size_t i, const vec3_type &p, const vec3_type &v, Precision r, Precision m, std::uint32_t type) {
+            set_position(i, p);
+            set_velocity(i, v);
+            get(Attr::radius, i) = r;
+            get(Attr::mass, i) = m;
+            get(Attr::lighting, i) = Precision(0);
+            type_indices[i] = type;
+        }
+
+        Precision& radius(std::size_t i) { return get(Attr::radius, i); }
+        Precision radius(std::size_t i) const { return get(Attr::radius, i); }
+
+        Precision& mass(std::size_t i) { return get(Attr::mass, i); }
+        Precision mass(std::size_t i) const { return get(Attr::mass, i); }
+
+        Precision& lighting(std::size_t i) { return get(Attr::lighting, i); }
+        Precision lighting(std::size_t i) const { return get(Attr::lighting, i); }
+
+        std::uint32_t& type_idx(std::size_t i) { return type_indices[i]; }
+        std::uint32_t type_idx(std::size_t i) const { return type_indices[i]; }
+
+        //Whole attribute as one aligned span covering padded_size() particles, only for SoA
+        Span<Precision> attribute(Attr attr) {
+            static_assert(std::is_same<Layout, SoA>::value, "Only SoA stores attributes contiguously, use block() instead");
+            return {data.data() + Layout::offset(0, static_cast<std::size_t>(attr), capacity), capacity};
+        }
+        Span<const Precision> attribute(Attr attr) const {
+            static_assert(std::is_same<Layout, SoA>::value, "Only SoA stores attributes contiguously, use block() instead");
+            return {data.data() + Layout::offset(0, static_cast<std::size_t>(attr), capacity), capacity};
+        }
+
+        //Contiguous span of one attribute for particles [block_idx*block_size, (block_idx+1)*block_size), not for AoS
+        Span<Precision> block(Attr attr, std::size_t block_idx) {
+            static_assert(!std::is_same<Layout, AoS>::value, "AoS has no contiguous attribute blocks");
+            return {&get(attr, block_idx*block_size), block_size};
+        }
+        Span<const Precision> block(Attr attr, std::size_t block_idx) const {
+            static_assert(!std::is_same<Layout, AoS>::value, "AoS has no contiguous attribute blocks");
+            return {&data[Layout::offset(block_idx*block_size, static_cast<std::size_t>(attr), capacity)], block_size};
+        }
+
+        Span<std::uint32_t> type_indices_span() { return {type_indices.data(), capacity}; }
+        Span<const std::uint32_t> type_indices_span() const { return {type_indices.data(), capacity}; }
+
+    private:
+
+        std::size_t n_particles;
+        std::size_t capacity;
+
+        std::vector<Precision, AlignedAllocator<Precision, alignment>> data;
+        std::vector<std::uint32_t, AlignedAllocator<std::uint32_t, alignment>> type_indices;
+
+    };
+
+}
+
+//The layout and precision used by the host side of the simulation, selected at configure time
+#ifndef PARTICLE_STORE_LAYOUT
+#define PARTICLE_STORE_LAYOUT SoA
+#endif
+#ifndef PARTICLE_STORE_PRECISION
+#define PARTICLE_STORE_PRECISION float
+#endif
+
+namespace Particles {
+
+    typedef ParticleStore<PARTICLE_STORE_LAYOUT, PARTICLE_STORE_PRECISION> HostParticleStore;
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+//Constants of the gravity solver in shaders/physics.comp that the host also needs, e.g. to put generated
+//galaxies into equilibrium
+namespace Physics {
+
+    //Passed as the G uniform
+    constexpr float G = 1.f;
+
+    //Must match epsilon in physics.comp
+    constexpr float softening = 0.1f;
+
+}
@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "playback.hpp"
+
+namespace {
+
+    //Must match the local size in interpolate.comp
+    constexpr std::size_t local_size_x = 64;
+
+    static_assert(sizeof(glm::vec3) == 3*sizeof(float), "The frame buffers are uploaded as tightly packed floats");
+
+}
+
+namespace Playback {
+
+    Player::Player(const std::string &path) : reader(path), playback_time(0.0) {
+
+        if (reader.n_frames() == 0) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Trajectory \"" << path << "\" has no frames\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+        playback_time = start_time();
+
+        std::size_t size = std::max<std::size_t>(n_particles(), 1)*sizeof(glm::vec3);
+        glGenBuffers(2, frame_buffers.data());
+        for (GLuint buffer : frame_buffers) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        decoder = std::thread(&Player::decode_loop, this);
+
+    }
+
+    Player::~Player() {
+        //Only stops the thread, the buffers go away with the GL context
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake_decoder.notify_all();
+        if (decoder.joinable()) decoder.join();
+    }
+
+    void Player::finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake_decoder.notify_all();
+        if (decoder.joinable()) decoder.join();
+
+        glDeleteBuffers(2, frame_buffers.data());
+        frame_buffers = {};
+        resident = {{no_frame, no_frame}};
+    }
+
+    Player::Stats Player::stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return statistics;
+    }
+
+    void Player::decode_loop() {
+
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+
+            std::size_t frame_idx = no_frame;
+            wake_decoder.wait(lock, [&] {
+                if (stop) return true;
+                for (std::size_t idx : wanted) {
+                    if (cache.count(idx) == 0) {
+                        frame_idx = idx;
+                        return true;
+                    }
+                }
+                return false;
+            });
+            if (stop) return;
+
+            std::vector<std::size_t> upcoming = readahead;
+            lock.unlock();
+
+            DecodedFrame frame;
+            std::exception_ptr error;
+            try {
+                //The reads for the frames after this one overlap with decoding it
+                for (std::size_t idx : upcoming) reader.prefetch(idx);
+
+                std::shared_ptr<std::vector<glm::vec3>> positions = std::make_shared<std::vector<glm::vec3>>(reader.n_particles());
+                reader.read_frame(frame_idx, positions->data());
+                frame = positions;
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            if (error) {
+                decode_error = error;
+                frame_ready.notify_all();
+                return;
+            }
+
+            cache[frame_idx] = frame;
+            statistics.decoded++;
+            //Only keep what's still wanted, the update thread holds its own references to frames it's uploading
+            for (auto it = cache.begin(); it != cache.end();) {
+                if (std::find(wanted.begin(), wanted.end(), it->first) == wanted.end()) it = cache.erase(it);
+                else ++it;
+            }
+            frame_ready.notify_all();
+
+        }
+
+    }
+
+    void Player::request(std::size_t frame_a, std::size_t frame_b) {
+
+        std::size_t n_frames = reader.n_frames();
+
+        //Walk away from the bracket in the playback direction, wrapping around like the playback time does
+        auto ahead = [&](std::size_t k) {
+            return direction > 0.0 ? (frame_b + k) % n_frames : (frame_a + n_frames - k % n_frames) % n_frames;
+        };
+
+        std::vector<std::size_t> frames = {frame_a};
+        if (frame_b != frame_a) frames.push_back(frame_b);
+        for (std::size_t k = 1; k <= lookahead && frames.size() < n_frames; k++)
+            if (std::find(frames.begin(), frames.end(), ahead(k)) == frames.end()) frames.push_back(ahead(k));
+
+        std::vector<std::size_t> next;
+        for (std::size_t k = lookahead+1; k <= 2*lookahead && k < n_frames; k++) next.push_back(ahead(k));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (frames == wanted) return;
+            wanted = std::move(frames);
+            readahead = std::move(next);
+        }
+        wake_decoder.notify_one();
+
+    }
+
+    Player::DecodedFrame Player::decoded(std::size_t frame_idx) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = cache.find(frame_idx);
+        return it == cache.end() ? nullptr : it->second;
+    }
+
+    std::size_t Player::make_resident(std::size_t frame_idx, std::size_t keep) {
+
+        for (std::size_t slot = 0; slot < 2; slot++)
+            if (resident[slot] == frame_idx) return slot;
+
+        DecodedFrame frame = decoded(frame_idx);
+        if (!frame) return no_frame;
+
+        std::size_t slot = resident[0] == keep ? 1 : 0;
+        std::size_t size = std::max<std::size_t>(n_particles(), 1)*sizeof(glm::vec3);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, frame_buffers[slot]);
+        //Orphan the old storage, so the upload doesn't wait for the last interpolation still reading it
+        glBufferData(GL_SHADER_STORAGE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, frame->size()*sizeof(glm::vec3), frame->data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        resident[slot] = frame_idx;
+        statistics.uploaded++;
+        return slot;
+
+    }
+
+    void Player::advance(double delta) {
+
+        if (delta != 0.0) direction = delta > 0.0 ? 1.0 : -1.0;
+
+        double duration = end_time() - start_time();
+        if (duration <= 0.0) return;
+
+        double t = std::fmod(playback_time - start_time() + delta, duration);
+        if (t < 0.0) t += duration;
+        playback_time = start_time() + t;
+
+    }
+
+    void Player::update(GlState::Cache &gl_state, GLuint interpolate_program, const GpuParticles::Buffers &buffers) {
+
+        std::size_t frame_a = reader.find_frame(playback_time);
+        std::size_t frame_b = std::min(frame_a + 1, reader.n_frames() - 1);
+
+        double time_a = reader.frame(frame_a).sim_time;
+        double time_b = reader.frame(frame_b).sim_time;
+        float t = time_b > time_a ? static_cast<float>(std::clamp((playback_time - time_a)/(time_b - time_a), 0.0, 1.0)) : 0.f;
+
+        request(frame_a, frame_b);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            //Nothing sensible is on screen yet, so the first frame is worth waiting for
+            if (!shown) frame_ready.wait(lock, [&] { return decode_error || (cache.count(frame_a) != 0 && cache.count(frame_b) != 0); });
+            if (decode_error) std::rethrow_exception(decode_error);
+        }
+
+        std::size_t slot_a = make_resident(frame_a, frame_b);
+        std::size_t slot_b = slot_a == no_frame ? no_frame : make_resident(frame_b, frame_a);
+        if (slot_b == no_frame) {
+            std::lock_guard<std::mutex> lock(mutex);
+            statistics.stalls++;
+            return;
+        }
+
+        gl_state.use_program(interpolate_program);
+
+        glUniform1ui(gl_state.uniform_location(interpolate_program, "n_particles"), static_cast<GLuint>(buffers.n_particles));
+        glUniform1f(gl_state.uniform_location(interpolate_program, "t"), t);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, frame_a_binding, frame_buffers[slot_a]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, frame_b_binding, frame_buffers[slot_b]);
+
+        GpuParticles::dispatch_chunked(gl_state.uniform_location(interpolate_program, "dispatch_offset"), buffers.n_particles, local_size_x);
+
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        shown = true;
+
+    }
+
+}
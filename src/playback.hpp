@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.hpp"
+#include "gpu_particles.hpp"
+#include "trajectory.hpp"
+
+//Renders a recorded trajectory instead of simulating. A decoder thread decodes the frames around the playback
+//position ahead of time while the OS is asked to read the frames after those in. The two frames bracketing the
+//playback time are uploaded into a pair of SSBOs and a compute shader interpolates between them straight into the
+//positions buffer, so the rest of the renderer doesn't know it isn't looking at a live simulation.
+namespace Playback {
+
+    //Must match the frame blocks in interpolate.comp, after the particle buffers and the mass profile
+    constexpr GLuint frame_a_binding = 4;
+    constexpr GLuint frame_b_binding = 5;
+
+    //Frames decoded ahead of the playback position, in the playback direction
+    constexpr std::size_t lookahead = 4;
+
+    //Scrubbing moves through the recording this many times faster than it plays
+    constexpr double scrub_speed = 10.0;
+
+    class Player {
+    public:
+
+        struct Stats {
+            std::uint64_t decoded = 0;
+            std::uint64_t uploaded = 0;
+            //Frames where the bracketing frames weren't decoded yet and the previous positions were shown again
+            std::uint64_t stalls = 0;
+        };
+
+        //Opens the trajectory and starts the decoder thread. Throws std::runtime_error if the file is unusable.
+        explicit Player(const std::string &path);
+        ~Player();
+
+        Player(const Player&) = delete;
+        Player& operator=(const Player&) = delete;
+
+        std::size_t n_particles() const { return reader.n_particles(); }
+        std::size_t n_frames() const { return reader.n_frames(); }
+        std::uint64_t ic_hash() const { return reader.ic_hash(); }
+
+        double start_time() const { return reader.frame(0).sim_time; }
+        double end_time() const { return reader.frame(reader.n_frames()-1).sim_time; }
+        double time() const { return playback_time; }
+
+        //Moves the playback time by delta, negative plays backwards. Wraps around at either end.
+        void advance(double delta);
+
+        //Call once per frame from the GL thread. Uploads the bracketing frames once they're decoded and interpolates
+        //them into the positions buffer, the radii in w are kept. Only waits for the decoder before the first frame
+        //has been shown, later it shows the previous positions instead. Rethrows decoder errors. The program is bound
+        //through gl_state.
+        void update(GlState::Cache &gl_state, GLuint interpolate_program, const GpuParticles::Buffers &buffers);
+
+        //Stops the decoder thread and deletes the frame buffers. Has to be called before the GL context goes away.
+        void finish();
+
+        Stats stats();
+
+    private:
+
+        typedef std::shared_ptr<const std::vector<glm::vec3>> DecodedFrame;
+
+        static constexpr std::size_t no_frame = ~std::size_t(0);
+
+        void decode_loop();
+        //Tells the decoder which frames to have ready around the bracket [frame_a, frame_b]
+        void request(std::size_t frame_a, std::size_t frame_b);
+        DecodedFrame decoded(std::size_t frame_idx);
+        //Makes frame_idx resident in one of the two buffers, never evicting keep. Returns the slot or no_frame.
+        std::size_t make_resident(std::size_t frame_idx, std::size_t keep);
+
+        Trajectory::Reader reader;
+
+        double playback_time;
+        double direction = 1.0;
+        bool shown = false;
+
+        std::array<GLuint, 2> frame_buffers{};
+        std::array<std::size_t, 2> resident{{no_frame, no_frame}};
+
+        std::mutex mutex;
+        std::condition_variable wake_decoder;
+        std::condition_variable frame_ready;
+        //Frames to decode, most urgent first, and the frames after them the OS should start reading in
+        std::vector<std::size_t> wanted;
+        std::vector<std::size_t> readahead;
+        std::map<std::size_t, DecodedFrame> cache;
+        bool stop = false;
+        std::exception_ptr decode_error;
+        std::thread decoder;
+
+        Stats statistics;
+
+    };
+
+}
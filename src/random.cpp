@@ -1,4 +1,3 @@
-#include <cstdlib>
 #include <cmath>
 
 #include "random.hpp"
@@ -7,22 +6,77 @@ namespace {
 
     constexpr float PI = 3.141592;
 
+    constexpr std::uint32_t philox_m0 = 0xD2511F53;
+    constexpr std::uint32_t philox_m1 = 0xCD9E8D57;
+    constexpr std::uint32_t philox_w0 = 0x9E3779B9;
+    constexpr std::uint32_t philox_w1 = 0xBB67AE85;
+
+    inline void mulhilo(std::uint32_t a, std::uint32_t b, std::uint32_t &hi, std::uint32_t &lo) {
+        std::uint64_t product = static_cast<std::uint64_t>(a)*static_cast<std::uint64_t>(b);
+        hi = static_cast<std::uint32_t>(product >> 32);
+        lo = static_cast<std::uint32_t>(product);
+    }
+
+    //Maps two uniform 32 bit values to two independent standard normal values
+    inline void box_muller(std::uint32_t a, std::uint32_t b, float &z0, float &z1) {
+        float u = 1.f - RandomNum::u32_to_float(a); //(0, 1], keeps log() finite
+        float v = RandomNum::u32_to_float(b);
+        float r = std::sqrt(-2.f*std::log(u));
+        z0 = r*std::cos(2.f*PI*v);
+        z1 = r*std::sin(2.f*PI*v);
+    }
+
 }
 
 namespace RandomNum {
 
-    float random_float(float a, float b) {
-        float random = ((float) rand()) / (float) RAND_MAX;
-        float diff = b - a;
-        float r = random * diff;
-        return a + r;
+    std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> counter, std::array<std::uint32_t, 2> key) {
+
+        for (unsigned round = 0; round < 10; round++) {
+            std::uint32_t hi0, lo0, hi1, lo1;
+            mulhilo(philox_m0, counter[0], hi0, lo0);
+            mulhilo(philox_m1, counter[2], hi1, lo1);
+            counter = {hi1^counter[1]^key[0], lo1, hi0^counter[3]^key[1], lo0};
+            key[0] += philox_w0;
+            key[1] += philox_w1;
+        }
+
+        return counter;
+
     }
-    
-    float gaus_rand(float mean, float stddev) {
 
-        float u = 1 - random_float(0.f, 1.f);
-        float v = random_float(0.f, 1.f);
-        float z = std::sqrt(-2.f*std::log(u)) * std::cos(2.f*PI*v);
+    Philox::Philox(std::uint64_t seed, std::uint64_t stream)
+        : key{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)},
+          counter{0, 0, static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)},
+          block{0, 0, 0, 0}, block_idx(4), spare_gaus(0.f), has_spare_gaus(false) {}
+
+    void Philox::refill() {
+        block = philox4x32(counter, key);
+        block_idx = 0;
+        if (++counter[0] == 0) ++counter[1];
+    }
+
+    std::uint32_t Philox::next_u32() {
+        if (block_idx == 4) refill();
+        return block[block_idx++];
+    }
+
+    float Philox::random_float(float a, float b) {
+        return a + u32_to_float(next_u32())*(b - a);
+    }
+
+    float Philox::gaus_rand(float mean, float stddev) {
+
+        if (has_spare_gaus) {
+            has_spare_gaus = false;
+            return spare_gaus*stddev+mean;
+        }
+
+        std::uint32_t a = next_u32();
+        std::uint32_t b = next_u32();
+        float z;
+        box_muller(a, b, z, spare_gaus);
+        has_spare_gaus = true;
 
         return z*stddev+mean;
 
@@ -1,8 +1,47 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
 namespace RandomNum {
 
-    float random_float(float a, float b);
-    float gaus_rand(float mean, float stddev);
+    //Philox4x32-10 block function (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+    //A pure function of the counter and the key, so any block can be computed independently of all others.
+    std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> counter, std::array<std::uint32_t, 2> key);
+
+    //Uniform float in [0, 1) from the top 24 bits
+    inline float u32_to_float(std::uint32_t x) {
+        return static_cast<float>(x >> 8) * (1.f/16777216.f);
+    }
+
+    //Counter based random stream. Every (seed, stream) pair is an independent, reproducible sequence,
+    //streams are usually particle indices so the result doesn't depend on how the work is split up.
+    class Philox {
+    public:
+
+        Philox(std::uint64_t seed, std::uint64_t stream);
+
+        std::uint32_t next_u32();
+
+        float random_float(float a, float b);
+
+        //Box-Muller, both outputs of a pair are used
+        float gaus_rand(float mean, float stddev);
+
+    private:
+
+        void refill();
+
+        std::array<std::uint32_t, 2> key;
+        std::array<std::uint32_t, 4> counter;
+
+        std::array<std::uint32_t, 4> block;
+        unsigned block_idx;
+
+        float spare_gaus;
+        bool has_spare_gaus;
+
+    };
 
 }
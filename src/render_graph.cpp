@@ -0,0 +1,234 @@
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+#include "render_graph.hpp"
+
+namespace {
+
+    std::size_t bytes_per_texel(GLenum internal_format) {
+        switch (internal_format) {
+            case GL_R11F_G11F_B10F:
+            case GL_RGBA8:
+            case GL_DEPTH24_STENCIL8:
+                return 4;
+            case GL_RGBA16F:
+                return 8;
+            default:
+                return 16;
+        }
+    }
+
+}
+
+namespace RenderGraph {
+
+    void TexturePool::destroy(Entry &entry) {
+        glDeleteFramebuffers(1, &entry.target.framebuffer);
+        glDeleteTextures(1, &entry.target.texture);
+        if (entry.depth_buffer != 0) glDeleteRenderbuffers(1, &entry.depth_buffer);
+    }
+
+    Target TexturePool::acquire(const TextureDesc &desc) {
+
+        for (Entry &entry : entries) {
+            if (entry.in_use || !(entry.desc == desc)) continue;
+            entry.in_use = true;
+            entry.last_used_frame = frame;
+            return entry.target;
+        }
+
+        //Allocated while the frame runs, so the bindings GlState::Cache knows about are put back
+        GLint previous_texture;
+        glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous_texture);
+        Target target;
+        glGenTextures(1, &target.texture);
+        glBindTexture(GL_TEXTURE_2D, target.texture);
+        //Immutable, so it can also be bound as an image
+        glTexStorage2D(GL_TEXTURE_2D, 1, desc.internal_format, desc.width, desc.height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, previous_texture);
+
+        GLint previous_framebuffer;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_framebuffer);
+        glGenFramebuffers(1, &target.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.texture, 0);
+        GLuint depth_buffer = 0;
+        if (desc.depth) {
+            glGenRenderbuffers(1, &depth_buffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, desc.width, desc.height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+        }
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::fprintf(stderr, "Error: %ux%u render target not ready!\n", desc.width, desc.height);
+        glBindFramebuffer(GL_FRAMEBUFFER, previous_framebuffer);
+
+        entries.push_back({desc, target, depth_buffer, true, frame});
+        return target;
+
+    }
+
+    void TexturePool::release(const Target &target) {
+        for (Entry &entry : entries) {
+            if (entry.target.texture == target.texture) entry.in_use = false;
+        }
+    }
+
+    void TexturePool::end_frame() {
+
+        //Targets acquired this frame are never freed, so they stay put while the others are removed
+        auto resized = [this](const Entry &entry) {
+            bool same_format = false;
+            for (const Entry &other : entries) {
+                if (other.last_used_frame != frame) continue;
+                if (other.desc == entry.desc) return false;
+                if (other.desc.internal_format == entry.desc.internal_format && other.desc.depth == entry.desc.depth) same_format = true;
+            }
+            return same_format;
+        };
+
+        for (std::size_t i = 0; i < entries.size();) {
+            Entry &entry = entries[i];
+            bool stale = entry.last_used_frame != frame && (frame - entry.last_used_frame > max_idle_frames || resized(entry));
+            if (!entry.in_use && stale) {
+                destroy(entry);
+                entries[i] = entries.back();
+                entries.pop_back();
+            }
+            else i++;
+        }
+
+        frame++;
+
+    }
+
+    std::size_t TexturePool::bytes() const {
+        std::size_t sum = 0;
+        for (const Entry &entry : entries) {
+            std::size_t texel_bytes = bytes_per_texel(entry.desc.internal_format);
+            if (entry.desc.depth) texel_bytes += bytes_per_texel(GL_DEPTH24_STENCIL8);
+            sum += static_cast<std::size_t>(entry.desc.width)*entry.desc.height*texel_bytes;
+        }
+        return sum;
+    }
+
+    Resource Graph::import_target(const char *name, Target target) {
+        resources.push_back({name, false, TextureDesc{}, target});
+        return resources.size() - 1;
+    }
+
+    Resource Graph::create_target(const char *name, const TextureDesc &desc) {
+        resources.push_back({name, true, desc, Target{}});
+        return resources.size() - 1;
+    }
+
+    Resource Graph::create_virtual(const char *name) {
+        resources.push_back({name, false, TextureDesc{}, Target{}});
+        return resources.size() - 1;
+    }
+
+    void Graph::add_pass(const char *name, std::vector<Resource> reads, std::vector<Resource> writes, std::function<void()> run) {
+        passes.push_back({name, std::move(reads), std::move(writes), std::move(run)});
+    }
+
+    void Graph::present(Resource resource) {
+        resources[resource].presented = true;
+    }
+
+    void Graph::execute() {
+
+        auto start_time = std::chrono::steady_clock::now();
+
+        //Walking backwards, a pass is live if it writes something a live pass or the presentation needs
+        std::vector<bool> needed(resources.size());
+        for (Resource resource = 0; resource < resources.size(); resource++) needed[resource] = resources[resource].presented;
+        std::vector<bool> live(passes.size());
+        for (std::size_t i = passes.size(); i-- > 0;) {
+            for (Resource resource : passes[i].writes) {
+                if (needed[resource]) live[i] = true;
+            }
+            if (!live[i]) continue;
+            for (Resource resource : passes[i].reads) needed[resource] = true;
+        }
+
+        //Pooled targets are held from the first live pass using them to the last one
+        constexpr std::size_t unused = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> first_use(resources.size(), unused);
+        std::vector<std::size_t> last_use(resources.size(), unused);
+        for (std::size_t i = 0; i < passes.size(); i++) {
+            if (!live[i]) continue;
+            for (const std::vector<Resource> *used : {&passes[i].reads, &passes[i].writes}) {
+                for (Resource resource : *used) {
+                    if (first_use[resource] == unused) first_use[resource] = i;
+                    last_use[resource] = i;
+                }
+            }
+        }
+        for (std::size_t i = 0; i < passes.size(); i++) {
+            if (!live[i]) continue;
+            for (Resource resource : passes[i].reads) {
+                bool written = false;
+                for (std::size_t j = first_use[resource]; j <= i && !written; j++) {
+                    if (!live[j]) continue;
+                    for (Resource write : passes[j].writes) written = written || write == resource;
+                }
+                if (resources[resource].transient && !written) {
+                    std::ostringstream err_msg_stream;
+                    err_msg_stream << "Error: Render pass \"" << passes[i].name << "\" reads \"" << resources[resource].name << "\" before any pass writes it\n";
+                    passes.clear();
+                    resources.clear();
+                    throw std::runtime_error(err_msg_stream.str());
+                }
+            }
+        }
+
+        n_passes_run = 0;
+        n_passes_culled = 0;
+        for (std::size_t i = 0; i < passes.size(); i++) {
+            if (!live[i]) {
+                n_passes_culled++;
+                continue;
+            }
+
+            for (Resource resource : passes[i].writes) {
+                ResourceEntry &entry = resources[resource];
+                if (entry.transient && first_use[resource] == i) entry.target = texture_pool.acquire(entry.desc);
+            }
+
+            passes[i].run();
+            n_passes_run++;
+
+            for (const std::vector<Resource> *used : {&passes[i].reads, &passes[i].writes}) {
+                for (Resource resource : *used) {
+                    ResourceEntry &entry = resources[resource];
+                    if (entry.transient && !entry.presented && last_use[resource] == i && entry.target.texture != 0) {
+                        texture_pool.release(entry.target);
+                        entry.target = Target{};
+                    }
+                }
+            }
+        }
+
+        for (ResourceEntry &entry : resources) {
+            if (entry.transient && entry.target.texture != 0) texture_pool.release(entry.target);
+        }
+        passes.clear();
+        resources.clear();
+        texture_pool.end_frame();
+
+        submit_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        total_submit_seconds += submit_seconds;
+        total_passes_run += n_passes_run;
+        total_passes_culled += n_passes_culled;
+        n_frames++;
+
+    }
+
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glad/glad.h>
+
+//The frame as a list of passes that declare which resources they read and write. Passes whose writes nothing
+//presented depends on are culled, and the render targets only used inside the frame come from a pool: a target is
+//taken when its first writer runs and handed back after its last reader, so a later pass can reuse it and targets
+//nothing wrote for a while are freed. The graph is declared anew every frame, passes run in declaration order.
+namespace RenderGraph {
+
+    //Frames a pooled target may go unused before it's freed
+    constexpr std::uint64_t max_idle_frames = 60;
+
+    struct TextureDesc {
+        unsigned width;
+        unsigned height;
+        GLenum internal_format;
+        //The frame buffer also gets a depth and stencil buffer
+        bool depth = false;
+
+        bool operator==(const TextureDesc &other) const {
+            return width == other.width && height == other.height && internal_format == other.internal_format && depth == other.depth;
+        }
+    };
+
+    //A texture and a frame buffer with it as the only color attachment, plus a depth buffer if it was asked for
+    struct Target {
+        GLuint texture = 0;
+        GLuint framebuffer = 0;
+    };
+
+    //The targets still pooled at the end go away with the GL context, the pool may outlive it
+    class TexturePool {
+    public:
+
+        TexturePool() = default;
+        TexturePool(const TexturePool&) = delete;
+        TexturePool& operator=(const TexturePool&) = delete;
+
+        //A free target matching desc, allocated if there is none. Linear filtering, clamped to the edges. Targets of
+        //sizes no longer asked for, like after the window was resized, are freed by end_frame().
+        Target acquire(const TextureDesc &desc);
+        void release(const Target &target);
+
+        //Frees the free targets no frame acquired for max_idle_frames frames, and right away those this frame didn't
+        //acquire while it did acquire one of the same format at another size. That's a resize, and while the window
+        //is dragged every intermediate size would otherwise be held on to.
+        void end_frame();
+
+        std::size_t targets() const { return entries.size(); }
+        std::size_t bytes() const;
+
+    private:
+
+        struct Entry {
+            TextureDesc desc;
+            Target target;
+            GLuint depth_buffer;
+            bool in_use;
+            std::uint64_t last_used_frame;
+        };
+
+        void destroy(Entry &entry);
+
+        std::vector<Entry> entries;
+        std::uint64_t frame = 0;
+
+    };
+
+    using Resource = std::size_t;
+
+    class Graph {
+    public:
+
+        Graph() = default;
+        Graph(const Graph&) = delete;
+        Graph& operator=(const Graph&) = delete;
+
+        //A target that lives outside the frame, like the default frame buffer or the headless screen
+        Resource import_target(const char *name, Target target);
+        //A target taken from the pool for the passes using it
+        Resource create_target(const char *name, const TextureDesc &desc);
+        //A result without a texture, like the instance lists of the culling pass, that only orders passes
+        Resource create_virtual(const char *name);
+
+        //run may use target() and texture() of the resources the pass reads and writes
+        void add_pass(const char *name, std::vector<Resource> reads, std::vector<Resource> writes, std::function<void()> run);
+        //The frame's result, the passes leading to it are the ones run
+        void present(Resource resource);
+
+        //Runs the passes the presented resources depend on and forgets the frame's declarations
+        void execute();
+
+        Target target(Resource resource) const { return resources[resource].target; }
+        GLuint texture(Resource resource) const { return resources[resource].target.texture; }
+
+        //Of the last frame. Submitting is the CPU time spent in execute(), issuing the GL commands.
+        std::size_t passes_run() const { return n_passes_run; }
+        std::size_t passes_culled() const { return n_passes_culled; }
+        double submit_ms() const { return submit_seconds*1e3; }
+        //Per frame since the start
+        double mean_passes_run() const { return n_frames > 0 ? static_cast<double>(total_passes_run)/n_frames : 0.0; }
+        double mean_passes_culled() const { return n_frames > 0 ? static_cast<double>(total_passes_culled)/n_frames : 0.0; }
+        double mean_submit_ms() const { return n_frames > 0 ? total_submit_seconds*1e3/n_frames : 0.0; }
+        std::uint64_t frames() const { return n_frames; }
+
+        const TexturePool& pool() const { return texture_pool; }
+
+    private:
+
+        struct ResourceEntry {
+            const char *name;
+            bool transient;
+            TextureDesc desc;
+            Target target;
+            bool presented = false;
+        };
+
+        struct Pass {
+            const char *name;
+            std::vector<Resource> reads;
+            std::vector<Resource> writes;
+            std::function<void()> run;
+        };
+
+        std::vector<ResourceEntry> resources;
+        std::vector<Pass> passes;
+        TexturePool texture_pool;
+
+        std::size_t n_passes_run = 0;
+        std::size_t n_passes_culled = 0;
+        std::uint64_t total_passes_run = 0;
+        std::uint64_t total_passes_culled = 0;
+        double submit_seconds = 0.0;
+        double total_submit_seconds = 0.0;
+        std::uint64_t n_frames = 0;
+
+    };
+
+}
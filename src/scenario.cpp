@@ -0,0 +1,158 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "scenario.hpp"
+
+namespace {
+
+    //Total mass of a galaxy when none is given, a 40000 particle galaxy of it matches the old fixed particle mass
+    constexpr float default_galaxy_mass = 20000.f;
+
+    std::runtime_error parse_error(const std::string &path, std::size_t line_number, const std::string &msg) {
+        std::ostringstream err_msg_stream;
+        err_msg_stream << "Error: " << path << ":" << line_number << ": " << msg << "\n";
+        return std::runtime_error(err_msg_stream.str());
+    }
+
+    float parse_float(const std::string &str, const std::string &path, std::size_t line_number) {
+        char *end;
+        errno = 0;
+        float value = std::strtof(str.c_str(), &end);
+        if (errno != 0 || end == str.c_str() || *end != '\0')
+            throw parse_error(path, line_number, "invalid number \"" + str + "\"");
+        return value;
+    }
+
+    std::size_t parse_size(const std::string &str, const std::string &path, std::size_t line_number) {
+        char *end;
+        errno = 0;
+        unsigned long long value = std::strtoull(str.c_str(), &end, 10);
+        if (errno != 0 || end == str.c_str() || *end != '\0' || str[0] == '-')
+            throw parse_error(path, line_number, "invalid count \"" + str + "\"");
+        return static_cast<std::size_t>(value);
+    }
+
+    glm::vec3 parse_vec3(const std::string &str, const std::string &path, std::size_t line_number) {
+        glm::vec3 v;
+        std::istringstream stream(str);
+        std::string component;
+        int i = 0;
+        for (; i < 3 && std::getline(stream, component, ','); i++) v[i] = parse_float(component, path, line_number);
+        if (i != 3 || std::getline(stream, component, ','))
+            throw parse_error(path, line_number, "expected 3 comma separated numbers, got \"" + str + "\"");
+        return v;
+    }
+
+}
+
+namespace Scenario {
+
+    std::size_t Scenario::n_particles() const {
+        std::size_t n = 0;
+        for (const GalaxyDesc &galaxy : galaxies) n += galaxy.n_particles;
+        return n;
+    }
+
+    std::vector<std::size_t> Scenario::offsets() const {
+        std::vector<std::size_t> result(1, 0);
+        for (const GalaxyDesc &galaxy : galaxies) result.push_back(result.back() + galaxy.n_particles);
+        return result;
+    }
+
+    Galaxy::Placement Scenario::placement(std::size_t galaxy_idx) const {
+        const GalaxyDesc &galaxy = galaxies[galaxy_idx];
+        return {galaxy.center, galaxy.velocity, Galaxy::basis(galaxy.axis), galaxy.mass/static_cast<float>(galaxy.n_particles),
+                galaxy.velocity_dispersion};
+    }
+
+    std::vector<Galaxy::MassProfile> Scenario::mass_profiles(std::uint64_t seed) const {
+        std::vector<std::size_t> first = offsets();
+        std::vector<Galaxy::MassProfile> profiles;
+        for (std::size_t g = 0; g < galaxies.size(); g++)
+            profiles.push_back(Galaxy::mass_profile(first[g], galaxies[g].n_particles, placement(g), seed));
+        return profiles;
+    }
+
+    Scenario default_scenario(std::size_t n_particles) {
+
+        GalaxyDesc galaxy;
+        galaxy.center = glm::vec3(-500.f, 0.f, 0.f);
+        galaxy.velocity = glm::vec3(0.f, 0.f, 0.f);
+        galaxy.axis = glm::vec3(0.f, 1.f, 0.f);
+        galaxy.n_particles = n_particles;
+        galaxy.mass = default_galaxy_mass;
+        galaxy.velocity_dispersion = 0.f;
+
+        Scenario scenario;
+        scenario.galaxies.push_back(galaxy);
+        return scenario;
+
+    }
+
+    Scenario load_scenario(const std::string &path) {
+
+        std::ifstream file(path);
+        if (file.fail()) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Failed to open scenario file \"" << path << "\": " << std::strerror(errno) << "\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+
+        Scenario scenario;
+
+        std::string line;
+        std::size_t line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+
+            std::istringstream line_stream(line);
+            std::string keyword;
+            if (!(line_stream >> keyword) || keyword[0] == '#') continue;
+            if (keyword != "galaxy") throw parse_error(path, line_number, "unknown keyword \"" + keyword + "\"");
+
+            GalaxyDesc galaxy;
+            galaxy.center = glm::vec3(0.f, 0.f, 0.f);
+            galaxy.velocity = glm::vec3(0.f, 0.f, 0.f);
+            galaxy.axis = glm::vec3(0.f, 1.f, 0.f);
+            galaxy.n_particles = 0;
+            galaxy.mass = default_galaxy_mass;
+            galaxy.velocity_dispersion = 0.f;
+
+            std::string field;
+            while (line_stream >> field) {
+                std::size_t eq = field.find('=');
+                if (eq == std::string::npos) throw parse_error(path, line_number, "expected key=value, got \"" + field + "\"");
+                std::string key = field.substr(0, eq);
+                std::string value = field.substr(eq+1);
+
+                if (key == "center") galaxy.center = parse_vec3(value, path, line_number);
+                else if (key == "velocity") galaxy.velocity = parse_vec3(value, path, line_number);
+                else if (key == "axis") galaxy.axis = parse_vec3(value, path, line_number);
+                else if (key == "particles") galaxy.n_particles = parse_size(value, path, line_number);
+                else if (key == "mass") galaxy.mass = parse_float(value, path, line_number);
+                else if (key == "dispersion") galaxy.velocity_dispersion = parse_float(value, path, line_number);
+                else throw parse_error(path, line_number, "unknown key \"" + key + "\"");
+            }
+
+            if (galaxy.n_particles == 0) throw parse_error(path, line_number, "a galaxy needs particles=N with N > 0");
+            if (glm::length(galaxy.axis) == 0.f) throw parse_error(path, line_number, "axis can't be zero");
+            if (galaxy.velocity_dispersion < 0.f) throw parse_error(path, line_number, "dispersion can't be negative");
+
+            scenario.galaxies.push_back(galaxy);
+        }
+
+        if (scenario.galaxies.empty()) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Scenario file \"" << path << "\" doesn't contain any galaxies\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+
+        return scenario;
+
+    }
+
+}
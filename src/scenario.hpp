@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "galaxy.hpp"
+#include "parallel.hpp"
+
+//A scenario is a set of galaxies that make up the initial conditions. Every galaxy owns a contiguous slice
+//of the particle arrays, in the order they're listed.
+namespace Scenario {
+
+    struct GalaxyDesc {
+        glm::vec3 center;
+        //Bulk velocity of the whole galaxy
+        glm::vec3 velocity;
+        //Spin axis, the disk lies in the plane perpendicular to it
+        glm::vec3 axis;
+        std::size_t n_particles;
+        //Total mass, split evenly between the galaxy's stars
+        float mass;
+        //Random velocity spread as a fraction of the circular speed, 0 for a cold disk
+        float velocity_dispersion;
+    };
+
+    struct Scenario {
+
+        std::vector<GalaxyDesc> galaxies;
+
+        std::size_t n_particles() const;
+
+        //Index of the first particle of every galaxy, plus the total particle count at the end
+        std::vector<std::size_t> offsets() const;
+
+        Galaxy::Placement placement(std::size_t galaxy_idx) const;
+
+        //Enclosed mass profile of every galaxy, needed by both generators
+        std::vector<Galaxy::MassProfile> mass_profiles(std::uint64_t seed) const;
+
+    };
+
+    //The single galaxy the simulation has always started with
+    Scenario default_scenario(std::size_t n_particles);
+
+    //Reads a scenario file, one galaxy per line:
+    //  galaxy center=X,Y,Z velocity=X,Y,Z axis=X,Y,Z particles=N mass=M dispersion=F
+    //Everything but particles is optional. Empty lines and lines starting with # are ignored.
+    //Throws std::runtime_error on malformed files.
+    Scenario load_scenario(const std::string &path);
+
+    //Generates every galaxy into its slice of particles[0, n_particles()). All galaxies are generated by one
+    //parallel_for over the whole particle range, so small galaxies don't serialize the work.
+    template<typename Particles>
+    void generate(const Scenario &scenario, Particles &particles, std::uint64_t seed) {
+
+        typedef typename Particles::vec3_type vec3_type;
+
+        std::vector<std::size_t> offsets = scenario.offsets();
+
+        std::vector<Galaxy::Placement> placements;
+        for (std::size_t g = 0; g < scenario.galaxies.size(); g++) placements.push_back(scenario.placement(g));
+
+        std::vector<Galaxy::MassProfile> profiles = scenario.mass_profiles(seed);
+
+        Parallel::parallel_for(offsets.back(), Galaxy::generation_chunk_size, [&](std::size_t begin, std::size_t end) {
+            //Galaxy containing particle begin
+            std::size_t g = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+            for (std::size_t i = begin; i < end; i++) {
+                while (i >= offsets[g+1]) g++;
+                const GalaxyDesc &galaxy = scenario.galaxies[g];
+                Galaxy::GalaxyStar star = Galaxy::galaxy_star(i - offsets[g], galaxy.n_particles, placements[g], profiles[g], seed, i);
+                particles.set_particle(i, vec3_type(star.position), vec3_type(star.velocity), star.radius, star.mass, star.type_idx);
+            }
+        });
+
+    }
+
+}
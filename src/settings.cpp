@@ -0,0 +1,221 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "settings.hpp"
+
+namespace {
+
+    const char* next_arg(int argc, char **argv, int &i) {
+        if (i+1 >= argc) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Missing value after \"" << argv[i] << "\"\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+        return argv[++i];
+    }
+
+    std::uint64_t parse_uint(const char *option, const char *str) {
+        char *end;
+        errno = 0;
+        unsigned long long value = std::strtoull(str, &end, 10);
+        if (errno != 0 || end == str || *end != '\0' || str[0] == '-') {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Invalid value \"" << str << "\" for " << option << "\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+        return value;
+    }
+
+    //WIDTHxHEIGHT, like 1920x1080
+    void parse_size(const char *option, const char *str, unsigned &width, unsigned &height) {
+        char *end;
+        errno = 0;
+        unsigned long w = std::strtoul(str, &end, 10);
+        bool valid = errno == 0 && end != str && str[0] != '-' && *end == 'x';
+        unsigned long h = 0;
+        if (valid) {
+            const char *height_str = end + 1;
+            h = std::strtoul(height_str, &end, 10);
+            valid = errno == 0 && end != height_str && height_str[0] != '-' && *end == '\0';
+        }
+        if (!valid || w < 16 || h < 16 || w > 16384 || h > 16384) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Invalid size \"" << str << "\" for " << option << ", has to be like 1920x1080 with sides from 16 to 16384\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+        width = static_cast<unsigned>(w);
+        height = static_cast<unsigned>(h);
+    }
+
+    float parse_float(const char *option, const char *str) {
+        char *end;
+        errno = 0;
+        float value = std::strtof(str, &end);
+        if (errno != 0 || end == str || *end != '\0' || !(value >= 0.f)) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream << "Error: Invalid value \"" << str << "\" for " << option << "\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
+        return value;
+    }
+
+}
+
+namespace Settings {
+
+    Settings parse_args(int argc, char **argv) {
+
+        Settings settings;
+
+        for (int i = 1; i < argc; i++) {
+            const char *arg = argv[i];
+
+            if (std::strcmp(arg, "--particles") == 0)
+                settings.n_particles = parse_uint(arg, next_arg(argc, argv, i));
+            else if (std::strcmp(arg, "--scenario") == 0)
+                settings.scenario_path = next_arg(argc, argv, i);
+            else if (std::strcmp(arg, "--catalog") == 0)
+                settings.catalog_path = next_arg(argc, argv, i);
+            else if (std::strcmp(arg, "--catalog-schema") == 0)
+                settings.catalog_schema = next_arg(argc, argv, i);
+            else if (std::strcmp(arg, "--seed") == 0)
+                settings.seed = parse_uint(arg, next_arg(argc, argv, i));
+            else if (std::strcmp(arg, "--gpu-ic") == 0)
+                settings.gpu_ic = true;
+            else if (std::strcmp(arg, "--check-gpu-ic") == 0)
+                settings.check_gpu_ic = true;
+            else if (std::strcmp(arg, "--no-ic-cache") == 0)
+                settings.use_ic_cache = false;
+            else if (std::strcmp(arg, "--ic-cache") == 0) {
+                settings.ic_cache_folder = next_arg(argc, argv, i);
+                if (settings.ic_cache_folder.back() != '/') settings.ic_cache_folder.push_back('/');
+            }
+            else if (std::strcmp(arg, "--restart") == 0)
+                settings.restart_path = next_arg(argc, argv, i);
+            else if (std::strcmp(arg, "--checkpoint") == 0)
+                settings.checkpoint_path = next_arg(argc, argv, i);
+            else if (std::strcmp(arg, "--checkpoint-every") == 0)
+                settings.checkpoint_interval = parse_uint(arg, next_arg(argc, argv, i));
+            else if (std::strcmp(arg, "--snapshot-every") == 0)
+                settings.snapshot_interval = parse_uint(arg, next_arg(argc, argv, i));
+            else if (std::strcmp(arg, "--snapshots") == 0) {
+                settings.snapshot_folder = next_arg(argc, argv, i);
+                if (settings.snapshot_folder.back() != '/') settings.snapshot_folder.push_back('/');
+            }
+            else if (std::strcmp(arg, "--raw-snapshots") == 0)
+                settings.raw_snapshots = true;
+            else if (std::strcmp(arg, "--cpu") == 0)
+                settings.cpu_backend = true;
+            else if (std::strcmp(arg, "--fork-checkpoints") == 0)
+                settings.fork_checkpoints = true;
+            else if (std::strcmp(arg, "--no-io-uring") == 0)
+                settings.use_io_uring = false;
+            else if (std::strcmp(arg, "--sphere-meshes") == 0)
+                settings.sphere_meshes = true;
+            else if (std::strcmp(arg, "--gaussian-bloom") == 0)
+                settings.gaussian_bloom = true;
+            else if (std::strcmp(arg, "--blur-radius") == 0) {
+                std::uint64_t radius = parse_uint(arg, next_arg(argc, argv, i));
+                if (radius < 1 || radius > 32) throw std::runtime_error("Error: --blur-radius has to be between 1 and 32\n");
+                settings.blur_radius = static_cast<int>(radius);
+            }
+            else if (std::strcmp(arg, "--blur-passes") == 0) {
+                std::uint64_t passes = parse_uint(arg, next_arg(argc, argv, i));
+                if (passes < 1 || passes > 64) throw std::runtime_error("Error: --blur-passes has to be between 1 and 64\n");
+                settings.blur_passes = static_cast<unsigned>(passes);
+            }
+            else if (std::strcmp(arg, "--frame-budget") == 0)
+                settings.frame_budget_ms = parse_float(arg, next_arg(argc, argv, i));
+            else if (std::strcmp(arg, "--render-scale") == 0) {
+                settings.render_scale = parse_float(arg, next_arg(argc, argv, i));
+                if (settings.render_scale < 0.5f || settings.render_scale > 1.f) throw std::runtime_error("Error: --render-scale has to be between 0.5 and 1\n");
+            }
+            else if (std::strcmp(arg, "--min-star-pixels") == 0)
+                settings.min_star_pixels = parse_float(arg, next_arg(argc, argv, i));
+            else if (std::strcmp(arg, "--splat-pixels") == 0) {
+                settings.splat_pixels = parse_float(arg, next_arg(argc, argv, i));
+                if (settings.splat_pixels != 0.f && settings.splat_pixels < 1.f) throw std::runtime_error("Error: --splat-pixels has to be 0 or at least 1\n");
+            }
+            else if (std::strcmp(arg, "--play") == 0)
+                settings.playback_path = next_arg(argc, argv, i);
+            else if (std::strcmp(arg, "--size") == 0)
+                parse_size(arg, next_arg(argc, argv, i), settings.width, settings.height);
+            else if (std::strcmp(arg, "--headless") == 0)
+                settings.headless = true;
+            else if (std::strcmp(arg, "--movie") == 0)
+                settings.movie_path = next_arg(argc, argv, i);
+            else if (std::strcmp(arg, "--fps") == 0) {
+                std::uint64_t fps = parse_uint(arg, next_arg(argc, argv, i));
+                if (fps < 1 || fps > 240) throw std::runtime_error("Error: --fps has to be between 1 and 240\n");
+                settings.movie_fps = static_cast<unsigned>(fps);
+            }
+            else if (std::strcmp(arg, "--frames") == 0)
+                settings.max_frames = parse_uint(arg, next_arg(argc, argv, i));
+            else if (std::strcmp(arg, "--trajectory-bits") == 0) {
+                std::uint64_t bits = parse_uint(arg, next_arg(argc, argv, i));
+                if (bits < 1 || bits > 16) throw std::runtime_error("Error: --trajectory-bits has to be between 1 and 16\n");
+                settings.trajectory_bits = static_cast<unsigned>(bits);
+            }
+            else {
+                std::ostringstream err_msg_stream;
+                err_msg_stream << "Error: Unknown argument \"" << arg << "\"\n";
+                throw std::runtime_error(err_msg_stream.str());
+            }
+        }
+
+        if (settings.n_particles == 0) throw std::runtime_error("Error: --particles has to be at least 1\n");
+        if (!settings.catalog_path.empty() && !settings.scenario_path.empty()) throw std::runtime_error("Error: --catalog and --scenario can't be combined\n");
+        if (!settings.catalog_schema.empty() && settings.catalog_path.empty()) throw std::runtime_error("Error: --catalog-schema only applies to --catalog\n");
+        if (settings.cpu_backend && !settings.playback_path.empty()) throw std::runtime_error("Error: --cpu and --play can't be combined\n");
+        if (settings.fork_checkpoints && !settings.cpu_backend) throw std::runtime_error("Error: --fork-checkpoints only applies to --cpu\n");
+        if (settings.headless && settings.max_frames == 0) throw std::runtime_error("Error: --headless needs --frames, there is no window to close\n");
+
+        return settings;
+
+    }
+
+    void print_usage(const char *exe_name) {
+        std::fprintf(stderr,
+                "Usage: %s [options]\n"
+                "  --particles N     Number of particles of the default scenario (default 40000)\n"
+                "  --scenario FILE   Load the galaxies from a scenario file\n"
+                "  --catalog FILE    Import the particles from a CSV or binary (.bin, .f32) catalog\n"
+                "  --catalog-schema SPEC Catalog columns (default x,y,z,vx,vy,vz,mass), see catalog.hpp\n"
+                "  --seed N          Seed for the initial conditions (default 1)\n"
+                "  --gpu-ic          Generate the initial conditions on the GPU\n"
+                "  --check-gpu-ic    Compare the GPU and CPU initial conditions and exit\n"
+                "  --no-ic-cache     Always regenerate the initial conditions\n"
+                "  --ic-cache DIR    Folder for cached initial conditions (default ic_cache/)\n"
+                "  --restart FILE    Continue the run saved in a checkpoint\n"
+                "  --checkpoint FILE Where checkpoints are written (default checkpoint.bin)\n"
+                "  --checkpoint-every N  Write a checkpoint every N steps\n"
+                "  --snapshot-every N    Dump the particle positions every N steps\n"
+                "  --snapshots DIR   Folder for the position dumps (default snapshots/)\n"
+                "  --raw-snapshots   Write one uncompressed file per snapshot instead of a trajectory\n"
+                "  --trajectory-bits N   Position precision of the trajectory, 1 to 16 (default 12)\n"
+                "  --play FILE       Play a recorded trajectory back instead of simulating\n"
+                "  --size WxH        Window size, or frame size with --headless (default 1280x720)\n"
+                "  --headless        Render without a window through EGL, works with Mesa's software rasterizer\n"
+                "  --movie PATH      Export every frame, to a .y4m video or a folder of PNGs\n"
+                "  --fps N           Frames per second of the exported movie, 1 to 240 (default 30)\n"
+                "  --frames N        Quit after N frames\n"
+                "  --cpu             Integrate on the CPU, only practical for small particle counts\n"
+                "  --fork-checkpoints    Write --cpu checkpoints from a forked process\n"
+                "  --no-io-uring     Write output files with a pwrite thread pool instead of io_uring\n"
+                "  --sphere-meshes   Draw the stars as sphere meshes instead of impostors (toggle with M)\n"
+                "  --gaussian-bloom  Start with the full resolution gaussian bloom instead of the mip chain (toggle with B)\n"
+                "  --blur-radius R   Taps on each side of the gaussian bloom, 1 to 32 (default 4, change with [ and ])\n"
+                "  --blur-passes N   Horizontal and vertical passes of the gaussian bloom, 1 to 64 (default 5)\n"
+                "  --frame-budget MS Scale the render resolution to keep the GPU frame time around MS milliseconds\n"
+                "  --render-scale S  Render the scene at S times the window resolution, 0.5 to 1 (default 1)\n"
+                "  --min-star-pixels R   Cull stars with a smaller radius on screen, 0 keeps all (default 0.25)\n"
+                "  --splat-pixels S  Sum stars smaller than S pixels into splats, 0 draws all on their own (default 2)\n",
+                exe_name);
+    }
+
+}
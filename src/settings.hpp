@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Settings {
+
+    struct Settings {
+        //Particle count of the default single galaxy scenario
+        std::size_t n_particles = 40000;
+        //Scenario file to load instead of the default scenario, see scenario.hpp
+        std::string scenario_path;
+        //Particle catalog to import instead of generating a scenario, see catalog.hpp
+        std::string catalog_path;
+        //Columns of the catalog, empty means Catalog::default_schema
+        std::string catalog_schema;
+        //Initial conditions are a pure function of the seed
+        std::uint64_t seed = 1;
+        //Generate the initial conditions with a compute shader instead of on the CPU
+        bool gpu_ic = false;
+        //Generate the initial conditions on both the CPU and the GPU, compare them and exit
+        bool check_gpu_ic = false;
+        //Reuse previously generated initial conditions from ic_cache_folder
+        bool use_ic_cache = true;
+        //Empty means "ic_cache/" next to the repo
+        std::string ic_cache_folder;
+        //Continue from this checkpoint instead of generating initial conditions
+        std::string restart_path;
+        //Where checkpoints are written, empty means "checkpoint.bin" next to the repo
+        std::string checkpoint_path;
+        //Write a checkpoint every this many simulation steps, 0 only writes them on request
+        std::uint64_t checkpoint_interval = 0;
+        //Dump the positions every this many simulation steps, 0 disables trajectory output
+        std::uint64_t snapshot_interval = 0;
+        //Empty means "snapshots/" next to the repo
+        std::string snapshot_folder;
+        //One raw file per snapshot instead of a compressed trajectory
+        bool raw_snapshots = false;
+        //Bits per axis of the quantized trajectory positions, same as Trajectory::default_position_bits
+        unsigned trajectory_bits = 12;
+        //Integrate on the host instead of in the physics shader
+        bool cpu_backend = false;
+        //Checkpoints of the CPU backend are written by a forked child instead of being copied through the GPU
+        bool fork_checkpoints = false;
+        //Write checkpoints and trajectories with the pwrite thread pool even where io_uring works
+        bool use_io_uring = true;
+        //Draw the stars as instanced sphere meshes instead of ray cast impostors
+        bool sphere_meshes = false;
+        //Start with the full resolution gaussian bloom instead of the mip chain
+        bool gaussian_bloom = false;
+        //Taps on each side of the gaussian blur, same as Blur::default_radius
+        int blur_radius = 4;
+        //Horizontal and vertical pairs of the gaussian blur, same as Blur::default_passes
+        unsigned blur_passes = 5;
+        //GPU frame time in milliseconds the render resolution is adjusted to, 0 keeps it fixed
+        double frame_budget_ms = 0.0;
+        //Scene resolution relative to the window, the start for --frame-budget, see DynamicResolution
+        float render_scale = 1.f;
+        //Stars with a smaller radius on screen in pixels aren't drawn, same as StarCulling::default_min_pixel_radius
+        float min_star_pixels = 0.25f;
+        //Width of the splats distant stars are summed into, 0 draws them all, same as StarCulling::default_splat_pixels
+        float splat_pixels = 2.f;
+        //Plays this trajectory back instead of simulating, empty means live simulation
+        std::string playback_path;
+        //Window size, or the size of the frames rendered without one
+        unsigned width = 1280;
+        unsigned height = 720;
+        //Render into a surfaceless EGL context instead of a window, see headless.hpp
+        bool headless = false;
+        //Where rendered frames are written, a .y4m video or a folder of PNGs, empty doesn't export any
+        std::string movie_path;
+        //Exported frames per second of simulated time, every frame steps the simulation by 1/movie_fps
+        unsigned movie_fps = 30;
+        //Quit after this many frames, 0 runs until the window is closed
+        std::uint64_t max_frames = 0;
+    };
+
+    //Throws std::runtime_error on unknown or malformed arguments
+    Settings parse_args(int argc, char **argv);
+
+    void print_usage(const char *exe_name);
+
+}
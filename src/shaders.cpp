@@ -2,14 +2,26 @@
 #include <cstring>
 #include <sstream>
 #include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 #include <glad/glad.h>
 
 #include "shaders.hpp"
 
-namespace Shaders {
+namespace {
+
+    //Reads a shader file, replacing every `#include "file"` line with the contents of that file.
+    //Included paths are relative to the directory of the including file.
+    std::string read_shader_source(const std::string &shader_path, unsigned depth = 0) {
 
-    GLuint create_shader(std::string shader_path, GLenum type) {
+        if (depth > 8) {
+            std::ostringstream err_msg_stream;
+            err_msg_stream <<
+                "Error: Shader includes nested too deeply at \"" << shader_path << "\"\n";
+            throw std::runtime_error(err_msg_stream.str());
+        }
 
         std::ifstream shader_file(shader_path);
         if (shader_file.fail()) {
@@ -19,9 +31,42 @@ namespace Shaders {
             throw std::runtime_error(err_msg_stream.str());
         }
 
+        std::string shader_folder = shader_path;
+        while (shader_folder.length() != 0 && shader_folder.back() != '/') shader_folder.pop_back();
+
+        const std::string include_directive = "#include \"";
+
         std::ostringstream shader_src_stream;
-        shader_src_stream << shader_file.rdbuf();
-        std::string shader_src = shader_src_stream.str();
+        std::string line;
+        while (std::getline(shader_file, line)) {
+            if (line.compare(0, include_directive.length(), include_directive) == 0) {
+                std::size_t end = line.find('"', include_directive.length());
+                std::string include_path = line.substr(include_directive.length(), end - include_directive.length());
+                shader_src_stream << read_shader_source(shader_folder + include_path, depth+1);
+            }
+            else {
+                shader_src_stream << line << '\n';
+            }
+        }
+
+        return shader_src_stream.str();
+
+    }
+
+}
+
+namespace Shaders {
+
+    GLuint create_shader(std::string shader_path, GLenum type, const std::vector<std::string> &defines) {
+
+        std::string shader_src = read_shader_source(shader_path);
+        if (!defines.empty()) {
+            //#version has to stay the first line, #line keeps the line numbers of compile errors
+            std::size_t version_end = shader_src.find('\n') + 1;
+            std::string define_lines;
+            for (const std::string &define : defines) define_lines += "#define " + define + "\n";
+            shader_src.insert(version_end, define_lines + "#line 2\n");
+        }
         const char* shader_src_cstr = shader_src.c_str();
 
         unsigned shader = glCreateShader(type);
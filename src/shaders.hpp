@@ -2,12 +2,15 @@
 
 #include <cstddef>
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
 
 namespace Shaders {
 
-    GLuint create_shader(std::string path, GLenum type);
+    //defines are inserted as "#define <define>" lines after the #version line, so one source can be compiled into
+    //variants, e.g. {"BLOOM"} or {"N_LODS 3"}
+    GLuint create_shader(std::string path, GLenum type, const std::vector<std::string> &defines = {});
     GLuint link_shaders(GLuint *shaders, std::size_t n_shaders, std::string shader_name); 
 
 }
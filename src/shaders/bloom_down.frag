@@ -0,0 +1,52 @@
+#version 430 core
+
+//Bloom::MipChain, halves the image. The first level also keeps only the bright pixels of the HDR scene, and may shrink
+//it by more than half.
+
+out vec4 frag_color;
+
+in vec2 tex_coords;
+
+uniform sampler2D image;
+uniform bool threshold;
+//Scene texels per pixel along each axis of the thresholding pass, a power of 2 up to Bloom::max_first_divisor
+uniform int footprint;
+
+//Pixels brighter than 1 glow
+vec3 bright(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722)) > 1.0 ? color : vec3(0.0);
+}
+
+void main() {
+
+    vec3 result = vec3(0.0);
+
+    if (threshold) {
+        //The texels around this pixel's footprint, twice as wide, with tent weights (1 3 3 1 when halving, 1 3 5 7 7 5
+        //3 1 when quartering), thresholded one at a time, filtering first would dim single bright pixels below the
+        //threshold
+        ivec2 size = textureSize(image, 0);
+        ivec2 base = footprint*ivec2(gl_FragCoord.xy) - footprint/2;
+        for (int y = 0; y < 2*footprint; y++) {
+            float weight_y = float(footprint) - abs(float(y) - float(footprint) + 0.5);
+            for (int x = 0; x < 2*footprint; x++) {
+                float weight_x = float(footprint) - abs(float(x) - float(footprint) + 0.5);
+                ivec2 texel = clamp(base + ivec2(x, y), ivec2(0), size - 1);
+                result += bright(texelFetch(image, texel, 0).rgb)*weight_x*weight_y;
+            }
+        }
+        result /= float(footprint*footprint*footprint*footprint);
+    }
+    else {
+        //The same tent in four bilinear fetches, 0.75 texels out each sample weighs the texel pairs 1:3 and 3:1
+        vec2 offset = 0.75/textureSize(image, 0);
+        result += texture(image, tex_coords + vec2(-offset.x, -offset.y)).rgb;
+        result += texture(image, tex_coords + vec2( offset.x, -offset.y)).rgb;
+        result += texture(image, tex_coords + vec2(-offset.x,  offset.y)).rgb;
+        result += texture(image, tex_coords + vec2( offset.x,  offset.y)).rgb;
+        result /= 4.0;
+    }
+
+    frag_color = vec4(result, 1.0);
+
+}
@@ -0,0 +1,27 @@
+#version 430 core
+
+//Bloom::MipChain, blurs a level with a 3x3 tent while magnifying it onto the next larger one, which it's added to
+
+out vec4 frag_color;
+
+in vec2 tex_coords;
+
+uniform sampler2D image;
+
+void main() {
+
+    vec2 offset = 1.0/textureSize(image, 0);
+
+    vec3 result = texture(image, tex_coords).rgb*4.0;
+    result += texture(image, tex_coords + vec2(-offset.x, 0.0)).rgb*2.0;
+    result += texture(image, tex_coords + vec2( offset.x, 0.0)).rgb*2.0;
+    result += texture(image, tex_coords + vec2(0.0, -offset.y)).rgb*2.0;
+    result += texture(image, tex_coords + vec2(0.0,  offset.y)).rgb*2.0;
+    result += texture(image, tex_coords + vec2(-offset.x, -offset.y)).rgb;
+    result += texture(image, tex_coords + vec2( offset.x, -offset.y)).rgb;
+    result += texture(image, tex_coords + vec2(-offset.x,  offset.y)).rgb;
+    result += texture(image, tex_coords + vec2( offset.x,  offset.y)).rgb;
+
+    frag_color = vec4(result/16.0, 1.0);
+
+}
@@ -0,0 +1,51 @@
+#version 430 core
+
+//The final image in one pass: tone maps the HDR scene, adds the bloom and lays the gas haze over it. Compiled once per
+//combination of BLOOM and GAS, so a switched off effect costs neither a branch nor a texture read.
+
+out vec4 frag_color;
+
+in vec2 tex_coords;
+
+uniform sampler2D scene;
+uniform float exposure;
+
+#if defined(BLOOM) || defined(GAS)
+uniform sampler2D bloom_blur;
+//Brings the summed levels of the mip chain bloom back to the brightness of a single blur
+uniform float bloom_scale;
+#endif
+
+void main() {
+
+    const float gamma = 2.2;
+
+    vec4 scene_color = texture(scene, tex_coords);
+    vec3 hdr_color = scene_color.rgb;
+#if defined(BLOOM) || defined(GAS)
+    vec3 bloom_color = texture(bloom_blur, tex_coords).rgb*bloom_scale;
+#endif
+
+#ifdef BLOOM
+    hdr_color += bloom_color; // additive blending
+#endif
+    // tone mapping
+    vec3 result = vec3(1.0) - exp(-hdr_color * exposure);
+    // also gamma correct while we're at it
+    result = pow(result, vec3(1.0 / gamma));
+
+#ifdef GAS
+    //The gas is as thick as the bright stars are distant, other stars barely show it
+    float brightness = dot(scene_color.rgb, vec3(0.2126, 0.7152, 0.0722));
+    float gas_depth = brightness > 1.0 ? scene_color.a : min(scene_color.a, 1.0);
+
+    vec3 blue = vec3(0.4, 0.6, 1.0);
+    vec3 bloom_as_blue = blue*sqrt(length(bloom_color));
+
+    //Blended over the tone mapped image like a separate pass into the 8 bit screen would, which clamps the haze first
+    result = mix(result, clamp(bloom_as_blue, 0.0, 1.0), clamp(gas_depth/250.0, 0.0, 0.75));
+#endif
+
+    frag_color = vec4(result, 1.0);
+
+}
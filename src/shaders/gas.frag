@@ -1,24 +0,0 @@
-#version 430 core
-
-out vec4 frag_color;
-
-in vec2 tex_coords;
-
-uniform sampler2D bloom_blur;
-
-void main() {
-
-    //frag_color = vec4(0.f, 0.f, 0.f, 0.f);
-    //return;
-
-    vec4 bloom_color = texture(bloom_blur, tex_coords).rgba;
-
-    vec3 blue = vec3(0.4, 0.6, 1.0);
-    vec3 pink = vec3(1.0, 0.75, 0.8);
-
-    vec3 base_color = blue;
-    vec3 bloom_as_blue = base_color*sqrt(length(bloom_color.rgb));
-
-    frag_color = vec4(bloom_as_blue, clamp(bloom_color.a/250.0, 0.0, 0.75));
-
-}
@@ -0,0 +1,31 @@
+#version 430 core
+
+#include "star_output.glsl"
+
+uniform mat4 vp_mat;
+uniform vec3 cam_pos;
+
+flat in vec3 center;
+flat in float sphere_radius;
+flat in vec4 color;
+in vec3 quad_pos;
+
+//The hit is always behind the quad, so early depth testing against the quad's depth stays valid
+layout (depth_greater) out float gl_FragDepth;
+
+void main() {
+
+    vec3 ray = normalize(quad_pos - cam_pos);
+    vec3 oc = cam_pos - center;
+    float b = dot(oc, ray);
+    float c = dot(oc, oc) - sphere_radius*sphere_radius;
+    float h = b*b - c;
+    if (h < 0.0) discard;
+
+    vec3 hit = cam_pos + ray*(-b - sqrt(h));
+    vec4 hit_clip = vp_mat * vec4(hit, 1.0);
+    gl_FragDepth = 0.5*hit_clip.z/hit_clip.w + 0.5;
+
+    write_star_color(color);
+
+}
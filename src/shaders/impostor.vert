@@ -0,0 +1,53 @@
+#version 430 core
+
+//Sphere impostors, one camera facing quad per visible star drawn as an instanced 4 vertex triangle strip.
+//impostor.frag ray casts the sphere inside it.
+
+#define PARTICLE_ACCESS readonly
+#include "particle_layout.glsl"
+#include "star_shading.glsl"
+
+//From the visible list filled by star_cull.comp
+layout (location = 1) in uint particle_idx;
+
+uniform mat4 vp_mat;
+uniform vec3 cam_pos;
+
+flat out vec3 center;
+flat out float sphere_radius;
+flat out vec4 color;
+//World space position on the quad, the fragment's ray goes from cam_pos through it
+out vec3 quad_pos;
+
+//Strip order, counter clockwise seen from the camera
+const vec2 corners[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+void main() {
+
+    vec4 particle = particle_positions[particle_idx];
+    float cam_dist = distance(particle.xyz, cam_pos);
+
+    center = particle.xyz;
+    sphere_radius = displayed_radius(particle.w, cam_dist);
+    color = star_color(particle_idx, cam_dist);
+
+    //Inside the sphere there's no silhouette to draw, move the quad out of the clip volume
+    if (cam_dist <= sphere_radius) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    vec3 dir = (particle.xyz - cam_pos)/cam_dist;
+    vec3 right = normalize(cross(dir, abs(dir.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 up = cross(right, dir);
+
+    //The quad lies in the plane touching the front of the sphere and is just large enough to hold the cone of
+    //rays tangent to it. The whole sphere is behind the plane, so the depth written by the fragment shader is never
+    //less than the quad's own.
+    float front_dist = cam_dist - sphere_radius;
+    float half_size = front_dist*sphere_radius/sqrt(cam_dist*cam_dist - sphere_radius*sphere_radius);
+
+    quad_pos = cam_pos + dir*front_dist + (right*corners[gl_VertexID].x + up*corners[gl_VertexID].y)*half_size;
+    gl_Position = vp_mat * vec4(quad_pos, 1.0);
+
+}
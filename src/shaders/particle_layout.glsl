@@ -0,0 +1,28 @@
+//Shared particle buffer layout, mirrored on the host by particle_layout.hpp.
+//Define PARTICLE_ACCESS (e.g. as readonly) before including this file to qualify the buffers.
+
+#ifndef PARTICLE_ACCESS
+#define PARTICLE_ACCESS
+#endif
+
+//Must match Star::n_star_colors
+#define N_STAR_TYPES 6
+
+struct ParticleInfo {
+    float lighting;
+    uint type_idx;
+};
+
+//xyz = position, w = radius
+layout (std430, binding=0) PARTICLE_ACCESS buffer particle_positions_buffer {
+    vec4 particle_positions[];
+};
+
+//xyz = velocity, w = mass
+layout (std430, binding=1) PARTICLE_ACCESS buffer particle_velocities_buffer {
+    vec4 particle_velocities[];
+};
+
+layout (std430, binding=2) PARTICLE_ACCESS buffer particle_info_buffer {
+    ParticleInfo particle_info[];
+};
@@ -0,0 +1,68 @@
+//GLSL port of the RandomNum::Philox stream in random.cpp. It draws numbers in exactly the same order,
+//so a stream seeded the same way produces the same values up to the precision of log/sin/cos.
+
+struct Philox {
+    uvec2 key;
+    uvec4 counter;
+    uvec4 block;
+    uint block_idx;
+    float spare_gaus;
+    bool has_spare_gaus;
+};
+
+uvec4 philox4x32(uvec4 counter, uvec2 key) {
+    for (int round = 0; round < 10; round++) {
+        uint hi0, lo0, hi1, lo1;
+        umulExtended(0xD2511F53u, counter.x, hi0, lo0);
+        umulExtended(0xCD9E8D57u, counter.z, hi1, lo1);
+        counter = uvec4(hi1^counter.y^key.x, lo1, hi0^counter.w^key.y, lo0);
+        key += uvec2(0x9E3779B9u, 0xBB67AE85u);
+    }
+    return counter;
+}
+
+Philox philox_init(uvec2 seed, uint stream) {
+    Philox rng;
+    rng.key = seed;
+    rng.counter = uvec4(0u, 0u, stream, 0u);
+    rng.block = uvec4(0u);
+    rng.block_idx = 4u;
+    rng.spare_gaus = 0.0;
+    rng.has_spare_gaus = false;
+    return rng;
+}
+
+float u32_to_float(uint x) {
+    return float(x >> 8) * (1.0/16777216.0);
+}
+
+uint next_u32(inout Philox rng) {
+    if (rng.block_idx == 4u) {
+        rng.block = philox4x32(rng.counter, rng.key);
+        rng.block_idx = 0u;
+        rng.counter.x++;
+        if (rng.counter.x == 0u) rng.counter.y++;
+    }
+    return rng.block[rng.block_idx++];
+}
+
+float random_float(inout Philox rng, float a, float b) {
+    return a + u32_to_float(next_u32(rng))*(b - a);
+}
+
+float gaus_rand(inout Philox rng, float mean, float stddev) {
+
+    if (rng.has_spare_gaus) {
+        rng.has_spare_gaus = false;
+        return rng.spare_gaus*stddev+mean;
+    }
+
+    float u = 1.0 - u32_to_float(next_u32(rng));
+    float v = u32_to_float(next_u32(rng));
+    float r = sqrt(-2.0*log(u));
+    rng.spare_gaus = r*sin(2.0*3.141592*v);
+    rng.has_spare_gaus = true;
+
+    return r*cos(2.0*3.141592*v)*stddev+mean;
+
+}
@@ -0,0 +1,17 @@
+#version 430 core
+
+#include "star_output.glsl"
+
+flat in vec3 color;
+flat in float cam_dist;
+in vec2 kernel_pos;
+
+void main() {
+
+    float r2 = dot(kernel_pos, kernel_pos);
+    if (r2 >= 1.0) discard;
+
+    float weight = (1.0 - r2)*(1.0 - r2);
+    write_star_color(vec4(color*weight, cam_dist));
+
+}
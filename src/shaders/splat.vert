@@ -0,0 +1,42 @@
+#version 430 core
+
+//Splats of distant stars, one camera facing quad per occupied cell of splat_cells.glsl drawn as an instanced 4
+//vertex triangle strip. splat.frag spreads the cell's summed light over it with a smooth kernel.
+
+#include "splat_cells.glsl"
+
+uniform mat4 vp_mat;
+uniform vec3 cam_pos;
+//Pixels covered by something 1 unit wide at distance 1
+uniform float projection_scale;
+
+//Color at the kernel's center, the kernel integrates to the cell's summed light
+flat out vec3 color;
+flat out float cam_dist;
+//Position in the kernel, the kernel ends at length 1
+out vec2 kernel_pos;
+
+//Strip order, counter clockwise seen from the camera
+const vec2 corners[4] = vec2[4](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+void main() {
+
+    SplatCell cell = splat_cells[splat_list[gl_InstanceID]];
+
+    //The kernel reaches a cell width out from the cell's center, so neighbouring cells blend into each other
+    float size = splat_cell_size(cell.level);
+    vec3 center = (vec3(cell.x, cell.y, cell.z) + 0.5)*size;
+    cam_dist = distance(center, cam_pos);
+
+    //(1 - r^2)^2 integrates to pi/3 over the unit disk
+    float pixel_radius = size*projection_scale/cam_dist;
+    color = vec3(cell.flux_r, cell.flux_g, cell.flux_b)/(FLUX_SCALE*PI/3.0*pixel_radius*pixel_radius);
+
+    vec3 dir = (center - cam_pos)/cam_dist;
+    vec3 right = normalize(cross(dir, abs(dir.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 up = cross(right, dir);
+
+    kernel_pos = corners[gl_VertexID];
+    gl_Position = vp_mat * vec4(center + (right*kernel_pos.x + up*kernel_pos.y)*size, 1.0);
+
+}
@@ -0,0 +1,68 @@
+//Grid hierarchy the distant stars are summed into by star_cull.comp and drawn from by splat.vert.
+//Level l cuts space into cubes BASE_CELL_SIZE*2^l wide, a star goes into the coarsest level whose cells are still
+//no wider on screen than the splat size. The occupied cells live in a hash table of buckets with SLOTS_PER_BUCKET
+//slots each, the key is mixed by a bijection so the bucket and the tag stored in the slot identify the cell exactly.
+
+//Must match StarCulling::splat_base_cell_size, StarCulling::max_splat_level and StarCulling::slots_per_bucket
+#define BASE_CELL_SIZE 0.25
+#define MAX_SPLAT_LEVEL 15
+#define SLOTS_PER_BUCKET 8u
+
+#define PI 3.1415926535897932
+
+//Summed colors are kept as fixed point so they can be added with integer atomics, saturating at 2^32-1
+#define FLUX_SCALE 4096.0
+
+//Must match StarCulling::Culler::SplatCell
+struct SplatCell {
+    //0 while the slot is free
+    uint tag;
+    uint level;
+    //Cell coordinates, the cell spans coords*size to (coords+1)*size
+    int x;
+    int y;
+    int z;
+    //Sum of color*area on screen in pixels of the stars in the cell, times FLUX_SCALE
+    uint flux_r;
+    uint flux_g;
+    uint flux_b;
+};
+
+layout (std430, binding = 8) buffer splat_cells_buffer {
+    SplatCell splat_cells[];
+};
+
+//Occupied slots in the order they were claimed, splat.vert draws one quad per entry
+layout (std430, binding = 9) buffer splat_list_buffer {
+    uint splat_list[];
+};
+
+float splat_cell_size(uint level) {
+    return BASE_CELL_SIZE*float(1u << level);
+}
+
+uint splat_mix(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+//Splits the cell's 43 bit key (4 bits of level, 13 of each coordinate) into a bucket and a tag. The coordinates
+//wrap around every 8192 cells, but the cells of one level all lie at a similar distance from the camera, far fewer
+//than 4096 cells away at any sensible splat size, so no two cells of a frame share a key. The key is run through a
+//4 round Feistel network, which is a bijection, and bucket_bits of the result pick the bucket. The remaining bits
+//plus one (so never 0) are the tag, they fit 32 bits since there are at least 2^12 buckets.
+void splat_key(uint level, ivec3 coords, uint bucket_bits, out uint bucket, out uint tag) {
+    uvec3 c = uvec3(coords) & 0x1fffu;
+    uint l = (level << 18) | (c.x << 5) | (c.y >> 8);
+    uint r = ((c.y & 0xffu) << 13) | c.z;
+    l ^= splat_mix(r ^ 0x9e3779b9u) & 0x3fffffu;
+    r ^= splat_mix(l ^ 0x85ebca6bu) & 0x1fffffu;
+    l ^= splat_mix(r ^ 0xc2b2ae35u) & 0x3fffffu;
+    r ^= splat_mix(l ^ 0x27d4eb2fu) & 0x1fffffu;
+    bucket = r & ((1u << bucket_bits) - 1u);
+    tag = ((l << (21u - bucket_bits)) | (r >> bucket_bits)) + 1u;
+}
@@ -0,0 +1,8 @@
+//The HDR scene target of hdr_fbo, written by both star paths and the splats. The alpha channel holds the distance
+//from the camera, the bright pixels are picked out later by the bloom.
+
+layout (location=0) out vec4 frag_color;
+
+void write_star_color(vec4 color) {
+    frag_color = color;
+}
@@ -0,0 +1,16 @@
+//Everything about a star's appearance that the mesh and impostor paths share.
+//Include after particle_layout.glsl.
+
+//Normalized star colors, indexed by ParticleInfo.type_idx
+uniform vec3 star_colors[N_STAR_TYPES];
+
+//Distant stars are drawn up to 10 times smaller than their radius, so they don't fill the screen
+float displayed_radius(float radius, float cam_dist) {
+    return clamp(radius * cam_dist/250.0, radius/10.0, radius);
+}
+
+//The alpha component holds the distance from the camera to the star, the gas pass reads it from the bloom texture
+vec4 star_color(uint i, float cam_dist) {
+    ParticleInfo info = particle_info[i];
+    return vec4(star_colors[info.type_idx]*info.lighting, cam_dist);
+}
@@ -1,22 +1,12 @@
 #version 430 core
 
 layout (location = 0) in vec3 v;
+//StarCulling instance lists, an instanced attribute so the draw's base instance picks the list
+layout (location = 1) in uint particle_idx;
 
-layout (std430, binding=0) readonly buffer particle_positions_buffer {
-    vec4 particle_positions[];
-};
-
-layout (std430, binding=1) readonly buffer particle_lighting_buffer {
-    float particle_lighting[];
-};
-
-layout (std430, binding=3) readonly buffer particle_base_colors_buffer {
-    vec4 particle_base_colors[];
-};
-
-layout (std430, binding=4) readonly buffer particle_radii_buffer {
-    float particle_radii[];
-};
+#define PARTICLE_ACCESS readonly
+#include "particle_layout.glsl"
+#include "star_shading.glsl"
 
 uniform mat4 vp_mat;
 uniform vec3 cam_pos;
@@ -24,12 +14,12 @@ uniform vec3 cam_pos;
 out vec4 color;
 
 void main() {
-    float cam_dist = distance(particle_positions[gl_InstanceID].xyz, cam_pos.xyz);
-    vec3 true_v = v * clamp(particle_radii[gl_InstanceID] * cam_dist/250.0, particle_radii[gl_InstanceID]/10.0, particle_radii[gl_InstanceID]);
+    float radius = particle_positions[particle_idx].w;
+    float cam_dist = distance(particle_positions[particle_idx].xyz, cam_pos.xyz);
+    vec3 true_v = v * displayed_radius(radius, cam_dist);
 
-    vec4 final_pos = vp_mat * vec4(particle_positions[gl_InstanceID].xyz + true_v.xyz, 1.0);
+    vec4 final_pos = vp_mat * vec4(particle_positions[particle_idx].xyz + true_v.xyz, 1.0);
     gl_Position = final_pos;
 
-    vec4 base_color = particle_base_colors[gl_InstanceID];
-    color = vec4(base_color.xyz*particle_lighting[gl_InstanceID], cam_dist);  //The alpha component will contain the distance from the camera to the particle
+    color = star_color(particle_idx, cam_dist);
 }
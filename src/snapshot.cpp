@@ -0,0 +1,277 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "particle_file.hpp"
+#include "snapshot.hpp"
+
+namespace {
+
+    constexpr char raw_magic[8] = {'G', 'S', 'I', 'M', 'S', 'N', 'A', 'P'};
+    constexpr std::uint32_t raw_format_version = 1;
+
+    struct RawHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t endian_marker;
+        std::uint64_t step;
+        double sim_time;
+        std::uint64_t n_particles;
+        std::uint64_t positions_offset;
+    };
+
+    typedef std::chrono::high_resolution_clock Clock;
+
+}
+
+namespace Snapshot {
+
+    Sink raw_sink(const std::string &folder) {
+        return [folder](const Frame &frame) {
+
+            RawHeader header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, raw_magic, sizeof(raw_magic));
+            header.version = raw_format_version;
+            header.endian_marker = ParticleFile::endian_marker;
+            header.step = frame.step;
+            header.sim_time = frame.sim_time;
+            header.n_particles = frame.n_particles;
+            header.positions_offset = ParticleFile::align_up(sizeof(RawHeader));
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "snap_%010llu.bin", static_cast<unsigned long long>(frame.step));
+
+            ParticleFile::write_atomically(folder + name, [&](std::FILE *file, const std::string &tmp_path) {
+                ParticleFile::write_or_throw(file, &header, sizeof(header), tmp_path);
+                ParticleFile::pad_to(file, header.positions_offset, tmp_path);
+                ParticleFile::write_or_throw(file, frame.positions, frame.n_particles*sizeof(glm::vec4), tmp_path);
+            });
+
+        };
+    }
+
+    Pipeline::Pipeline(std::size_t n_particles, Sink sink) :
+        n_particles(n_particles), sink(std::move(sink)), persistent_mapping(GLAD_GL_VERSION_4_4), slots(new Slot[ring_size]) {
+
+        std::size_t size = n_particles*sizeof(glm::vec4);
+        if (size == 0) size = sizeof(glm::vec4);
+
+        for (std::size_t i = 0; i < ring_size; i++) {
+            Slot &slot = slots[i];
+            glGenBuffers(1, &slot.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            if (persistent_mapping) {
+                GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, flags);
+                slot.mapped = static_cast<glm::vec4*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+                if (slot.mapped == nullptr) {
+                    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                    throw std::runtime_error("Error: Failed to persistently map a snapshot buffer\n");
+                }
+            }
+            else {
+                glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_READ);
+            }
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        io_thread = std::thread(&Pipeline::io_loop, this);
+
+    }
+
+    Pipeline::~Pipeline() {
+        //Only stops the thread, the buffers go away with the GL context
+        stop_io_thread();
+    }
+
+    void Pipeline::stop_io_thread() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            stop = true;
+        }
+        wake_io.notify_one();
+        if (io_thread.joinable()) io_thread.join();
+    }
+
+    void Pipeline::io_loop() {
+        for (;;) {
+            std::size_t slot_idx;
+            if (ready.pop(slot_idx)) {
+                Slot &slot = slots[slot_idx];
+                try {
+                    sink(Frame{slot.step, slot.sim_time, n_particles, slot.mapped});
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(error_mutex);
+                    if (!io_error) io_error = std::current_exception();
+                }
+                slot.written.store(true, std::memory_order_release);
+            }
+            else {
+                std::unique_lock<std::mutex> lock(wake_mutex);
+                wake_io.wait(lock, [&]() { return stop || !ready.empty(); });
+                if (stop && ready.empty()) return;
+            }
+        }
+    }
+
+    bool Pipeline::capture(GLuint positions, std::uint64_t step, double sim_time) {
+
+        Clock::time_point start = Clock::now();
+
+        reclaim_written();
+
+        Slot *slot = nullptr;
+        std::size_t slot_idx = 0;
+        for (; slot_idx < ring_size; slot_idx++) {
+            if (!slots[slot_idx].in_use) {
+                slot = &slots[slot_idx];
+                break;
+            }
+        }
+
+        if (slot == nullptr) {
+            statistics.dropped++;
+            statistics.render_thread_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+            return false;
+        }
+
+        slot->in_use = true;
+        slot->written.store(false, std::memory_order_relaxed);
+        slot->step = step;
+        slot->sim_time = sim_time;
+
+        //The physics shader writes the positions through an SSBO
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, positions);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slot->buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, n_particles*sizeof(glm::vec4));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        //poll() checks the fence without flushing, so it's sent on here. Headless runs have no swap that would.
+        slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        copying.push_back(slot_idx);
+
+        statistics.captured++;
+        statistics.render_thread_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+        return true;
+
+    }
+
+    void Pipeline::hand_over(std::size_t slot_idx) {
+
+        Slot &slot = slots[slot_idx];
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        if (!persistent_mapping) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+            slot.mapped = static_cast<glm::vec4*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, n_particles*sizeof(glm::vec4), GL_MAP_READ_BIT));
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            if (slot.mapped == nullptr) {
+                slot.in_use = false;
+                throw std::runtime_error("Error: Failed to map a snapshot buffer\n");
+            }
+        }
+
+        //Can't fail, there are never more slots in flight than the queue holds
+        ready.push(slot_idx);
+        //Passing through the lock keeps the notify from landing between the I/O thread's check and its wait
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+        }
+        wake_io.notify_one();
+
+    }
+
+    void Pipeline::reclaim_written() {
+        for (std::size_t i = 0; i < ring_size; i++) {
+            Slot &slot = slots[i];
+            if (!slot.in_use || !slot.written.load(std::memory_order_acquire)) continue;
+            if (!persistent_mapping) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+                slot.mapped = nullptr;
+            }
+            slot.in_use = false;
+            statistics.written++;
+        }
+    }
+
+    void Pipeline::rethrow_io_error() {
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            std::swap(error, io_error);
+        }
+        if (error) std::rethrow_exception(error);
+    }
+
+    void Pipeline::poll() {
+
+        Clock::time_point start = Clock::now();
+
+        //Copies finish in submission order, so the first unsignaled fence ends the scan
+        while (!copying.empty()) {
+            GLenum status = glClientWaitSync(slots[copying.front()].fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED) break;
+            std::size_t slot_idx = copying.front();
+            copying.pop_front();
+            if (status == GL_WAIT_FAILED) {
+                glDeleteSync(slots[slot_idx].fence);
+                slots[slot_idx].fence = 0;
+                slots[slot_idx].in_use = false;
+                statistics.render_thread_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+                throw std::runtime_error("Error: Waiting for a snapshot copy failed\n");
+            }
+            hand_over(slot_idx);
+        }
+
+        reclaim_written();
+
+        statistics.render_thread_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+        rethrow_io_error();
+
+    }
+
+    void Pipeline::finish() {
+
+        while (!copying.empty()) {
+            std::size_t slot_idx = copying.front();
+            GLenum status;
+            do {
+                status = glClientWaitSync(slots[slot_idx].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            copying.pop_front();
+            if (status == GL_WAIT_FAILED) {
+                glDeleteSync(slots[slot_idx].fence);
+                slots[slot_idx].fence = 0;
+                slots[slot_idx].in_use = false;
+                continue;
+            }
+            hand_over(slot_idx);
+        }
+
+        for (;;) {
+            reclaim_written();
+            bool busy = false;
+            for (std::size_t i = 0; i < ring_size; i++) busy |= slots[i].in_use;
+            if (!busy) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        stop_io_thread();
+
+        rethrow_io_error();
+
+    }
+
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "spsc_queue.hpp"
+
+//Trajectory output. Snapshots of the particle positions are copied on the GPU into a ring of persistently mapped
+//buffers, fences are polled once per frame without blocking and finished copies are handed to an I/O thread through
+//a lock-free queue, so the render loop never waits for a readback.
+namespace Snapshot {
+
+    struct Frame {
+        std::uint64_t step;
+        double sim_time;
+        std::size_t n_particles;
+        //Same layout as the positions SSBO, xyz = position, w = radius
+        const glm::vec4 *positions;
+    };
+
+    //Called on the I/O thread for every captured frame, in step order. The positions are only valid during the call.
+    typedef std::function<void(const Frame&)> Sink;
+
+    //Writes every frame to its own file in folder, a small header followed by the raw positions
+    Sink raw_sink(const std::string &folder);
+
+    class Pipeline {
+    public:
+
+        //Frames that can be in flight at once, captures are dropped while all of them are busy
+        static constexpr std::size_t ring_size = 4;
+
+        struct Stats {
+            std::uint64_t captured = 0;
+            std::uint64_t dropped = 0;
+            std::uint64_t written = 0;
+            //Time spent in capture() and poll() on the render thread
+            double render_thread_seconds = 0.0;
+        };
+
+        //Persistent mapping needs GL 4.4, older contexts map each slot once its copy is done instead
+        Pipeline(std::size_t n_particles, Sink sink);
+        ~Pipeline();
+
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+
+        //Queues a copy of the positions buffer. Returns false and drops the frame if every slot is busy.
+        bool capture(GLuint positions, std::uint64_t step, double sim_time);
+
+        //Call once per frame from the GL thread. Never blocks. Rethrows errors from the sink.
+        void poll();
+
+        //Waits until every captured frame has gone through the sink and stops the I/O thread. Has to be called
+        //before the GL context goes away.
+        void finish();
+
+        const Stats& stats() const { return statistics; }
+        bool persistent() const { return persistent_mapping; }
+
+    private:
+
+        struct Slot {
+            GLuint buffer = 0;
+            glm::vec4 *mapped = nullptr;
+            GLsync fence = 0;
+            std::uint64_t step = 0;
+            double sim_time = 0.0;
+            //Owned by the render thread, set from capture() until the slot has been written
+            bool in_use = false;
+            //Set by the I/O thread once the sink is done with the slot
+            std::atomic<bool> written{false};
+        };
+
+        void io_loop();
+        void hand_over(std::size_t slot_idx);
+        void stop_io_thread();
+        void reclaim_written();
+        void rethrow_io_error();
+
+        std::size_t n_particles;
+        Sink sink;
+        bool persistent_mapping;
+
+        std::unique_ptr<Slot[]> slots;
+        //Slots with a pending fence, oldest first
+        std::deque<std::size_t> copying;
+
+        SpscQueue<std::size_t, ring_size> ready;
+        //The I/O thread sleeps on wake_io while the queue is empty, the queue itself stays lock-free
+        std::mutex wake_mutex;
+        std::condition_variable wake_io;
+        bool stop = false;
+        std::thread io_thread;
+
+        std::mutex error_mutex;
+        std::exception_ptr io_error;
+
+        Stats statistics;
+
+    };
+
+}
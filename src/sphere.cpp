@@ -1,5 +1,8 @@
-#include <vector>
+#include <array>
 #include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
 
 #include "sphere.hpp"
 
@@ -7,40 +10,88 @@ constexpr float deg_to_rad = 0.0174532925;
 
 namespace Sphere {
 
-    std::vector<float> sphere_vertices(unsigned rings, unsigned slices, float radius) {
+    Mesh uv_sphere(unsigned rings, unsigned slices, float radius) {
 
-        std::vector<float> vertices;
+        Mesh mesh;
 
-        for (unsigned i = 0; i < (rings+2); i++) {
+        for (unsigned i = 0; i < rings+2; i++) {
+            float latitude = deg_to_rad*(270.f+(180.f/(rings+1))*i);
             for (unsigned j = 0; j < slices; j++) {
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*i))*std::sin(deg_to_rad*(360.f*j/slices)) * radius);
-                vertices.push_back(std::sin(deg_to_rad*(270.f+(180.f/(rings+1))*i)) * radius);
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*i))*std::cos(deg_to_rad*(360.f*j/slices)) * radius);
-
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1)))*std::sin(deg_to_rad*(360.f*(j+1)/slices)) * radius);
-                vertices.push_back(std::sin(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1))) * radius);
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1)))*std::cos(deg_to_rad*(360.f*(j+1)/slices)) * radius);
-                
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1)))*std::sin(deg_to_rad*(360.f*j/slices)) * radius);
-                vertices.push_back(std::sin(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1))) * radius);
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1)))*std::cos(deg_to_rad*(360.f*j/slices)) * radius);
-
-
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*i))*std::sin(deg_to_rad*(360.f*j/slices)) * radius);
-                vertices.push_back(std::sin(deg_to_rad*(270.f+(180.f/(rings+1))*i)) * radius);
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*i))*std::cos(deg_to_rad*(360.f*j/slices)) * radius);
-                
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*i))*std::sin(deg_to_rad*(360.f*(j+1)/slices)) * radius);
-                vertices.push_back(std::sin(deg_to_rad*(270.f+(180.f/(rings+1))*i)) * radius);
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*i))*std::cos(deg_to_rad*(360.f*(j+1)/slices)) * radius);
-
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1)))*std::sin(deg_to_rad*(360.f*(j+1)/slices)) * radius);
-                vertices.push_back(std::sin(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1))) * radius);
-                vertices.push_back(std::cos(deg_to_rad*(270.f+(180.f/(rings+1))*(i+1)))*std::cos(deg_to_rad*(360.f*(j+1)/slices)) * radius);
+                float longitude = deg_to_rad*(360.f*j/slices);
+                mesh.vertices.push_back(std::cos(latitude)*std::sin(longitude) * radius);
+                mesh.vertices.push_back(std::sin(latitude) * radius);
+                mesh.vertices.push_back(std::cos(latitude)*std::cos(longitude) * radius);
+            }
+        }
+
+        auto vertex = [&](unsigned i, unsigned j) { return static_cast<std::uint32_t>(i*slices + j % slices); };
+
+        //The first and last circles collapse into the poles, the triangles with two corners on them are left out
+        for (unsigned i = 0; i < rings+1; i++) {
+            for (unsigned j = 0; j < slices; j++) {
+                if (i != rings) mesh.indices.insert(mesh.indices.end(), {vertex(i, j), vertex(i+1, j+1), vertex(i+1, j)});
+                if (i != 0) mesh.indices.insert(mesh.indices.end(), {vertex(i, j), vertex(i, j+1), vertex(i+1, j+1)});
+            }
+        }
+
+        return mesh;
+
+    }
+
+    Mesh icosphere(unsigned subdivisions, float radius) {
+
+        const float t = (1.f + std::sqrt(5.f))/2.f;
+
+        std::vector<std::array<float, 3>> positions = {
+            {{-1.f, t, 0.f}}, {{1.f, t, 0.f}}, {{-1.f, -t, 0.f}}, {{1.f, -t, 0.f}},
+            {{0.f, -1.f, t}}, {{0.f, 1.f, t}}, {{0.f, -1.f, -t}}, {{0.f, 1.f, -t}},
+            {{t, 0.f, -1.f}}, {{t, 0.f, 1.f}}, {{-t, 0.f, -1.f}}, {{-t, 0.f, 1.f}},
+        };
+
+        std::vector<std::uint32_t> indices = {
+            0, 11, 5,   0, 5, 1,    0, 1, 7,    0, 7, 10,   0, 10, 11,
+            1, 5, 9,    5, 11, 4,   11, 10, 2,  10, 7, 6,   7, 1, 8,
+            3, 9, 4,    3, 4, 2,    3, 2, 6,    3, 6, 8,    3, 8, 9,
+            4, 9, 5,    2, 4, 11,   6, 2, 10,   8, 6, 7,    9, 8, 1,
+        };
+
+        auto normalize = [](std::array<float, 3> p) {
+            float length = std::sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+            return std::array<float, 3>{{p[0]/length, p[1]/length, p[2]/length}};
+        };
+        for (std::array<float, 3> &p : positions) p = normalize(p);
+
+        for (unsigned s = 0; s < subdivisions; s++) {
+
+            //Every edge is shared by two triangles, its midpoint is only added once
+            std::map<std::pair<std::uint32_t, std::uint32_t>, std::uint32_t> midpoints;
+            auto midpoint = [&](std::uint32_t a, std::uint32_t b) {
+                auto key = std::make_pair(std::min(a, b), std::max(a, b));
+                auto it = midpoints.find(key);
+                if (it != midpoints.end()) return it->second;
+                const std::array<float, 3> &pa = positions[a], &pb = positions[b];
+                positions.push_back(normalize({{pa[0]+pb[0], pa[1]+pb[1], pa[2]+pb[2]}}));
+                std::uint32_t idx = static_cast<std::uint32_t>(positions.size() - 1);
+                midpoints[key] = idx;
+                return idx;
+            };
+
+            std::vector<std::uint32_t> split;
+            for (std::size_t i = 0; i < indices.size(); i += 3) {
+                std::uint32_t a = indices[i], b = indices[i+1], c = indices[i+2];
+                std::uint32_t ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+                split.insert(split.end(), {a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca});
             }
+            indices.swap(split);
+
         }
 
-        return vertices;
+        Mesh mesh;
+        for (const std::array<float, 3> &p : positions)
+            mesh.vertices.insert(mesh.vertices.end(), {p[0]*radius, p[1]*radius, p[2]*radius});
+        mesh.indices = std::move(indices);
+
+        return mesh;
 
     }
 
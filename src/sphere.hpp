@@ -1,9 +1,20 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 namespace Sphere {
 
-    std::vector<float> sphere_vertices(unsigned rings, unsigned slices, float radius);
+    //Indexed triangle mesh, xyz per vertex, counter clockwise seen from outside
+    struct Mesh {
+        std::vector<float> vertices;
+        std::vector<std::uint32_t> indices;
+    };
+
+    //Latitude/longitude sphere, slices vertices on each of rings+2 circles from pole to pole (both poles included)
+    Mesh uv_sphere(unsigned rings, unsigned slices, float radius);
+
+    //Icosahedron with every triangle split into 4 subdivisions times, new vertices are pushed out onto the sphere
+    Mesh icosphere(unsigned subdivisions, float radius);
 
 }
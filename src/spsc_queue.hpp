@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+//Bounded lock-free queue for exactly one producer thread and one consumer thread
+template<typename T, std::size_t Capacity>
+class SpscQueue {
+
+    static_assert(Capacity > 0 && (Capacity & (Capacity-1)) == 0, "SpscQueue capacity has to be a power of 2");
+
+public:
+
+    //Producer side, returns false if the queue is full
+    bool push(const T &value) {
+        std::size_t tail = write_idx.load(std::memory_order_relaxed);
+        if (tail - read_idx.load(std::memory_order_acquire) == Capacity) return false;
+        slots[tail & (Capacity-1)] = value;
+        write_idx.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    //Consumer side, returns false if the queue is empty
+    bool pop(T &value) {
+        std::size_t head = read_idx.load(std::memory_order_relaxed);
+        if (head == write_idx.load(std::memory_order_acquire)) return false;
+        value = slots[head & (Capacity-1)];
+        read_idx.store(head+1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return read_idx.load(std::memory_order_acquire) == write_idx.load(std::memory_order_acquire);
+    }
+
+private:
+
+    //On separate cache lines so the two threads don't fight over one
+    alignas(64) std::atomic<std::size_t> read_idx{0};
+    alignas(64) std::atomic<std::size_t> write_idx{0};
+    alignas(64) T slots[Capacity];
+
+};
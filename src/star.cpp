@@ -52,11 +52,11 @@ namespace Star {
         0.13f,
     };
     
-    std::size_t rand_star_type_idx() {
+    std::size_t rand_star_type_idx(RandomNum::Philox &rng) {
 
-        //return std::round(RandomNum::random_float(0.f, n_star_colors-1));
+        //return std::round(rng.random_float(0.f, n_star_colors-1));
 
-        float rand_val = RandomNum::random_float(0.f, 100.f);
+        float rand_val = rng.random_float(0.f, 100.f);
 
         for (std::size_t i = 0; i < n_star_colors; i++) {
             if (is_in_range(0.f, star_probabilities[i], rand_val)) return i;
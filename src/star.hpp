@@ -3,6 +3,8 @@
 #include <array>
 #include <glm/glm.hpp>
 
+#include "random.hpp"
+
 namespace Star {
 
     constexpr std::size_t n_star_colors = 6;
@@ -10,6 +12,6 @@ namespace Star {
     extern std::array<float, n_star_colors> star_size_mults;
     extern std::array<float, n_star_colors> star_probabilities;
 
-    std::size_t rand_star_type_idx();
+    std::size_t rand_star_type_idx(RandomNum::Philox &rng);
 
 }
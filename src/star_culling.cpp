@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "gpu_particles.hpp"
+#include "sphere.hpp"
+#include "star_culling.hpp"
+
+namespace {
+
+    //Must match the local size in star_cull.comp
+    constexpr std::size_t local_size_x = 64;
+
+    //The six planes bounding the clip volume of vp_mat in world space (Gribb/Hartmann), normals pointing inwards
+    //and normalized, so a point's signed distance to a plane is dot(plane.xyz, point) + plane.w
+    std::array<glm::vec4, 6> frustum_planes(const glm::mat4 &vp_mat) {
+        std::array<glm::vec4, 6> planes;
+        for (int axis = 0; axis < 3; axis++) {
+            for (int side = 0; side < 2; side++) {
+                glm::vec4 &plane = planes[2*axis + side];
+                float sign = side == 0 ? 1.f : -1.f;
+                for (int c = 0; c < 4; c++) plane[c] = vp_mat[c][3] + sign*vp_mat[c][axis];
+                float length = std::sqrt(plane[0]*plane[0] + plane[1]*plane[1] + plane[2]*plane[2]);
+                for (int c = 0; c < 4; c++) plane[c] /= length;
+            }
+        }
+        return planes;
+    }
+
+}
+
+namespace StarCulling {
+
+    Culler::Culler(std::size_t n_particles, float min_pixel_radius, float splat_pixels) :
+        n_particles(n_particles), min_radius(min_pixel_radius), splat_size(splat_pixels) {
+
+        std::array<Sphere::Mesh, n_lods> meshes = {{
+            Sphere::icosphere(0, 1.f),
+            Sphere::icosphere(1, 1.f),
+            Sphere::uv_sphere(10, 10, 1.f),
+        }};
+
+        //All levels share one vertex and one index buffer, the commands pick out their ranges
+        std::vector<float> vertices;
+        std::vector<std::uint32_t> indices;
+        for (std::size_t lod = 0; lod < n_lods; lod++) {
+            const Sphere::Mesh &mesh = meshes[lod];
+            commands.lods[lod].count = static_cast<GLuint>(mesh.indices.size());
+            commands.lods[lod].instance_count = 0;
+            commands.lods[lod].first_index = static_cast<GLuint>(indices.size());
+            commands.lods[lod].base_vertex = static_cast<GLint>(vertices.size()/3);
+            commands.lods[lod].base_instance = static_cast<GLuint>(lod*n_particles);
+            lod_vertices[lod] = mesh.vertices.size()/3;
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+
+        //The impostors reuse the first list, their quads are built from gl_VertexID
+        commands.impostors.count = 4;
+        commands.impostors.instance_count = 0;
+        commands.impostors.first = 0;
+        commands.impostors.base_instance = 0;
+
+        //The splat list holds cells, not stars, so it has a buffer of its own starting at instance 0
+        commands.splats.count = 4;
+        commands.splats.instance_count = 0;
+        commands.splats.first = 0;
+        commands.splats.base_instance = 0;
+        commands.splatted_stars = 0;
+
+        //Written by the compute pass as an SSBO, read by the draws as an instanced attribute
+        glGenBuffers(1, &instance_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, std::max<std::size_t>(n_lods*n_particles, 1)*sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+        glGenVertexArrays(1, &mesh_vao);
+        glBindVertexArray(mesh_vao);
+
+        glVertexAttribIPointer(particle_idx_location, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(particle_idx_location, 1);
+        glEnableVertexAttribArray(particle_idx_location);
+
+        glGenBuffers(1, &vertex_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size()*sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glGenBuffers(1, &index_buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(std::uint32_t), indices.data(), GL_STATIC_DRAW);
+
+        glGenVertexArrays(1, &impostor_vao);
+        glBindVertexArray(impostor_vao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+        glVertexAttribIPointer(particle_idx_location, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void*)0);
+        glVertexAttribDivisor(particle_idx_location, 1);
+        glEnableVertexAttribArray(particle_idx_location);
+
+        //Like the impostors the splat quads are built from gl_VertexID, core profile draws still need a bound VAO
+        glGenVertexArrays(1, &splat_vao);
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if (splatting()) {
+            std::size_t n_slots = min_splat_slots;
+            while (n_slots < n_particles && n_slots < max_splat_slots) n_slots *= 2;
+            for (std::size_t n_buckets = n_slots/slots_per_bucket; n_buckets > 1; n_buckets /= 2) splat_bucket_bits++;
+
+            glGenBuffers(1, &splat_cell_buffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, splat_cell_buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, n_slots*sizeof(SplatCell), NULL, GL_DYNAMIC_COPY);
+
+            glGenBuffers(1, &splat_list_buffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, splat_list_buffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, n_slots*sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+
+        glGenBuffers(1, &command_buffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(Commands), &commands, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        for (Readback &readback : readbacks) {
+            glGenBuffers(1, &readback.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(Commands), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    }
+
+    void Culler::cull(GlState::Cache &gl_state, GLuint cull_program, bool impostors, const glm::mat4 &vp_mat, const glm::vec3 &cam_pos, float projection_scale) {
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Commands), &commands);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, instances_binding, instance_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, commands_binding, command_buffer);
+
+        //Every slot free again, the hierarchy is rebuilt from scratch every frame
+        if (splatting()) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, splat_cell_buffer);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, splat_cells_binding, splat_cell_buffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, splat_list_binding, splat_list_buffer);
+        }
+
+        gl_state.use_program(cull_program);
+
+        std::array<glm::vec4, 6> planes = frustum_planes(vp_mat);
+
+        glUniform1ui(gl_state.uniform_location(cull_program, "n_particles"), static_cast<GLuint>(n_particles));
+        glUniform1i(gl_state.uniform_location(cull_program, "impostors"), impostors);
+        glUniform4fv(gl_state.uniform_location(cull_program, "frustum_planes"), 6, glm::value_ptr(planes[0]));
+        glUniform3fv(gl_state.uniform_location(cull_program, "cam_pos"), 1, glm::value_ptr(cam_pos));
+        glUniform1f(gl_state.uniform_location(cull_program, "projection_scale"), projection_scale);
+        glUniform1f(gl_state.uniform_location(cull_program, "min_pixel_radius"), min_radius);
+        glUniform1f(gl_state.uniform_location(cull_program, "splat_pixels"), splat_size);
+        glUniform1ui(gl_state.uniform_location(cull_program, "splat_bucket_bits"), splat_bucket_bits);
+        glUniform1fv(gl_state.uniform_location(cull_program, "lod_pixel_radii"), n_lods-1, lod_pixel_radii.data());
+
+        GpuParticles::dispatch_chunked(gl_state.uniform_location(cull_program, "dispatch_offset"), n_particles, local_size_x);
+
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+        read_counts();
+
+    }
+
+    void Culler::read_counts() {
+
+        Readback &readback = readbacks[next_readback];
+        next_readback = (next_readback + 1) % readback_latency;
+
+        //Written readback_latency frames ago, normally long done. If not that frame's counts are skipped and the
+        //previous ones stay.
+        if (readback.fence) {
+            GLenum status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            glDeleteSync(readback.fence);
+            readback.fence = 0;
+
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                Commands counted;
+                glBindBuffer(GL_COPY_READ_BUFFER, readback.buffer);
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(Commands), &counted);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+                //Only the commands of the kind that was culled count up, the others stay at zero
+                std::size_t visible = counted.impostors.instance_count;
+                for (const DrawElementsIndirectCommand &command : counted.lods) visible += command.instance_count;
+
+                latest_counts.visible = visible;
+                latest_counts.splatted = counted.splatted_stars;
+                latest_counts.splats = counted.splats.instance_count;
+                latest_counts.culled = n_particles - visible - latest_counts.splatted;
+                n_counted++;
+                visible_sum += latest_counts.visible;
+                splatted_sum += latest_counts.splatted;
+                culled_sum += latest_counts.culled;
+            }
+        }
+
+        glBindBuffer(GL_COPY_READ_BUFFER, command_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(Commands));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    }
+
+    void Culler::draw_impostors(GlState::Cache &gl_state) const {
+
+        gl_state.bind_vertex_array(impostor_vao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)offsetof(Commands, impostors));
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    }
+
+    void Culler::draw_meshes(GlState::Cache &gl_state) const {
+
+        gl_state.bind_vertex_array(mesh_vao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)offsetof(Commands, lods), n_lods, 0);
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    }
+
+    void Culler::draw_splats(GlState::Cache &gl_state) const {
+
+        gl_state.bind_vertex_array(splat_vao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)offsetof(Commands, splats));
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    }
+
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.hpp"
+
+//Decides on the GPU which stars get drawn and how. A compute pass tests every star's sphere against the view
+//frustum and drops the ones smaller on screen than a minimum radius, the others are appended to compacted instance
+//lists and counted into indirect draw commands. The impostors are one list and one DrawArraysIndirectCommand, the
+//sphere meshes one list and DrawElementsIndirectCommand per level of detail, picked by the size on screen and drawn
+//with a single glMultiDrawElementsIndirect. Either way the vertex stage only runs for visible stars, which it gets
+//from an instanced vertex attribute reading the lists, unlike gl_InstanceID that includes the command's base
+//instance.
+//
+//Distant stars smaller than a splat aren't drawn on their own, the same pass sums their light into the cells of a
+//grid hierarchy whose level is picked by distance so a cell is at most a splat wide on screen (see
+//splat_cells.glsl), and every occupied cell is drawn as one blurred splat. The number of splats is bounded by the
+//screen area they cover instead of the number of stars behind them.
+namespace StarCulling {
+
+    //Must match star_cull.comp
+    constexpr std::size_t n_lods = 3;
+    constexpr GLuint instances_binding = 6;
+    constexpr GLuint commands_binding = 7;
+
+    //Must match splat_cells.glsl
+    constexpr GLuint splat_cells_binding = 8;
+    constexpr GLuint splat_list_binding = 9;
+    constexpr float splat_base_cell_size = 0.25f;
+    constexpr unsigned max_splat_level = 15;
+    constexpr std::size_t slots_per_bucket = 8;
+
+    //Must match vertex.vert and impostor.vert, location 0 is the mesh vertex
+    constexpr GLuint particle_idx_location = 1;
+
+    //On screen radii in pixels where the next level starts. Below the first an icosahedron (20 triangles) is drawn,
+    //below the second a once subdivided one (80) and above it the latitude/longitude sphere (200).
+    constexpr std::array<float, n_lods-1> lod_pixel_radii = {{3.f, 10.f}};
+
+    //Stars with a smaller radius on screen, in pixels, are culled unless told otherwise
+    constexpr float default_min_pixel_radius = 0.25f;
+    //Width on screen in pixels of the largest splats, smaller stars are summed into them
+    constexpr float default_splat_pixels = 2.f;
+
+    //Slots in the splat hash table, scaled with the particle count between these. Each bucket needs a tag of at
+    //most 31 bits, so there have to be at least 2^12 buckets.
+    constexpr std::size_t min_splat_slots = std::size_t(1) << 15;
+    constexpr std::size_t max_splat_slots = std::size_t(1) << 20;
+
+    //Frames the counts are read back late, so reading them never waits for the GPU. Counts that still aren't there
+    //then are skipped.
+    constexpr std::size_t readback_latency = 3;
+
+    struct Counts {
+        //Drawn on their own
+        std::size_t visible = 0;
+        //Summed into splats, and the number of splats drawn
+        std::size_t splatted = 0;
+        std::size_t splats = 0;
+        std::size_t culled = 0;
+    };
+
+    class Culler {
+    public:
+
+        //Uploads the meshes and makes room for n_particles stars in every list. A splat_pixels of 0 draws every
+        //visible star on its own. Needs a current GL context, the buffers go away with it.
+        Culler(std::size_t n_particles, float min_pixel_radius, float splat_pixels);
+
+        Culler(const Culler&) = delete;
+        Culler& operator=(const Culler&) = delete;
+
+        //Fills the lists with cull_program (star_cull.comp), for the impostors or the meshes. vp_mat is the view
+        //and projection matrix, projection_scale the on screen size in pixels of something 1 unit wide at
+        //distance 1. The program is bound through gl_state.
+        void cull(GlState::Cache &gl_state, GLuint cull_program, bool impostors, const glm::mat4 &vp_mat, const glm::vec3 &cam_pos, float projection_scale);
+
+        //Draw the visible stars with the bound program, after cull() with the same kind. Their vertex arrays are bound
+        //through gl_state.
+        void draw_impostors(GlState::Cache &gl_state) const;
+        void draw_meshes(GlState::Cache &gl_state) const;
+        //Draws the splats with the bound program (splat.vert), after cull()
+        void draw_splats(GlState::Cache &gl_state) const;
+
+        bool splatting() const { return splat_size > 0.f; }
+
+        //Counts of the newest cull() whose results reached the CPU, usually readback_latency frames old
+        const Counts& counts() const { return latest_counts; }
+        //Sums over every cull() read back so far, skipped ones aside
+        std::uint64_t frames_counted() const { return n_counted; }
+        std::uint64_t total_visible() const { return visible_sum; }
+        std::uint64_t total_splatted() const { return splatted_sum; }
+        std::uint64_t total_culled() const { return culled_sum; }
+
+        float min_pixel_radius() const { return min_radius; }
+
+        std::size_t vertices(std::size_t lod) const { return lod_vertices[lod]; }
+        std::size_t triangles(std::size_t lod) const { return commands.lods[lod].count/3; }
+
+    private:
+
+        //Layouts fixed by glMultiDrawElementsIndirect and glDrawArraysIndirect
+        struct DrawElementsIndirectCommand {
+            GLuint count;
+            GLuint instance_count;
+            GLuint first_index;
+            GLint base_vertex;
+            GLuint base_instance;
+        };
+
+        struct DrawArraysIndirectCommand {
+            GLuint count;
+            GLuint instance_count;
+            GLuint first;
+            GLuint base_instance;
+        };
+
+        //Must match the commands block in star_cull.comp
+        struct Commands {
+            std::array<DrawElementsIndirectCommand, n_lods> lods;
+            DrawArraysIndirectCommand impostors;
+            DrawArraysIndirectCommand splats;
+            GLuint splatted_stars;
+        };
+
+        //Must match SplatCell in splat_cells.glsl
+        struct SplatCell {
+            GLuint tag;
+            GLuint level;
+            GLint x;
+            GLint y;
+            GLint z;
+            GLuint flux_r;
+            GLuint flux_g;
+            GLuint flux_b;
+        };
+
+        struct Readback {
+            GLuint buffer = 0;
+            GLsync fence = 0;
+        };
+
+        //Copies the commands of this frame's cull() into the ring and reads the oldest finished copies
+        void read_counts();
+
+        std::size_t n_particles;
+        float min_radius;
+        float splat_size;
+
+        GLuint mesh_vao;
+        GLuint impostor_vao;
+        GLuint splat_vao;
+        GLuint vertex_buffer;
+        GLuint index_buffer;
+        GLuint instance_buffer;
+        GLuint command_buffer;
+        GLuint splat_cell_buffer = 0;
+        GLuint splat_list_buffer = 0;
+        GLuint splat_bucket_bits = 0;
+
+        //Uploaded with zero instances before every cull() pass
+        Commands commands;
+        std::array<std::size_t, n_lods> lod_vertices;
+
+        std::array<Readback, readback_latency> readbacks;
+        std::size_t next_readback = 0;
+
+        Counts latest_counts;
+        std::uint64_t n_counted = 0;
+        std::uint64_t visible_sum = 0;
+        std::uint64_t splatted_sum = 0;
+        std::uint64_t culled_sum = 0;
+
+    };
+
+}
@@ -0,0 +1,587 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef HAVE_ZSTD
+    #include <zstd.h>
+#endif
+
+#include "parallel.hpp"
+#include "particle_file.hpp"
+#include "trajectory.hpp"
+
+namespace {
+
+    constexpr char file_magic[8] = {'G', 'S', 'I', 'M', 'T', 'R', 'J', 0};
+    constexpr char index_magic[8] = {'G', 'S', 'I', 'M', 'T', 'I', 'D', 'X'};
+    constexpr std::uint32_t frame_magic = 0x4d415246;
+    constexpr std::uint32_t format_version = 2;
+
+    constexpr int zstd_level = 3;
+
+    struct FileHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t endian_marker;
+        std::uint64_t n_particles;
+        std::uint64_t chunk_size;
+        std::uint64_t first_frame_offset;
+        std::uint32_t position_bits;
+        std::uint32_t padding;
+        //ICCache hash of the run's initial conditions, identifies the radii, masses and types that go with the positions
+        std::uint64_t ic_hash;
+    };
+
+    //Followed by n_chunks ChunkEntries and the chunk payloads
+    struct FrameHeader {
+        std::uint32_t magic;
+        std::uint32_t n_chunks;
+        std::uint64_t step;
+        double sim_time;
+        //Of the whole frame, header included
+        std::uint64_t size;
+        //Frame holding the particle order and ids of this frame's chunks, this frame itself for keyframes
+        std::uint64_t keyframe_offset;
+        float bbox_min[3];
+        float bbox_max[3];
+    };
+
+    //A compressed byte range
+    struct Blob {
+        //From the start of the file
+        std::uint64_t offset;
+        std::uint64_t stored_size;
+        std::uint64_t raw_size;
+        Trajectory::Codec codec;
+        std::uint32_t padding;
+    };
+
+    struct ChunkEntry {
+        float bbox_min[3];
+        float bbox_max[3];
+        std::uint32_t n;
+        std::uint32_t padding;
+        Blob positions;
+        //Only in keyframes
+        Blob ids;
+    };
+
+    struct Footer {
+        std::uint64_t index_offset;
+        std::uint64_t n_frames;
+        char magic[8];
+    };
+
+    typedef std::runtime_error Error;
+
+    Error file_error(const std::string &path, const char *msg) {
+        std::ostringstream err_msg_stream;
+        err_msg_stream << "Error: Trajectory \"" << path << "\": " << msg << "\n";
+        return Error(err_msg_stream.str());
+    }
+
+    //Interleaves the low 21 bits of x with two zero bits each
+    std::uint64_t spread_bits(std::uint64_t x) {
+        x &= 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffff;
+        x = (x | x << 16) & 0x1f0000ff0000ff;
+        x = (x | x << 8) & 0x100f00f00f00f00f;
+        x = (x | x << 4) & 0x10c30c30c30c30c3;
+        x = (x | x << 2) & 0x1249249249249249;
+        return x;
+    }
+
+    std::uint64_t morton_code(glm::vec3 p, const Trajectory::Box &box) {
+        glm::vec3 extent = box.max - box.min;
+        std::uint64_t code = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            float t = extent[axis] > 0.f ? (p[axis] - box.min[axis])/extent[axis] : 0.f;
+            std::uint64_t q = static_cast<std::uint64_t>(std::clamp(t, 0.f, 1.f)*2097151.f);
+            code |= spread_bits(q) << axis;
+        }
+        return code;
+    }
+
+    std::uint32_t zigzag32(std::uint32_t delta) {
+        std::int32_t d = static_cast<std::int32_t>(delta);
+        return (static_cast<std::uint32_t>(d) << 1) ^ static_cast<std::uint32_t>(d >> 31);
+    }
+    std::uint32_t unzigzag32(std::uint32_t z) {
+        return (z >> 1) ^ (0u - (z & 1u));
+    }
+
+    std::uint16_t zigzag16(std::uint16_t delta) {
+        std::int16_t d = static_cast<std::int16_t>(delta);
+        return static_cast<std::uint16_t>((static_cast<std::uint16_t>(d) << 1) ^ static_cast<std::uint16_t>(d >> 15));
+    }
+    std::uint16_t unzigzag16(std::uint16_t z) {
+        return static_cast<std::uint16_t>((z >> 1) ^ (0u - (z & 1u)));
+    }
+
+    //The 4 byte planes of the zigzagged id deltas. Splitting the planes groups the mostly zero high bytes together.
+    void encode_ids(const std::uint32_t *ids, std::size_t n, unsigned char *out) {
+        std::uint32_t prev_id = 0;
+        for (std::size_t k = 0; k < n; k++) {
+            std::uint32_t z = zigzag32(ids[k] - prev_id);
+            prev_id = ids[k];
+            for (std::size_t b = 0; b < 4; b++) out[b*n + k] = static_cast<unsigned char>(z >> (8*b));
+        }
+    }
+
+    void decode_ids(const unsigned char *in, std::size_t n, std::uint32_t *ids) {
+        std::uint32_t id = 0;
+        for (std::size_t k = 0; k < n; k++) {
+            std::uint32_t z = 0;
+            for (std::size_t b = 0; b < 4; b++) z |= static_cast<std::uint32_t>(in[b*n + k]) << (8*b);
+            id += unzigzag32(z);
+            ids[k] = id;
+        }
+    }
+
+    float quant_max(unsigned bits) {
+        return static_cast<float>((1u << bits) - 1u);
+    }
+
+    //For every axis the 2 byte planes of the zigzagged deltas of the positions quantized inside box, in ids order
+    void encode_positions(const std::uint32_t *ids, std::size_t n, const glm::vec4 *positions, const Trajectory::Box &box, unsigned bits, unsigned char *out) {
+        glm::vec3 extent = box.max - box.min;
+        float q_max = quant_max(bits);
+        for (int axis = 0; axis < 3; axis++) {
+            unsigned char *planes = out + 2*n*axis;
+            float scale = extent[axis] > 0.f ? q_max/extent[axis] : 0.f;
+            std::uint16_t prev = 0;
+            for (std::size_t k = 0; k < n; k++) {
+                float t = (positions[ids[k]][axis] - box.min[axis])*scale;
+                std::uint16_t q = static_cast<std::uint16_t>(std::clamp(std::round(t), 0.f, q_max));
+                std::uint16_t z = zigzag16(static_cast<std::uint16_t>(q - prev));
+                prev = q;
+                planes[k] = static_cast<unsigned char>(z);
+                planes[n + k] = static_cast<unsigned char>(z >> 8);
+            }
+        }
+    }
+
+    void decode_positions(const unsigned char *in, std::size_t n, const Trajectory::Box &box, unsigned bits, glm::vec3 *out) {
+        glm::vec3 step = (box.max - box.min)/quant_max(bits);
+        for (int axis = 0; axis < 3; axis++) {
+            const unsigned char *planes = in + 2*n*axis;
+            std::uint16_t q = 0;
+            for (std::size_t k = 0; k < n; k++) {
+                q = static_cast<std::uint16_t>(q + unzigzag16(static_cast<std::uint16_t>(planes[k] | (planes[n + k] << 8))));
+                out[k][axis] = box.min[axis] + static_cast<float>(q)*step[axis];
+            }
+        }
+    }
+
+    //Compresses raw into payload if the codec is zstd and it actually helps, stores it as is otherwise
+    void pack_blob(std::vector<unsigned char> &raw, Trajectory::Codec codec, Blob &blob, std::vector<unsigned char> &payload) {
+
+        blob.raw_size = raw.size();
+        blob.codec = Trajectory::Codec::none;
+
+        #ifdef HAVE_ZSTD
+            if (codec == Trajectory::Codec::zstd) {
+                payload.resize(ZSTD_compressBound(raw.size()));
+                std::size_t size = ZSTD_compress(payload.data(), payload.size(), raw.data(), raw.size(), zstd_level);
+                if (!ZSTD_isError(size) && size < raw.size()) {
+                    payload.resize(size);
+                    blob.codec = Trajectory::Codec::zstd;
+                }
+            }
+        #else
+            (void)codec;
+        #endif
+
+        if (blob.codec == Trajectory::Codec::none) payload.swap(raw);
+        blob.stored_size = payload.size();
+
+    }
+
+    //Contents of a blob of raw_size bytes, decompressed into scratch if needed
+    const unsigned char* unpack_blob(const File::MappedFile &file, const Blob &blob, std::size_t raw_size, std::vector<unsigned char> &scratch, const std::string &path) {
+
+        if (blob.offset > file.size() || blob.stored_size > file.size() - blob.offset || blob.raw_size != raw_size)
+            throw file_error(path, "corrupt chunk table");
+
+        if (blob.codec == Trajectory::Codec::none) {
+            if (blob.stored_size != blob.raw_size) throw file_error(path, "corrupt chunk table");
+            return file.data() + blob.offset;
+        }
+
+        if (blob.codec == Trajectory::Codec::zstd) {
+            #ifdef HAVE_ZSTD
+                scratch.resize(blob.raw_size);
+                std::size_t size = ZSTD_decompress(scratch.data(), scratch.size(), file.data() + blob.offset, blob.stored_size);
+                if (ZSTD_isError(size) || size != blob.raw_size) throw file_error(path, "corrupt zstd chunk");
+                return scratch.data();
+            #else
+                (void)scratch;
+                throw file_error(path, "chunk is zstd compressed but this build has no zstd");
+            #endif
+        }
+
+        throw file_error(path, "unknown chunk codec");
+
+    }
+
+    Trajectory::Box box_of(const ChunkEntry &chunk) {
+        return {glm::vec3(chunk.bbox_min[0], chunk.bbox_min[1], chunk.bbox_min[2]), glm::vec3(chunk.bbox_max[0], chunk.bbox_max[1], chunk.bbox_max[2])};
+    }
+
+    FrameHeader read_frame_header(const File::MappedFile &file, std::uint64_t offset, const std::string &path) {
+        FrameHeader header;
+        if (offset > file.size() || file.size() - offset < sizeof(FrameHeader)) throw file_error(path, "corrupt frame offset");
+        std::memcpy(&header, file.data() + offset, sizeof(header));
+        if (header.magic != frame_magic || header.size > file.size() - offset ||
+                sizeof(FrameHeader) + static_cast<std::uint64_t>(header.n_chunks)*sizeof(ChunkEntry) > header.size)
+            throw file_error(path, "corrupt frame");
+        return header;
+    }
+
+    ChunkEntry read_chunk_entry(const File::MappedFile &file, std::uint64_t frame_offset, std::size_t chunk_idx) {
+        ChunkEntry chunk;
+        std::memcpy(&chunk, file.data() + frame_offset + sizeof(FrameHeader) + chunk_idx*sizeof(ChunkEntry), sizeof(chunk));
+        return chunk;
+    }
+
+    //Decodes chunk_idx of a frame into ids and positions, the ids come from the frame's keyframe
+    void decode_chunk(const File::MappedFile &file, const FrameHeader &header, std::uint64_t frame_offset, std::size_t chunk_idx, unsigned bits,
+                      std::vector<std::uint32_t> &ids, std::vector<glm::vec3> &positions, std::vector<unsigned char> &scratch, const std::string &path) {
+
+        ChunkEntry chunk = read_chunk_entry(file, frame_offset, chunk_idx);
+
+        ChunkEntry key_chunk = chunk;
+        if (header.keyframe_offset != frame_offset) {
+            FrameHeader key_header = read_frame_header(file, header.keyframe_offset, path);
+            if (key_header.n_chunks != header.n_chunks) throw file_error(path, "frame doesn't match its keyframe");
+            key_chunk = read_chunk_entry(file, header.keyframe_offset, chunk_idx);
+            if (key_chunk.n != chunk.n) throw file_error(path, "frame doesn't match its keyframe");
+        }
+
+        ids.resize(chunk.n);
+        positions.resize(chunk.n);
+        decode_ids(unpack_blob(file, key_chunk.ids, chunk.n*sizeof(std::uint32_t), scratch, path), chunk.n, ids.data());
+        decode_positions(unpack_blob(file, chunk.positions, chunk.n*3*sizeof(std::uint16_t), scratch, path), chunk.n, box_of(chunk), bits, positions.data());
+
+    }
+
+}
+
+namespace Trajectory {
+
+    bool Box::intersects(const Box &other) const {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+               min.y <= other.max.y && max.y >= other.min.y &&
+               min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    bool Box::contains(glm::vec3 p) const {
+        return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z;
+    }
+
+    Codec default_codec() {
+        #ifdef HAVE_ZSTD
+            return Codec::zstd;
+        #else
+            return Codec::none;
+        #endif
+    }
+
+    Writer::Writer(const std::string &path, std::size_t n_particles, std::uint64_t ic_hash, unsigned position_bits, Codec codec) :
+        path(path), n_particles(n_particles), position_bits(position_bits), codec(codec) {
+
+        if (position_bits < 1 || position_bits > 16) throw file_error(path, "position bits have to be between 1 and 16");
+
+        #ifndef HAVE_ZSTD
+            if (codec == Codec::zstd) throw file_error(path, "this build has no zstd");
+        #endif
+        if (!ParticleFile::is_little_endian()) throw file_error(path, "trajectories can only be written on little endian hosts");
+        if (n_particles > std::numeric_limits<std::uint32_t>::max()) throw file_error(path, "too many particles for 32 bit ids");
+
+        file = std::make_unique<AsyncFile::Writer>(path);
+
+        FileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, file_magic, sizeof(file_magic));
+        header.version = format_version;
+        header.endian_marker = ParticleFile::endian_marker;
+        header.n_particles = n_particles;
+        header.chunk_size = chunk_size;
+        header.first_frame_offset = sizeof(FileHeader);
+        header.position_bits = position_bits;
+        header.ic_hash = ic_hash;
+
+        file->write(&header, sizeof(header));
+        written_bytes = sizeof(header);
+
+    }
+
+    Writer::~Writer() {
+        if (!open) return;
+        try {
+            close();
+        }
+        catch (std::exception &e) {
+            std::fprintf(stderr, "%s", e.what());
+        }
+    }
+
+    void Writer::write_frame(const Snapshot::Frame &frame) {
+
+        if (!open) throw file_error(path, "writer is closed");
+        if (frame.n_particles != n_particles) throw file_error(path, "particle count changed between frames");
+
+        std::size_t n = n_particles;
+        const glm::vec4 *positions = frame.positions;
+
+        //Bounding box of the frame, reduced per parallel chunk
+        std::size_t bbox_chunk = 1 << 16;
+        std::vector<Box> partial_boxes((n + bbox_chunk - 1)/bbox_chunk);
+        Parallel::parallel_for(n, bbox_chunk, [&](std::size_t begin, std::size_t end) {
+            Box box = {glm::vec3(positions[begin]), glm::vec3(positions[begin])};
+            for (std::size_t i = begin+1; i < end; i++) {
+                box.min = glm::min(box.min, glm::vec3(positions[i]));
+                box.max = glm::max(box.max, glm::vec3(positions[i]));
+            }
+            partial_boxes[begin/bbox_chunk] = box;
+        });
+        Box frame_box = {glm::vec3(0.f), glm::vec3(0.f)};
+        for (std::size_t c = 0; c < partial_boxes.size(); c++) {
+            frame_box.min = c == 0 ? partial_boxes[c].min : glm::min(frame_box.min, partial_boxes[c].min);
+            frame_box.max = c == 0 ? partial_boxes[c].max : glm::max(frame_box.max, partial_boxes[c].max);
+        }
+
+        //Keyframes sort the particles along the Morton curve, so every chunk is a compact region of space, and store
+        //the ids in that order. The frames after one reuse its order, particles barely move between snapshots.
+        bool keyframe = frames_since_keyframe == 0 || frames_since_keyframe >= keyframe_interval;
+        if (keyframe) {
+            struct Key {
+                std::uint64_t code;
+                std::uint32_t id;
+            };
+            std::vector<Key> keys(n);
+            Parallel::parallel_for(n, 1 << 16, [&](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; i++) keys[i] = {morton_code(glm::vec3(positions[i]), frame_box), static_cast<std::uint32_t>(i)};
+            });
+            Parallel::parallel_sort(keys, [](const Key &a, const Key &b) { return a.code < b.code || (a.code == b.code && a.id < b.id); });
+
+            order.resize(n);
+            for (std::size_t i = 0; i < n; i++) order[i] = keys[i].id;
+
+            keyframe_offset = written_bytes;
+            frames_since_keyframe = 0;
+        }
+        frames_since_keyframe++;
+
+        std::size_t n_chunks = (n + chunk_size - 1)/chunk_size;
+        std::vector<ChunkEntry> chunks(n_chunks);
+        std::vector<std::vector<unsigned char>> position_payloads(n_chunks);
+        std::vector<std::vector<unsigned char>> id_payloads(n_chunks);
+
+        Parallel::parallel_for(n_chunks, 1, [&](std::size_t begin, std::size_t end) {
+            std::vector<unsigned char> raw;
+            for (std::size_t c = begin; c < end; c++) {
+                std::size_t first = c*chunk_size;
+                std::size_t count = std::min(chunk_size, n - first);
+                const std::uint32_t *chunk_ids = order.data() + first;
+
+                Box box = {glm::vec3(positions[chunk_ids[0]]), glm::vec3(positions[chunk_ids[0]])};
+                for (std::size_t k = 1; k < count; k++) {
+                    box.min = glm::min(box.min, glm::vec3(positions[chunk_ids[k]]));
+                    box.max = glm::max(box.max, glm::vec3(positions[chunk_ids[k]]));
+                }
+
+                ChunkEntry &chunk = chunks[c];
+                std::memset(&chunk, 0, sizeof(chunk));
+                for (int axis = 0; axis < 3; axis++) {
+                    chunk.bbox_min[axis] = box.min[axis];
+                    chunk.bbox_max[axis] = box.max[axis];
+                }
+                chunk.n = static_cast<std::uint32_t>(count);
+
+                raw.resize(count*3*sizeof(std::uint16_t));
+                encode_positions(chunk_ids, count, positions, box, position_bits, raw.data());
+                pack_blob(raw, codec, chunk.positions, position_payloads[c]);
+
+                if (keyframe) {
+                    raw.resize(count*sizeof(std::uint32_t));
+                    encode_ids(chunk_ids, count, raw.data());
+                    pack_blob(raw, codec, chunk.ids, id_payloads[c]);
+                }
+            }
+        });
+
+        FrameHeader header;
+        std::memset(&header, 0, sizeof(header));
+        header.magic = frame_magic;
+        header.n_chunks = static_cast<std::uint32_t>(n_chunks);
+        header.step = frame.step;
+        header.sim_time = frame.sim_time;
+        header.keyframe_offset = keyframe_offset;
+        for (int axis = 0; axis < 3; axis++) {
+            header.bbox_min[axis] = frame_box.min[axis];
+            header.bbox_max[axis] = frame_box.max[axis];
+        }
+
+        //Payloads follow the chunk table, ids first so a keyframe's ids are contiguous
+        std::uint64_t frame_offset = written_bytes;
+        std::uint64_t offset = frame_offset + sizeof(FrameHeader) + n_chunks*sizeof(ChunkEntry);
+        for (std::size_t c = 0; c < n_chunks; c++) {
+            chunks[c].ids.offset = offset;
+            offset += chunks[c].ids.stored_size;
+        }
+        for (std::size_t c = 0; c < n_chunks; c++) {
+            chunks[c].positions.offset = offset;
+            offset += chunks[c].positions.stored_size;
+        }
+        header.size = offset - frame_offset;
+
+        file->write(&header, sizeof(header));
+        file->write(chunks.data(), n_chunks*sizeof(ChunkEntry));
+        for (const std::vector<unsigned char> &payload : id_payloads) file->write(payload.data(), payload.size());
+        for (const std::vector<unsigned char> &payload : position_payloads) file->write(payload.data(), payload.size());
+
+        written_bytes = offset;
+        raw_bytes += n*sizeof(glm::vec4);
+        index.push_back({frame.step, frame.sim_time, frame_offset, header.size});
+
+    }
+
+    void Writer::close() {
+
+        if (!open) return;
+
+        Footer footer;
+        std::memset(&footer, 0, sizeof(footer));
+        footer.index_offset = written_bytes;
+        footer.n_frames = index.size();
+        std::memcpy(footer.magic, index_magic, sizeof(index_magic));
+
+        open = false;
+        file->write(index.data(), index.size()*sizeof(FrameInfo));
+        file->write(&footer, sizeof(footer));
+        file->close();
+        written_bytes += index.size()*sizeof(FrameInfo) + sizeof(footer);
+
+    }
+
+    Snapshot::Sink sink(std::shared_ptr<Writer> writer) {
+        return [writer](const Snapshot::Frame &frame) { writer->write_frame(frame); };
+    }
+
+    Reader::Reader(const std::string &path) : path(path), mapped(path), particle_count(0), position_bits(0), initial_conditions_hash(0) {
+
+        FileHeader header;
+        if (mapped.size() < sizeof(FileHeader)) throw file_error(path, "file is too small");
+        std::memcpy(&header, mapped.data(), sizeof(header));
+        if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0) throw file_error(path, "not a trajectory file");
+        if (header.version != format_version) throw file_error(path, "unsupported version");
+        if (header.endian_marker != ParticleFile::endian_marker) throw file_error(path, "wrong byte order");
+        if (header.position_bits < 1 || header.position_bits > 16) throw file_error(path, "corrupt header");
+        particle_count = header.n_particles;
+        position_bits = header.position_bits;
+        initial_conditions_hash = header.ic_hash;
+
+        //Use the index if the writer got to close the file, otherwise walk the frames
+        Footer footer;
+        bool indexed = false;
+        if (mapped.size() >= sizeof(FileHeader) + sizeof(Footer)) {
+            std::memcpy(&footer, mapped.data() + mapped.size() - sizeof(Footer), sizeof(footer));
+            indexed = std::memcmp(footer.magic, index_magic, sizeof(index_magic)) == 0;
+        }
+
+        //Checked piecewise, so a corrupt footer can't wrap the sum around
+        if (indexed) {
+            std::uint64_t index_end = mapped.size() - sizeof(Footer);
+            if (footer.index_offset > index_end || footer.n_frames > (index_end - footer.index_offset)/sizeof(FrameInfo) ||
+                    footer.index_offset + footer.n_frames*sizeof(FrameInfo) != index_end)
+                throw file_error(path, "corrupt frame index");
+        }
+
+        if (indexed) {
+            frames.resize(footer.n_frames);
+            std::memcpy(frames.data(), mapped.data() + footer.index_offset, footer.n_frames*sizeof(FrameInfo));
+        }
+        else {
+            std::uint64_t offset = header.first_frame_offset;
+            while (offset + sizeof(FrameHeader) <= mapped.size()) {
+                FrameHeader frame_header;
+                std::memcpy(&frame_header, mapped.data() + offset, sizeof(frame_header));
+                if (frame_header.magic != frame_magic || frame_header.size > mapped.size() - offset) break;
+                frames.push_back({frame_header.step, frame_header.sim_time, offset, frame_header.size});
+                offset += frame_header.size;
+            }
+        }
+
+        for (const FrameInfo &frame : frames)
+            if (frame.offset > mapped.size() || frame.size > mapped.size() - frame.offset || frame.size < sizeof(FrameHeader))
+                throw file_error(path, "corrupt frame index");
+
+    }
+
+    std::size_t Reader::find_frame(double sim_time) const {
+        auto it = std::upper_bound(frames.begin(), frames.end(), sim_time, [](double t, const FrameInfo &frame) { return t < frame.sim_time; });
+        return it == frames.begin() ? 0 : static_cast<std::size_t>(it - frames.begin()) - 1;
+    }
+
+    void Reader::prefetch(std::size_t frame_idx) const {
+        const FrameInfo &info = frames[frame_idx];
+        mapped.will_need(info.offset, info.size);
+        FrameHeader header = read_frame_header(mapped, info.offset, path);
+        //The ids sit at the start of the keyframe's payloads, right after its chunk table
+        if (header.keyframe_offset != info.offset) {
+            FrameHeader key_header = read_frame_header(mapped, header.keyframe_offset, path);
+            mapped.will_need(header.keyframe_offset, key_header.size);
+        }
+    }
+
+    void Reader::read_frame(std::size_t frame_idx, glm::vec3 *positions) const {
+
+        const FrameInfo &info = frames[frame_idx];
+        FrameHeader header = read_frame_header(mapped, info.offset, path);
+
+        std::size_t n = particle_count;
+        Parallel::parallel_for(header.n_chunks, 1, [&](std::size_t begin, std::size_t end) {
+            std::vector<std::uint32_t> ids;
+            std::vector<glm::vec3> chunk_positions;
+            std::vector<unsigned char> scratch;
+            for (std::size_t c = begin; c < end; c++) {
+                decode_chunk(mapped, header, info.offset, c, position_bits, ids, chunk_positions, scratch, path);
+                for (std::size_t k = 0; k < ids.size(); k++)
+                    if (ids[k] < n) positions[ids[k]] = chunk_positions[k];
+            }
+        });
+
+    }
+
+    std::vector<Particle> Reader::read_region(std::size_t frame_idx, const Box &region) const {
+
+        const FrameInfo &info = frames[frame_idx];
+        FrameHeader header = read_frame_header(mapped, info.offset, path);
+
+        std::vector<std::size_t> overlapping;
+        for (std::size_t c = 0; c < header.n_chunks; c++)
+            if (box_of(read_chunk_entry(mapped, info.offset, c)).intersects(region)) overlapping.push_back(c);
+
+        std::vector<std::vector<Particle>> found(overlapping.size());
+        Parallel::parallel_for(overlapping.size(), 1, [&](std::size_t begin, std::size_t end) {
+            std::vector<std::uint32_t> ids;
+            std::vector<glm::vec3> chunk_positions;
+            std::vector<unsigned char> scratch;
+            for (std::size_t i = begin; i < end; i++) {
+                decode_chunk(mapped, header, info.offset, overlapping[i], position_bits, ids, chunk_positions, scratch, path);
+                for (std::size_t k = 0; k < ids.size(); k++)
+                    if (region.contains(chunk_positions[k])) found[i].push_back({ids[k], chunk_positions[k]});
+            }
+        });
+
+        std::vector<Particle> particles;
+        for (const std::vector<Particle> &f : found) particles.insert(particles.end(), f.begin(), f.end());
+        return particles;
+
+    }
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "async_file.hpp"
+#include "mapped_file.hpp"
+#include "snapshot.hpp"
+
+//Compressed trajectory container. Keyframes sort the particles along a Morton curve over the frame's bounding box
+//and split them into chunks of neighbouring particles, the frames up to the next keyframe reuse that order. A chunk
+//stores its bounding box and the positions quantized inside that box and delta encoded along the curve,
+//keyframe chunks also store the particle ids. Byte planes are split and compressed with zstd when it's available.
+//A frame index at the end of the file gives random access by time, and the chunk boxes let a reader decompress
+//only the part of a frame that overlaps a region.
+namespace Trajectory {
+
+    struct Box {
+        glm::vec3 min;
+        glm::vec3 max;
+
+        bool intersects(const Box &other) const;
+        bool contains(glm::vec3 p) const;
+    };
+
+    //Particles per chunk
+    constexpr std::size_t chunk_size = 16384;
+
+    //Frames per keyframe, only keyframes store the particle order and ids
+    constexpr std::size_t keyframe_interval = 16;
+
+    //Positions are quantized to this many bits per axis inside their chunk's box. The error is at most half a step,
+    //e.g. about 0.15 for a 1000 wide outer chunk at 12 bits. 16 bits roughly halves the compression ratio, 10 bits
+    //improves it by a third.
+    constexpr unsigned default_position_bits = 12;
+
+    enum class Codec : std::uint32_t {
+        none = 0,
+        zstd = 1,
+    };
+
+    //Codec new files are written with, zstd if the build found it
+    Codec default_codec();
+
+    //Entry of the frame index, where a frame is and which step it holds
+    struct FrameInfo {
+        std::uint64_t step;
+        double sim_time;
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    class Writer {
+    public:
+
+        //ic_hash identifies the initial conditions, the trajectory only stores positions. Throws std::runtime_error if
+        //the file can't be created.
+        Writer(const std::string &path, std::size_t n_particles, std::uint64_t ic_hash,
+               unsigned position_bits = default_position_bits, Codec codec = default_codec());
+        ~Writer();
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        //Encodes and appends a frame, the chunks are encoded in parallel. Throws std::runtime_error on failure.
+        void write_frame(const Snapshot::Frame &frame);
+
+        //Writes the frame index. Without it, readers fall back to scanning the frames.
+        void close();
+
+        std::uint64_t bytes_in() const { return raw_bytes; }
+        std::uint64_t bytes_out() const { return written_bytes; }
+
+        const AsyncFile::Writer& output() const { return *file; }
+
+    private:
+
+        std::string path;
+        std::unique_ptr<AsyncFile::Writer> file;
+        bool open = true;
+        std::size_t n_particles;
+        unsigned position_bits;
+        Codec codec;
+
+        std::vector<FrameInfo> index;
+
+        //Particle order of the last keyframe
+        std::vector<std::uint32_t> order;
+        std::uint64_t keyframe_offset = 0;
+        std::size_t frames_since_keyframe = 0;
+
+        std::uint64_t raw_bytes = 0;
+        std::uint64_t written_bytes = 0;
+
+    };
+
+    //Snapshot sink appending every frame to writer
+    Snapshot::Sink sink(std::shared_ptr<Writer> writer);
+
+    struct Particle {
+        std::uint32_t id;
+        glm::vec3 position;
+    };
+
+    class Reader {
+    public:
+
+        //Maps the file. Throws std::runtime_error if it isn't a trajectory or uses a codec this build lacks.
+        explicit Reader(const std::string &path);
+
+        std::size_t n_particles() const { return particle_count; }
+        std::uint64_t ic_hash() const { return initial_conditions_hash; }
+        std::size_t n_frames() const { return frames.size(); }
+        const FrameInfo& frame(std::size_t i) const { return frames[i]; }
+
+        //Last frame at or before sim_time, the first frame if there is none
+        std::size_t find_frame(double sim_time) const;
+
+        //Decodes the whole frame in parallel, positions[id] = position. positions has to hold n_particles().
+        void read_frame(std::size_t frame_idx, glm::vec3 *positions) const;
+
+        //Only decodes the chunks whose boxes overlap region and returns the particles inside it
+        std::vector<Particle> read_region(std::size_t frame_idx, const Box &region) const;
+
+        //Hints the OS to start reading a frame in
+        void prefetch(std::size_t frame_idx) const;
+
+        const File::MappedFile& file() const { return mapped; }
+
+    private:
+
+        std::string path;
+        File::MappedFile mapped;
+        std::size_t particle_count;
+        unsigned position_bits;
+        std::uint64_t initial_conditions_hash;
+        std::vector<FrameInfo> frames;
+
+    };
+
+}